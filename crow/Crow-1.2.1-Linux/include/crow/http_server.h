@@ -257,6 +257,10 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                   [this, p, &ic, context_idx](error_code ec) {
                       if (!ec)
                       {
+                          // Frames chicos (presencia, chat): sin Nagle, que con el ACK
+                          // diferido del cliente los retrasa ~40 ms.
+                          error_code nodelay_ec;
+                          p->socket().set_option(tcp::no_delay(true), nodelay_ec);
                           asio::post(ic,
                             [p] {
                                 p->start();
@@ -1,5 +1,7 @@
 #pragma once
 #include <array>
+#include <atomic>
+#include <deque>
 #include "crow/logging.h"
 #include "crow/socket_adaptors.h"
 #include "crow/http_request.h"
@@ -57,10 +59,99 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             EndStatusCodes = 4999,
         };
 
+        /// An immutable payload shared by every connection it is sent to.
+        using shared_payload = std::shared_ptr<const std::string>;
+
+        /// Generate the websocket headers using an opcode and the message size (in bytes).
+        inline std::string build_frame_header(int opcode, size_t size)
+        {
+            char buf[2 + 8] = "\x80\x00";
+            buf[0] += opcode;
+            if (size < 126)
+            {
+                buf[1] += static_cast<char>(size);
+                return {buf, buf + 2};
+            }
+            else if (size < 0x10000)
+            {
+                buf[1] += 126;
+                *(uint16_t*)(buf + 2) = htons(static_cast<uint16_t>(size));
+                return {buf, buf + 4};
+            }
+            else
+            {
+                buf[1] += 127;
+                *reinterpret_cast<uint64_t*>(buf + 2) = ((1 == htonl(1)) ? static_cast<uint64_t>(size) : (static_cast<uint64_t>(htonl((size)&0xFFFFFFFF)) << 32) | htonl(static_cast<uint64_t>(size) >> 32));
+                return {buf, buf + 10};
+            }
+        }
+
+        /// What a frame carries, used by the slow-consumer policies of an \ref outbound_queue.
+        enum class frame_class : uint8_t
+        {
+            data,     ///< Messages the client cannot rebuild (chat, responses).
+            presence, ///< Presence notifications, superseded by newer ones.
+        };
+
+        /// A complete server-to-client frame (header and payload), encoded once.
+
+        ///
+        /// Server frames are never masked, so the same bytes can be written to
+        /// every connection without touching them again.
+        struct encoded_frame
+        {
+            shared_payload wire;
+            size_t header_size = 0;
+            frame_class cls = frame_class::data;
+
+            std::string payload() const { return wire->substr(header_size); }
+            size_t payload_size() const { return wire->size() - header_size; }
+        };
+
+        /// Encode a whole frame in a single allocation.
+        inline encoded_frame encode_frame(int opcode, const std::string& payload, frame_class cls = frame_class::data)
+        {
+            std::string header = build_frame_header(opcode, payload.size());
+            std::string wire;
+            wire.reserve(header.size() + payload.size());
+            wire += header;
+            wire += payload;
+            return encoded_frame{std::make_shared<const std::string>(std::move(wire)), header.size(), cls};
+        }
+
+        struct outbound_limits;
+        struct outbound_stats;
+
         /// A base class for websocket connection.
         struct connection
         {
             virtual void send_binary(std::string msg) = 0;
+
+            /// Queue a pre-encoded frame as-is.
+
+            ///
+            /// The default decodes the payload back into send_binary(), for implementations
+            /// without a write queue of their own.
+            virtual void send_frame(const encoded_frame& frame) { send_binary(frame.payload()); }
+
+            /// Queue a pre-encoded frame from the thread running this connection's io_context.
+
+            ///
+            /// Skips the post() that send_frame() needs when called from another thread.
+            virtual void queue_frame(const encoded_frame& frame) { send_frame(frame); }
+
+            /// The io_context this connection runs on, nullptr if it has none.
+            virtual asio::io_context* get_io_context() { return nullptr; }
+
+            /// Expires when the connection is destroyed; lock it before touching the connection from a posted task.
+            virtual std::weak_ptr<void> lifetime() { return {}; }
+
+            /// Bound the connection's outbound queue. Implementations without a queue ignore it.
+            virtual void set_outbound_limits(const outbound_limits&) {}
+
+            /// Snapshot of the outbound queue depth, safe to call from any thread.
+            virtual outbound_stats get_outbound_stats();
+
             virtual void send_text(std::string msg) = 0;
             virtual void send_ping(std::string msg) = 0;
             virtual void send_pong(std::string msg) = 0;
@@ -73,7 +164,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             void* userdata() { return userdata_; }
 
         private:
-            void* userdata_;
+            void* userdata_{nullptr};
         };
 
         // Modified version of the illustration in RFC6455 Section-5.2
@@ -99,6 +190,229 @@ namespace crow // NOTE: Already documented in "crow/app.h"
         // +---------------------------------------------------------------+
         //
 
+        /// A buffer in a connection's write queue.
+
+        ///
+        /// Either owns its bytes or keeps a reference to a shared payload, so a
+        /// broadcast does not copy its payload into every recipient's queue.
+        struct write_buffer
+        {
+            write_buffer(std::string s):
+              owned(std::move(s))
+            {}
+
+            write_buffer(shared_payload s):
+              shared(std::move(s))
+            {}
+
+            write_buffer() = default;
+
+            size_t size() const { return shared ? shared->size() : owned.size(); }
+
+            asio::const_buffer buffer() const
+            {
+                return shared ? asio::buffer(*shared) : asio::buffer(owned);
+            }
+
+            std::string owned;
+            shared_payload shared;
+        };
+
+        /// What to do when a frame does not fit in a connection's outbound queue.
+        enum class overflow_policy
+        {
+            drop_oldest,   ///< Discard the oldest queued frames, then the new one if still full.
+            drop_presence, ///< Discard queued presence frames; disconnect if data alone overflows.
+            disconnect,    ///< Close the connection with \ref outbound_limits::close_code.
+        };
+
+        /// Limits of an \ref outbound_queue. A limit of 0 means unlimited.
+        struct outbound_limits
+        {
+            size_t max_bytes = 0;
+            size_t max_messages = 0;
+            overflow_policy policy = overflow_policy::drop_oldest;
+            uint16_t close_code = CloseStatusCode::PolicyViolated;
+        };
+
+        /// Queue depth and drop counters of a connection.
+        struct outbound_stats
+        {
+            size_t queued_bytes = 0;
+            size_t queued_messages = 0;
+            size_t peak_bytes = 0;
+            uint64_t dropped_messages = 0;
+            uint64_t dropped_bytes = 0;
+            bool overflowed = false;
+        };
+
+        inline outbound_stats connection::get_outbound_stats() { return {}; }
+
+        /// Bounded queue of outgoing frames for one connection.
+
+        ///
+        /// Frames wait as pending until the connection starts writing them (in flight).
+        /// Both count towards the limits, but only pending frames can be dropped.
+        /// Control frames (handshake, close, ping, pong) are never dropped.
+        /// Must only be modified from the connection's thread; stats() may be read from anywhere.
+        class outbound_queue
+        {
+        public:
+            struct entry
+            {
+                write_buffer header;
+                write_buffer body;
+                frame_class cls = frame_class::data;
+                bool control = false;
+
+                size_t size() const { return header.size() + body.size(); }
+            };
+
+            enum class push_result
+            {
+                queued,
+                dropped,
+                disconnect,
+            };
+
+            void set_limits(const outbound_limits& limits) { limits_ = limits; }
+            const outbound_limits& limits() const { return limits_; }
+
+            push_result push(entry e)
+            {
+                if (!e.control)
+                {
+                    if (overflowed_)
+                        return count_drop(e.size());
+                    while (over_limit(e.size()))
+                    {
+                        if (limits_.policy == overflow_policy::drop_oldest)
+                        {
+                            if (!drop_first([](const entry& q) { return !q.control; }))
+                                return count_drop(e.size());
+                        }
+                        else if (limits_.policy == overflow_policy::drop_presence)
+                        {
+                            if (!drop_first([](const entry& q) { return !q.control && q.cls == frame_class::presence; }))
+                            {
+                                if (e.cls == frame_class::presence)
+                                    return count_drop(e.size());
+                                return overflow(e.size());
+                            }
+                        }
+                        else
+                        {
+                            return overflow(e.size());
+                        }
+                    }
+                }
+                pending_bytes_ += e.size();
+                pending_.push_back(std::move(e));
+                publish();
+                return push_result::queued;
+            }
+
+            bool empty() const { return pending_.empty(); }
+
+            /// Move every pending frame to \p in_flight.
+            void take(std::vector<entry>& in_flight)
+            {
+                for (auto& e : pending_)
+                {
+                    in_flight.push_back(std::move(e));
+                }
+                in_flight_bytes_ += pending_bytes_;
+                in_flight_messages_ += pending_.size();
+                pending_bytes_ = 0;
+                pending_.clear();
+            }
+
+            /// The frames moved by take() were written (or discarded).
+            void sent(const std::vector<entry>& in_flight)
+            {
+                for (const auto& e : in_flight)
+                {
+                    in_flight_bytes_ -= e.size();
+                }
+                in_flight_messages_ -= in_flight.size();
+                publish();
+            }
+
+            outbound_stats stats() const
+            {
+                outbound_stats st;
+                st.queued_bytes = queued_bytes_.load(std::memory_order_relaxed);
+                st.queued_messages = queued_messages_.load(std::memory_order_relaxed);
+                st.peak_bytes = peak_bytes_.load(std::memory_order_relaxed);
+                st.dropped_messages = dropped_messages_.load(std::memory_order_relaxed);
+                st.dropped_bytes = dropped_bytes_.load(std::memory_order_relaxed);
+                st.overflowed = overflowed_;
+                return st;
+            }
+
+        private:
+            bool over_limit(size_t extra) const
+            {
+                size_t bytes = pending_bytes_ + in_flight_bytes_ + extra;
+                size_t messages = pending_.size() + in_flight_messages_ + 1;
+                return (limits_.max_bytes && bytes > limits_.max_bytes) ||
+                       (limits_.max_messages && messages > limits_.max_messages);
+            }
+
+            template<typename Pred>
+            bool drop_first(Pred pred)
+            {
+                for (auto it = pending_.begin(); it != pending_.end(); ++it)
+                {
+                    if (pred(*it))
+                    {
+                        pending_bytes_ -= it->size();
+                        count_drop(it->size());
+                        pending_.erase(it);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            push_result count_drop(size_t bytes)
+            {
+                dropped_messages_.fetch_add(1, std::memory_order_relaxed);
+                dropped_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+                publish();
+                return push_result::dropped;
+            }
+
+            push_result overflow(size_t bytes)
+            {
+                overflowed_ = true;
+                count_drop(bytes);
+                return push_result::disconnect;
+            }
+
+            void publish()
+            {
+                size_t bytes = pending_bytes_ + in_flight_bytes_;
+                queued_bytes_.store(bytes, std::memory_order_relaxed);
+                queued_messages_.store(pending_.size() + in_flight_messages_, std::memory_order_relaxed);
+                if (bytes > peak_bytes_.load(std::memory_order_relaxed))
+                    peak_bytes_.store(bytes, std::memory_order_relaxed);
+            }
+
+            outbound_limits limits_;
+            std::deque<entry> pending_;
+            size_t pending_bytes_ = 0;
+            size_t in_flight_bytes_ = 0;
+            size_t in_flight_messages_ = 0;
+            std::atomic<bool> overflowed_{false};
+
+            std::atomic<size_t> queued_bytes_{0};
+            std::atomic<size_t> queued_messages_{0};
+            std::atomic<size_t> peak_bytes_{0};
+            std::atomic<uint64_t> dropped_messages_{0};
+            std::atomic<uint64_t> dropped_bytes_{0};
+        };
+
         /// A websocket connection.
 
         template<typename Adaptor, typename Handler>
@@ -246,6 +560,44 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                 send_data(0x2, std::move(msg));
             }
 
+            /// Queue a pre-encoded frame without building a header for this connection.
+            void send_frame(const encoded_frame& frame) override
+            {
+                post([this, frame]() {
+                    queue_frame(frame);
+                });
+            }
+
+            void queue_frame(const encoded_frame& frame) override
+            {
+                outbound_queue::entry e;
+                e.header = frame.wire;
+                e.cls = frame.cls;
+                enqueue(std::move(e));
+            }
+
+            asio::io_context* get_io_context() override
+            {
+                return &adaptor_.get_io_context();
+            }
+
+            std::weak_ptr<void> lifetime() override
+            {
+                return anchor_;
+            }
+
+            void set_outbound_limits(const outbound_limits& limits) override
+            {
+                dispatch([this, limits]() {
+                    outbound_.set_limits(limits);
+                });
+            }
+
+            outbound_stats get_outbound_stats() override
+            {
+                return outbound_.stats();
+            }
+
             /// Send a plaintext message.
             void send_text(std::string msg) override
             {
@@ -270,10 +622,11 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                     char status_buf[2];
                     *(uint16_t*)(status_buf) = htons(status_code);
 
-                    write_buffers_.emplace_back(std::move(header));
-                    write_buffers_.emplace_back(std::string(status_buf, 2));
-                    write_buffers_.emplace_back(msg);
-                    do_write();
+                    outbound_queue::entry e;
+                    e.header = header + std::string(status_buf, 2);
+                    e.body = msg;
+                    e.control = true;
+                    enqueue(std::move(e));
                 });
             }
 
@@ -297,25 +650,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             /// Generate the websocket headers using an opcode and the message size (in bytes).
             std::string build_header(int opcode, size_t size)
             {
-                char buf[2 + 8] = "\x80\x00";
-                buf[0] += opcode;
-                if (size < 126)
-                {
-                    buf[1] += static_cast<char>(size);
-                    return {buf, buf + 2};
-                }
-                else if (size < 0x10000)
-                {
-                    buf[1] += 126;
-                    *(uint16_t*)(buf + 2) = htons(static_cast<uint16_t>(size));
-                    return {buf, buf + 4};
-                }
-                else
-                {
-                    buf[1] += 127;
-                    *reinterpret_cast<uint64_t*>(buf + 2) = ((1 == htonl(1)) ? static_cast<uint64_t>(size) : (static_cast<uint64_t>(htonl((size)&0xFFFFFFFF)) << 32) | htonl(static_cast<uint64_t>(size) >> 32));
-                    return {buf, buf + 10};
-                }
+                return build_frame_header(opcode, size);
             }
 
             /// Send the HTTP upgrade response.
@@ -329,17 +664,19 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                   "Upgrade: websocket\r\n"
                   "Connection: Upgrade\r\n"
                   "Sec-WebSocket-Accept: ";
-                write_buffers_.emplace_back(header);
-                write_buffers_.emplace_back(std::move(hello));
-                write_buffers_.emplace_back(crlf);
+                std::string response = header + hello + crlf;
                 if (!subprotocol_.empty())
                 {
-                    write_buffers_.emplace_back("Sec-WebSocket-Protocol: ");
-                    write_buffers_.emplace_back(subprotocol_);
-                    write_buffers_.emplace_back(crlf);
+                    response += "Sec-WebSocket-Protocol: ";
+                    response += subprotocol_;
+                    response += crlf;
                 }
-                write_buffers_.emplace_back(crlf);
-                do_write();
+                response += crlf;
+
+                outbound_queue::entry e;
+                e.header = std::move(response);
+                e.control = true;
+                enqueue(std::move(e));
                 if (open_handler_)
                     open_handler_(*this);
                 do_read();
@@ -719,12 +1056,15 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             {
                 if (sending_buffers_.empty())
                 {
-                    sending_buffers_.swap(write_buffers_);
+                    outbound_.take(sending_buffers_);
                     std::vector<asio::const_buffer> buffers;
-                    buffers.reserve(sending_buffers_.size());
-                    for (auto& s : sending_buffers_)
+                    buffers.reserve(sending_buffers_.size() * 2);
+                    for (auto& e : sending_buffers_)
                     {
-                        buffers.emplace_back(asio::buffer(s));
+                        if (e.header.size())
+                            buffers.emplace_back(e.header.buffer());
+                        if (e.body.size())
+                            buffers.emplace_back(e.body.buffer());
                     }
                     auto watch = std::weak_ptr<void>{anchor_};
                     asio::async_write(
@@ -732,8 +1072,9 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                       [&, watch](const error_code& ec, std::size_t /*bytes_transferred*/) {
                           if (!ec && !close_connection_)
                           {
+                              outbound_.sent(sending_buffers_);
                               sending_buffers_.clear();
-                              if (!write_buffers_.empty())
+                              if (!outbound_.empty())
                                   do_write();
                               if (has_sent_close_)
                                   close_connection_ = true;
@@ -743,6 +1084,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                               auto anchor = watch.lock();
                               if (anchor == nullptr) { return; }
 
+                              outbound_.sent(sending_buffers_);
                               sending_buffers_.clear();
                               close_connection_ = true;
                               check_destroy();
@@ -779,9 +1121,23 @@ namespace crow // NOTE: Already documented in "crow/app.h"
 
             void send_data_impl(SendMessageType* s)
             {
-                auto header = build_header(s->opcode, s->payload.size());
-                write_buffers_.emplace_back(std::move(header));
-                write_buffers_.emplace_back(std::move(s->payload));
+                outbound_queue::entry e;
+                e.header = build_header(s->opcode, s->payload.size());
+                e.body = std::move(s->payload);
+                e.control = s->opcode >= 0x8;
+                enqueue(std::move(e));
+            }
+
+            /// Queue a frame applying the outbound limits, then start writing.
+            void enqueue(outbound_queue::entry e)
+            {
+                auto result = outbound_.push(std::move(e));
+                if (result == outbound_queue::push_result::disconnect)
+                {
+                    CROW_LOG_WARNING << "Websocket outbound queue overflow, closing connection";
+                    close("outbound queue overflow", outbound_.limits().close_code);
+                    return;
+                }
                 do_write();
             }
 
@@ -799,8 +1155,8 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             Adaptor adaptor_;
             Handler* handler_;
 
-            std::vector<std::string> sending_buffers_;
-            std::vector<std::string> write_buffers_;
+            std::vector<outbound_queue::entry> sending_buffers_;
+            outbound_queue outbound_;
 
             std::array<char, 4096> buffer_;
             bool is_binary_;
@@ -0,0 +1,37 @@
+#pragma once
+#include "crow.h"
+#include "shared_frame.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Destinatario de un fanout, capturado mientras se tiene el lock del
+// registro para poder entregar después sin él.
+struct FanoutTarget {
+    crow::websocket::connection* conn;
+    crow::asio::io_context* context;  // nullptr: se entrega en el hilo que llama
+    std::weak_ptr<void> lifetime;
+};
+
+// Reparte frames compartidos entre los io_context de Crow. Los destinatarios
+// se agrupan por el io_context dueño de su socket y se publica una sola tarea
+// por grupo, que escribe directamente en las colas de esas conexiones. La
+// entrega corre en paralelo en los hilos de Crow y sin locks del registro.
+class FanoutExecutor {
+public:
+    static FanoutExecutor& getInstance();
+
+    // Llamar con el lock del registro tomado (la conexión sigue viva).
+    static FanoutTarget target_for(crow::websocket::connection& conn);
+
+    void deliver(const SharedFrame& frame, const std::vector<FanoutTarget>& targets);
+
+    uint64_t batches_posted() const { return batches_posted_.load(std::memory_order_relaxed); }
+    uint64_t inline_deliveries() const { return inline_deliveries_.load(std::memory_order_relaxed); }
+
+private:
+    FanoutExecutor() = default;
+
+    std::atomic<uint64_t> batches_posted_{0};
+    std::atomic<uint64_t> inline_deliveries_{0};
+};
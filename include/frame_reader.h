@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Errores de decodificación de un frame del cliente.
+enum class ParseError : uint8_t {
+    None = 0,
+    Truncated,  // el frame terminó antes que el campo
+};
+
+inline const char* parse_error_name(ParseError error)
+{
+    switch (error)
+    {
+    case ParseError::None:
+        return "ok";
+    case ParseError::Truncated:
+        return "frame truncado";
+    }
+    return "desconocido";
+}
+
+// Lector de campos del protocolo binario sobre el buffer del frame, sin
+// copias ni excepciones. Las cadenas se devuelven como vistas al frame y solo
+// son válidas mientras este exista. El primer error queda registrado: las
+// lecturas siguientes fallan y devuelven valores vacíos, así que un handler
+// puede leer todos sus campos y revisar ok() una sola vez antes de actuar.
+class FrameReader {
+public:
+    explicit FrameReader(std::string_view data, size_t offset = 0) : data_(data), offset_(offset) {}
+
+    bool u8(uint8_t& out)
+    {
+        out = 0;
+        if (!require(1)) return false;
+        out = static_cast<uint8_t>(data_[offset_]);
+        offset_ += 1;
+        return true;
+    }
+
+    // Entero de 64 bits en big endian.
+    bool u64(uint64_t& out)
+    {
+        out = 0;
+        if (!require(8)) return false;
+        for (int i = 0; i < 8; i++)
+        {
+            out = (out << 8) | static_cast<uint8_t>(data_[offset_ + i]);
+        }
+        offset_ += 8;
+        return true;
+    }
+
+    // Cadena con prefijo de largo u8.
+    bool str8(std::string_view& out)
+    {
+        out = {};
+        uint8_t length = 0;
+        if (!u8(length)) return false;
+        if (!require(length)) return false;
+        out = data_.substr(offset_, length);
+        offset_ += length;
+        return true;
+    }
+
+    bool ok() const { return error_ == ParseError::None; }
+    ParseError error() const { return error_; }
+    size_t offset() const { return offset_; }
+    size_t remaining() const { return data_.size() - offset_; }
+
+private:
+    bool require(size_t n)
+    {
+        if (error_ != ParseError::None) return false;
+        if (n > data_.size() - offset_)
+        {
+            error_ = ParseError::Truncated;
+            return false;
+        }
+        return true;
+    }
+
+    std::string_view data_;
+    size_t offset_;
+    ParseError error_ = ParseError::None;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Historial de chats en buffers circulares de capacidad fija. Cada
+// conversación guarda sus últimos N mensajes en slots de tamaño fijo
+// protegidos por un seqlock: los escritores de una misma conversación se
+// serializan con un mutex propio y los lectores nunca toman locks, solo
+// descartan los slots que fueron sobrescritos mientras los copiaban.
+// Las conversaciones privadas se identifican por el par de IDs de usuario
+// (ver UserIdTable) empacado en 64 bits, y se reparten en stripes con su
+// propio lock lector/escritor, que solo se toma en exclusiva al crear una
+// conversación. Las salas (ver RoomRegistry) usan la misma tabla con llaves
+// cuya mitad alta es 0, que ningún par de usuarios puede producir.
+class HistoryStore {
+public:
+    static constexpr size_t kMaxAuthor = 32;
+    static constexpr size_t kMaxText = 255;
+
+    // private_capacity vale también para cada sala.
+    explicit HistoryStore(size_t general_capacity = 4096, size_t private_capacity = 1024, size_t stripe_count = 64);
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    // Devuelven la secuencia asignada al mensaje dentro de su conversación.
+    uint64_t append_general(std::string_view author, std::string_view text);
+    uint64_t append_private(uint32_t user_a, uint32_t user_b, std::string_view author, std::string_view text);
+    uint64_t append_room(uint32_t room_id, std::string_view author, std::string_view text);
+
+    // Agrega al final de `out` hasta max_entries de los mensajes más recientes,
+    // del más antiguo al más nuevo, como [len autor][autor][len texto][texto].
+    // Devuelve cuántos se escribieron.
+    size_t write_general(std::string& out, size_t max_entries) const;
+    size_t write_private(uint32_t user_a, uint32_t user_b, std::string& out, size_t max_entries) const;
+
+    // Resultado de una página. Cada conversación numera sus mensajes desde 1.
+    struct Page {
+        size_t count = 0;             // mensajes escritos
+        uint64_t first_seq = 0;       // secuencia del más antiguo escrito (0 si ninguno)
+        uint64_t oldest_retained = 1; // secuencia más antigua que sigue en el buffer
+        bool has_older() const { return count > 0 && first_seq > oldest_retained; }
+    };
+
+    // Como write_general/write_private, pero solo con mensajes anteriores a
+    // la secuencia `before` (0: desde el más reciente). Para retroceder se
+    // pide la siguiente página con before = first_seq.
+    Page write_general_page(std::string& out, uint64_t before, size_t max_entries) const;
+    Page write_private_page(uint32_t user_a, uint32_t user_b, std::string& out, uint64_t before, size_t max_entries) const;
+    Page write_room_page(uint32_t room_id, std::string& out, uint64_t before, size_t max_entries) const;
+
+    // Mensajes retenidos (como mucho la capacidad del buffer).
+    size_t general_size() const;
+    size_t private_size(uint32_t user_a, uint32_t user_b) const;
+    size_t room_size(uint32_t room_id) const;
+
+    // Copia de los mensajes retenidos, del más antiguo al más nuevo.
+    std::vector<std::pair<std::string, std::string>> general_messages() const;
+    std::vector<std::pair<std::string, std::string>> private_messages(uint32_t user_a, uint32_t user_b) const;
+
+    // Vacía todo el historial. No debe correr junto a lecturas o escrituras.
+    void clear();
+
+    // (min, max) en una sola llave: la misma para ambos sentidos.
+    static uint64_t conversation_key(uint32_t user_a, uint32_t user_b)
+    {
+        uint32_t lo = user_a < user_b ? user_a : user_b;
+        uint32_t hi = user_a < user_b ? user_b : user_a;
+        return (static_cast<uint64_t>(lo) << 32) | hi;
+    }
+    static uint64_t room_key(uint32_t room_id) { return room_id; }
+
+private:
+    class Ring;
+    class ConversationTable;
+    struct Stripe;
+
+    Stripe& stripe_for(uint64_t hash) const;
+    const Ring* find_ring(uint64_t key) const;
+    Ring* ring_for_append(uint64_t key);
+    const Ring* find_private(uint32_t user_a, uint32_t user_b) const;
+
+    size_t private_capacity_;
+    size_t stripe_count_;
+    std::unique_ptr<Ring> general_;
+    std::unique_ptr<Stripe[]> stripes_;
+};
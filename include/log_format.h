@@ -0,0 +1,177 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : uint8_t { Debug = 0, Info, Warn, Error, Off };
+
+// Subsistema que origina la línea; cada uno tiene su propio nivel mínimo.
+enum class LogComponent : uint8_t {
+    Server,    // arranque, parseo de mensajes
+    Session,   // conexiones, reconexiones, desconexiones
+    Chat,      // envío y entrega de mensajes
+    Presence,  // estados y notificaciones 53/54
+    History,   // historial y búsqueda
+    Storage,   // log de mensajes y snapshots
+    Count
+};
+
+const char* log_level_name(LogLevel level);
+const char* log_component_name(LogComponent component);
+bool parse_log_level(std::string_view name, LogLevel& level);
+bool parse_log_component(std::string_view name, LogComponent& component);
+
+// Formato binario del log, al estilo de NanoLog. Cada llamada registra una
+// vez su descriptor estático (formato con "{}", nivel, componente, archivo y
+// línea) y en cada mensaje solo se guardan el ID del descriptor, el reloj
+// monotónico y los argumentos crudos. El texto se arma después: en el hilo
+// consumidor del Logger (modo texto) o fuera de línea con logdecode.
+//
+// El archivo es una secuencia de registros [tipo u8][largo u32][cuerpo], en
+// little endian:
+//   Header: [magic "SLOG"][versión u16][reloj de pared ns u64][monotónico ns u64]
+//   Format: [id u32][nivel u8][componente u8][len u16][formato][len u16][archivo][línea u32]
+//   Entry:  [id u32][monotónico ns u64][argumentos]
+// Cada argumento es [tipo u8][valor]: enteros y doubles de 8 bytes, bool de
+// 1 byte y strings como [len u16][bytes]. Un Header empieza un proceso nuevo:
+// reinicia el diccionario de formatos y el ancla para convertir el reloj
+// monotónico a hora de pared.
+namespace logfmt {
+
+enum class RecordKind : uint8_t { Header = 1, Format = 2, Entry = 3 };
+enum class ArgType : uint8_t { Int = 'i', Uint = 'u', Double = 'd', Bool = 'b', String = 's' };
+
+constexpr size_t kRecordHeader = 5;
+constexpr uint16_t kVersion = 1;
+
+// Descriptor de una llamada. Nivel Off indica una línea sin nivel ni componente.
+struct FormatInfo {
+    LogLevel level = LogLevel::Info;
+    LogComponent component = LogComponent::Server;
+    std::string format;
+    std::string file;
+    uint32_t line = 0;
+};
+
+struct Arg {
+    ArgType type = ArgType::Int;
+    int64_t i = 0;
+    uint64_t u = 0;
+    double d = 0;
+    std::string_view s;  // apunta al registro decodificado
+};
+
+inline void put_u16(std::string& out, uint16_t v) {
+    out.push_back(static_cast<char>(v & 0xFF));
+    out.push_back(static_cast<char>(v >> 8));
+}
+
+inline void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+inline void put_u64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+inline void encode_arg(std::string& out, std::string_view s) {
+    size_t n = s.size() < UINT16_MAX ? s.size() : UINT16_MAX;
+    out.push_back(static_cast<char>(ArgType::String));
+    put_u16(out, static_cast<uint16_t>(n));
+    out.append(s.data(), n);
+}
+
+inline void encode_arg(std::string& out, const std::string& s) { encode_arg(out, std::string_view(s)); }
+inline void encode_arg(std::string& out, const char* s) { encode_arg(out, std::string_view(s ? s : "")); }
+inline void encode_arg(std::string& out, char c) { encode_arg(out, std::string_view(&c, 1)); }
+
+inline void encode_arg(std::string& out, bool b) {
+    out.push_back(static_cast<char>(ArgType::Bool));
+    out.push_back(b ? 1 : 0);
+}
+
+inline void encode_arg(std::string& out, double d) {
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(d), "double de 64 bits");
+    std::memcpy(&bits, &d, sizeof(bits));
+    out.push_back(static_cast<char>(ArgType::Double));
+    put_u64(out, bits);
+}
+
+template <typename T>
+inline std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>>
+encode_arg(std::string& out, T v) {
+    if constexpr (std::is_signed_v<T>) {
+        out.push_back(static_cast<char>(ArgType::Int));
+        put_u64(out, static_cast<uint64_t>(static_cast<int64_t>(v)));
+    } else {
+        out.push_back(static_cast<char>(ArgType::Uint));
+        put_u64(out, static_cast<uint64_t>(v));
+    }
+}
+
+template <typename T>
+inline std::enable_if_t<std::is_enum_v<T>> encode_arg(std::string& out, T v) {
+    encode_arg(out, static_cast<std::underlying_type_t<T>>(v));
+}
+
+inline void encode_arg(std::string& out, float f) { encode_arg(out, static_cast<double>(f)); }
+
+// Empieza un Entry en `out` (que se vacía); end_entry completa el largo.
+inline void begin_entry(std::string& out, uint32_t format_id, uint64_t steady_ns) {
+    out.clear();
+    out.push_back(static_cast<char>(RecordKind::Entry));
+    put_u32(out, 0);
+    put_u32(out, format_id);
+    put_u64(out, steady_ns);
+}
+
+inline void end_entry(std::string& out) {
+    uint32_t len = static_cast<uint32_t>(out.size() - kRecordHeader);
+    for (int i = 0; i < 4; ++i) out[1 + i] = static_cast<char>((len >> (8 * i)) & 0xFF);
+}
+
+void encode_header(std::string& out, uint64_t wall_ns, uint64_t steady_ns);
+void encode_format(std::string& out, uint32_t id, const FormatInfo& info);
+
+// Decodifica un Entry completo (con su encabezado de registro).
+bool decode_entry(std::string_view record, uint32_t& format_id, uint64_t& steady_ns, std::vector<Arg>& args);
+
+// Reemplaza cada "{}" de `format` por el siguiente argumento.
+void format_message(std::string_view format, const std::vector<Arg>& args, std::string& out);
+// "[YYYY-MM-DD HH:MM:SS] " en hora local.
+void append_timestamp(std::string& out, uint64_t wall_ns);
+// "NIVEL componente: " (nada si el formato no tiene nivel).
+void append_tag(std::string& out, const FormatInfo& info);
+
+// Recorre un archivo binario completo.
+class Reader {
+public:
+    struct Line {
+        uint64_t wall_ns;
+        const FormatInfo* format;
+        std::vector<Arg> args;
+    };
+
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    // Siguiente mensaje, o false al terminar. Si el archivo está cortado o
+    // corrupto se detiene ahí y error() lo describe.
+    bool next(Line& line);
+    const std::string& error() const { return error_; }
+
+private:
+    std::string_view data_;
+    size_t offset_ = 0;
+    std::vector<FormatInfo> formats_;
+    std::vector<bool> known_;
+    uint64_t anchor_wall_ = 0;
+    uint64_t anchor_steady_ = 0;
+    std::string error_;
+};
+
+}  // namespace logfmt
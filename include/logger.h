@@ -1,27 +1,221 @@
 #pragma once
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <fstream>
 #include <string>
 #include <thread>
-#include <condition_variable>
+#include <vector>
+#include "log_format.h"
+
+// Nivel mínimo compilado: las llamadas por debajo desaparecen del binario.
+// Por defecto Debug, o Info si se compila con NDEBUG (release).
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 0
+#endif
+#endif
+
+// Si las llamadas de este nivel se compilan. Con LOG_MIN_LEVEL 0 se compilan
+// todas: se resuelve en el preprocesador para no comparar contra 0, que con
+// -Wextra avisa de una comparación siempre verdadera.
+constexpr bool logLevelCompiled(LogLevel level) {
+#if LOG_MIN_LEVEL > 0
+    return static_cast<int>(level) >= LOG_MIN_LEVEL;
+#else
+    (void)level;
+    return true;
+#endif
+}
+
+// LOG_INFO(Chat, "Mensaje de {} para {}", sender, destino). El formato debe
+// ser un literal: cada llamada lo registra una sola vez y después solo se
+// copian los argumentos crudos. Los argumentos solo se evalúan si el nivel
+// está habilitado para el componente.
+#define LOG_AT(level, component, format, ...)                                                        \
+    do {                                                                                              \
+        if constexpr (logLevelCompiled(level)) {                                                      \
+            Logger& logger_ = Logger::getInstance();                                                  \
+            if (logger_.enabled(level, component)) {                                                  \
+                static const uint32_t logFormatId_ =                                                  \
+                    logger_.registerFormat(level, component, format, __FILE__, __LINE__);            \
+                logger_.write(logFormatId_, ##__VA_ARGS__);                                           \
+            }                                                                                         \
+        }                                                                                             \
+    } while (0)
+
+#define LOG_DEBUG(component, format, ...) LOG_AT(LogLevel::Debug, LogComponent::component, format, ##__VA_ARGS__)
+#define LOG_INFO(component, format, ...) LOG_AT(LogLevel::Info, LogComponent::component, format, ##__VA_ARGS__)
+#define LOG_WARN(component, format, ...) LOG_AT(LogLevel::Warn, LogComponent::component, format, ##__VA_ARGS__)
+#define LOG_ERROR(component, format, ...) LOG_AT(LogLevel::Error, LogComponent::component, format, ##__VA_ARGS__)
 
+// Logger asíncrono. Cada hilo productor escribe en su propio buffer circular
+// (un productor, un consumidor) sin tomar locks y sin formatear: solo el ID
+// del formato, el reloj monotónico y los argumentos (ver log_format.h). Un
+// único hilo consumidor recorre los buffers por lotes y, según el formato de
+// salida, arma el texto (server_logs.txt) o copia los registros tal cual con
+// writev (server_logs.bin, que se lee con logdecode). Las líneas de un mismo
+// hilo salen en orden; entre hilos distintos no se garantiza.
+//
+// El consumidor también rota el archivo por tamaño o antigüedad: lo renombra
+// a server_logs-AAAAMMDD-HHMMSS-NNN.txt (o .bin) y abre uno nuevo. Un hilo
+// de baja prioridad comprime los rotados con gzip y borra los más viejos.
 class Logger {
 public:
+    // Qué hacer cuando el buffer del hilo está lleno.
+    enum class OverflowPolicy {
+        Block,  // esperar a que el consumidor libere espacio
+        Drop    // descartar la línea y contarla
+    };
+
+    enum class OutputFormat {
+        Text,   // server_logs.txt
+        Binary  // server_logs.bin
+    };
+
     static Logger& getInstance();
 
+    // Línea sin nivel ni componente: siempre se registra.
     void log(const std::string& message);
+
+    // Registra el descriptor de una llamada y devuelve su ID. Lo usan los LOG_*.
+    uint32_t registerFormat(LogLevel level, LogComponent component, const char* format, const char* file, int line);
+
+    template <typename... Args>
+    void write(uint32_t formatId, const Args&... args) {
+        Slot slot = acquireSlot();
+        if (!slot.buffer) return;
+        logfmt::begin_entry(*slot.buffer, formatId, steadyNanos());
+        (logfmt::encode_arg(*slot.buffer, args), ...);
+        logfmt::end_entry(*slot.buffer);
+        publish(slot);
+    }
+
+    bool enabled(LogLevel level, LogComponent component) const {
+        return static_cast<uint8_t>(level) >=
+               componentLevels[static_cast<size_t>(component)].load(std::memory_order_relaxed);
+    }
+    // Nivel de todos los componentes, o de uno solo.
+    void setLevel(LogLevel level);
+    void setComponentLevel(LogComponent component, LogLevel level);
+    LogLevel componentLevel(LogComponent component) const;
+    // Aplica una especificación como "info,chat=debug,presence=off": un nivel
+    // suelto vale para todos los componentes y componente=nivel para uno.
+    // Devuelve false (sin aplicar nada) si tiene algún nombre desconocido.
+    bool configure(const std::string& spec);
+
     void startLogging();
+    // Escribe lo pendiente y detiene el hilo consumidor.
     void stopLogging();
+    // Bloquea hasta que todo lo registrado antes de la llamada esté escrito.
+    void flush();
+
+    // Cambia el archivo de salida; si el logger está corriendo, lo reinicia.
+    void setOutputFormat(OutputFormat format);
+    OutputFormat outputFormat() const { return output; }
+    static const char* fileFor(OutputFormat format);
+
+    // Rota al llegar a maxBytes o cuando el archivo lleva maxAge abierto (0
+    // desactiva cada límite) y conserva los `keep` comprimidos más recientes
+    // de cada formato (0: todos). Por defecto 64 MiB, 24 h y 10 archivos.
+    void setRotation(size_t maxBytes, std::chrono::seconds maxAge, size_t keep);
+    // Rota en la próxima pasada del consumidor, aunque no se llegó al límite.
+    void rotate();
+    // Bloquea hasta que no queden archivos rotados por comprimir.
+    void waitForCompression();
+
+    void setOverflowPolicy(OverflowPolicy policy);
+    // Capacidad (en líneas) de los buffers de hilos que empiecen a loguear
+    // después de la llamada. Se redondea a potencia de dos.
+    void setThreadBufferCapacity(size_t lines);
+    uint64_t droppedMessages() const { return dropped.load(std::memory_order_relaxed); }
 
 private:
+    struct Ring;
+    struct ThreadRing;
+    struct Slot {
+        Ring* ring;
+        std::string* buffer;
+    };
+
     Logger();
     ~Logger();
 
+    static uint64_t steadyNanos() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    Ring& threadRing();
+    Slot acquireSlot();
+    void publish(Slot slot);
+    void openOutput();
+    void maybeRotate();
+    std::string rotatedName();
+    void startCompressor();
+    void stopCompressor();
+    void compressLoop();
+    void compressFile(const std::string& path);
+    void pruneRotated(const std::string& extension);
     void processLogs();
-    std::queue<std::string> logQueue;
-    std::mutex queueMutex;
+    size_t drainOnce(std::vector<std::shared_ptr<Ring>>& rings);
+    void refreshFormats(std::string& preamble);
+    void appendText(std::string_view record, std::string& out);
+    bool hasPending();
+    void writeAll(const std::string& data);
+
+    int logFd;
+    OutputFormat output;
+    std::atomic<bool> running;
+    std::atomic<bool> consumerWaiting;
+    std::atomic<OverflowPolicy> policy;
+    std::atomic<size_t> ringCapacity;
+    std::atomic<uint64_t> dropped;
+    uint64_t reportedDrops;
+    std::atomic<uint8_t> componentLevels[static_cast<size_t>(LogComponent::Count)];
+
+    // Reloj de pared y monotónico tomados juntos al crear el logger.
+    uint64_t anchorWallNs;
+    uint64_t anchorSteadyNs;
+
+    std::mutex formatsMutex;
+    std::vector<logfmt::FormatInfo> formats;
+    // Copia de `formats` que usa solo el consumidor, y cuántos ya están en el
+    // archivo binario actual.
+    std::vector<logfmt::FormatInfo> consumerFormats;
+    size_t formatsWritten;
+    int64_t cachedSecond;
+    std::string cachedPrefix;
+
+    // Rotación. fileSize y fileOpenedAt solo los usa el consumidor (o
+    // start/stop mientras no corre).
+    std::atomic<size_t> rotateBytes;
+    std::atomic<int64_t> rotateAgeSeconds;
+    std::atomic<size_t> keepRotated;
+    std::atomic<bool> rotateRequested;
+    size_t fileSize;
+    std::chrono::steady_clock::time_point fileOpenedAt;
+    // Último nombre rotado: dentro del mismo segundo el número solo crece,
+    // aunque la limpieza ya haya borrado los anteriores.
+    std::string lastRotatedStamp;
+    int lastRotatedSeq;
+
+    std::mutex compressMutex;
+    std::condition_variable compressCondition;
+    std::deque<std::string> compressQueue;
+    bool compressStop;
+    bool compressBusy;
+    std::thread compressor;
+
+    std::mutex ringsMutex;  // solo para registrar buffers nuevos y para dormir al consumidor
     std::condition_variable condition;
-    std::ofstream logFile;
-    bool running;
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::thread consumer;
+    std::mutex lifecycleMutex;
 };
@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Mensaje leído del log. Las vistas apuntan al segmento mapeado en memoria y
+// solo son válidas durante el callback de replay.
+struct LogRecord {
+    enum class Kind : uint8_t { General = 0, Private = 1 };
+
+    Kind kind;
+    std::string_view author;
+    std::string_view recipient;  // vacío en el chat general
+    std::string_view text;
+};
+
+struct MessageLogOptions {
+    size_t segment_bytes = 64 * 1024 * 1024;
+    // Tiempo que el hilo de commit espera para juntar más registros antes de
+    // sincronizar, salvo que alguien esté esperando en flush().
+    std::chrono::milliseconds commit_window{2};
+};
+
+// Log de mensajes append-only en segmentos (NNNNNNNN.wal dentro de un
+// directorio). Cada registro es [largo u32][crc32 u32][payload], en little
+// endian. append() solo encola el registro en memoria; un hilo de group
+// commit escribe los registros acumulados y hace un único fdatasync por lote.
+// Al abrir, los segmentos existentes se recorren con mmap y se descarta una
+// cola incompleta o corrupta del último segmento (escritura interrumpida).
+class MessageLog {
+public:
+    using Options = MessageLogOptions;
+    using ReplayFn = std::function<void(const LogRecord&)>;
+
+    MessageLog() = default;
+    ~MessageLog();
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    // Abre (o crea) el log en `dir`, pasa cada registro existente a `replay`
+    // en orden y arranca el hilo de commit. Devuelve cuántos registros se
+    // recuperaron. Lanza std::runtime_error si no puede abrir el directorio.
+    size_t open(const std::string& dir, const ReplayFn& replay = nullptr, const Options& options = Options());
+    // Sincroniza lo pendiente y detiene el hilo de commit.
+    void close();
+    bool is_open() const { return open_.load(std::memory_order_acquire); }
+
+    // Devuelven el número de secuencia del registro, o 0 si el log está cerrado.
+    uint64_t append_general(std::string_view author, std::string_view text);
+    uint64_t append_private(std::string_view author, std::string_view recipient, std::string_view text);
+
+    // Bloquea hasta que el registro `seq` (y todos los anteriores) esté en
+    // disco. Devuelve false si falló una escritura mientras esperaba (el lote
+    // se reintenta; una llamada posterior puede devolver true) o si `seq` no
+    // es un registro de este log.
+    bool flush(uint64_t seq);
+
+    uint64_t durable_seq() const { return durable_seq_.load(std::memory_order_acquire); }
+    uint64_t sync_count() const { return syncs_.load(std::memory_order_relaxed); }
+    uint64_t write_errors() const { return write_errors_.load(std::memory_order_relaxed); }
+    uint32_t segment_index() const { return segment_index_; }
+
+    static uint32_t crc32(const void* data, size_t size);
+
+private:
+    uint64_t append(LogRecord::Kind kind, std::string_view author, std::string_view recipient, std::string_view text);
+    size_t replay_segment(const std::string& path, bool last, const ReplayFn& replay);
+    void open_segment(uint32_t index);
+    void commit_loop();
+    bool write_batch(const std::string& batch);
+    void discard_tail(size_t written);
+
+    std::string dir_;
+    Options options_;
+    std::atomic<bool> open_{false};
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable durable_cv_;
+    std::string pending_;
+    uint64_t next_seq_ = 1;
+    uint64_t pending_last_seq_ = 0;
+    size_t flush_waiters_ = 0;
+    bool stop_ = false;
+    std::atomic<uint64_t> durable_seq_{0};
+    std::atomic<uint64_t> syncs_{0};
+    std::atomic<uint64_t> write_errors_{0};
+    std::thread commit_thread_;
+
+    // Solo los usa el hilo de commit (y open/close antes y después de él).
+    int fd_ = -1;
+    uint32_t segment_index_ = 0;
+    size_t segment_size_ = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Buzones de mensajes privados para usuarios desconectados, por ID de
+// UserIdTable. Cada mensaje se guarda ya codificado como entrada del
+// opcode 63 (remitente, mensaje), así que al reconectar el buzón completo se
+// entrega como un solo frame concatenando bytes. La memoria está acotada por
+// buzón (mensajes y bytes) y en total; los mensajes vencen a los `ttl`.
+class OfflineMailboxes {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Limits {
+        size_t max_messages = 100;           // por buzón; como mucho 255 (un frame)
+        size_t max_bytes = 64 * 1024;        // por buzón
+        size_t max_total_bytes = 64 << 20;   // entre todos los buzones
+        std::chrono::seconds ttl = std::chrono::minutes(5);
+    };
+
+    OfflineMailboxes();
+    explicit OfflineMailboxes(const Limits& limits);
+
+    // Devuelve false si el buzón o el total están llenos.
+    bool push(uint32_t recipient, std::string_view sender, std::string_view text, Clock::time_point now = Clock::now());
+    // Vacía el buzón y devuelve el payload 63 con los mensajes no vencidos,
+    // del más antiguo al más nuevo, o "" si no había ninguno.
+    std::string take(uint32_t recipient, Clock::time_point now = Clock::now());
+    // Descarta el buzón (sesión eliminada).
+    void drop(uint32_t recipient);
+
+    size_t size(uint32_t recipient) const;
+    size_t total_bytes() const;
+    void set_limits(const Limits& limits);
+    Limits limits() const;
+    void clear();
+
+private:
+    struct Entry {
+        Clock::time_point queued;
+        std::string record;  // HistoryEntry codificada
+    };
+    struct Mailbox {
+        std::deque<Entry> entries;
+        size_t bytes = 0;
+    };
+
+    void expire(Mailbox& box, Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    Limits limits_;
+    std::unordered_map<uint32_t, Mailbox> boxes_;
+    size_t total_bytes_ = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace crow
+{
+    namespace websocket
+    {
+        struct connection;
+    }
+}
+
+// Conexiones que reciben presencia, por ID de usuario. SessionRegistry la
+// mantiene con cada cambio de sesión (conexión, modo de lotes o modo
+// suscripción), así que notificar un 53/54 no recorre el registro: los
+// clientes sin suscripciones ni lotes están en un arreglo aparte, y los
+// suscriptores de un usuario se resuelven por ID en O(1). Las altas y bajas
+// de los arreglos son O(1) (la baja mueve el último a su lugar).
+class PresenceAudience {
+public:
+    using Connection = crow::websocket::connection;
+
+    // Estado de presencia de la sesión del usuario. conn == nullptr lo saca
+    // de todos los arreglos; el ID 0 (sin ID) se ignora.
+    void update(uint32_t user, Connection* conn, bool batched, bool subscriber);
+    void remove(uint32_t user);
+    void clear();
+
+    // fn(uint32_t user, Connection&) para cada conexión sin suscripciones ni
+    // lotes, con el lock compartido: las conexiones siguen vivas durante el
+    // callback.
+    template <typename Fn>
+    void for_each_global(Fn&& fn) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (uint32_t user : global_) fn(user, *entries_[user].conn);
+    }
+
+    // fn(uint32_t user, Connection&) para cada usuario de `users` conectado
+    // que recibe presencia por evento.
+    template <typename Fn>
+    void for_each_of(const std::vector<uint32_t>& users, Fn&& fn) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (uint32_t user : users)
+        {
+            if (user >= entries_.size()) continue;
+            const Entry& e = entries_[user];
+            if (e.conn && !e.batched) fn(user, *e.conn);
+        }
+    }
+
+    // fn(uint32_t user, bool subscriber, Connection&) para cada conexión que
+    // pidió presencia en lotes.
+    template <typename Fn>
+    void for_each_batched(Fn&& fn) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (uint32_t user : batched_) fn(user, entries_[user].subscriber, *entries_[user].conn);
+    }
+
+    size_t global_size() const;
+    size_t batched_size() const;
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Entry {
+        Connection* conn = nullptr;
+        bool batched = false;
+        bool subscriber = false;
+        uint32_t global_pos = kNone;   // posición en global_
+        uint32_t batched_pos = kNone;  // posición en batched_
+    };
+
+    void place(std::vector<uint32_t>& list, uint32_t Entry::*pos, uint32_t user, bool member);
+
+    mutable std::shared_mutex mutex_;
+    std::vector<Entry> entries_;  // por ID de usuario
+    std::vector<uint32_t> global_;
+    std::vector<uint32_t> batched_;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Acumula las transiciones de presencia (53/54) durante una ventana corta y
+// las entrega como frames 59 con el estado final de cada usuario. Varias
+// transiciones del mismo usuario dentro de la ventana quedan en una sola
+// entrada, y si el usuario termina en el estado que los clientes ya conocían
+// (p. ej. ACTIVO -> INACTIVO -> ACTIVO) la entrada se descarta.
+class PresenceBatcher {
+public:
+    static constexpr uint8_t kUnknown = 0xFF;
+
+    // Registra el nuevo estado de `username`; O(1).
+    void record(const std::string& username, uint8_t status);
+
+    struct Change {
+        std::string username;
+        uint8_t status;
+    };
+
+    // Cierra la ventana y devuelve el estado final de cada usuario que cambió.
+    std::vector<Change> drain_changes();
+    // Payloads 59 de los cambios (uno por cada 255 entradas).
+    static std::vector<std::string> encode(const std::vector<Change>& changes);
+    // drain_changes() ya codificado. Vacío si no quedó ningún cambio que informar.
+    std::vector<std::string> drain() { return encode(drain_changes()); }
+
+    // Bloquea hasta que haya transiciones pendientes.
+    void wait_pending();
+
+    // Olvida el último estado enviado del usuario (sesión eliminada).
+    void forget(const std::string& username);
+    void clear();
+
+    size_t pending() const;
+    // Transiciones absorbidas por otras del mismo usuario o descartadas por
+    // no cambiar nada, desde el inicio.
+    size_t collapsed() const;
+
+private:
+    struct Pending {
+        std::string username;
+        uint8_t origin;  // estado que los clientes conocían al abrir la ventana
+        uint8_t status;
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable pending_cv_;
+    std::vector<Pending> pending_;
+    std::unordered_map<std::string, size_t> index_;      // posición en pending_
+    std::unordered_map<std::string, uint8_t> last_sent_;  // último estado entregado
+    size_t collapsed_ = 0;
+};
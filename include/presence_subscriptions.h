@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <vector>
+
+// Suscripciones de presencia entre usuarios, por ID de UserIdTable. Es una
+// lista de adyacencia en los dos sentidos: para cada usuario, los IDs de sus
+// suscriptores y los de los usuarios que sigue, en vectores ordenados de
+// enteros de 32 bits (4 bytes por arista y sentido). Un usuario que se
+// suscribió alguna vez pasa a recibir presencia solo de quienes sigue;
+// los demás siguen recibiendo la de todos.
+class PresenceSubscriptions {
+public:
+    // Devuelven false si no hubo cambios.
+    bool subscribe(uint32_t subscriber, uint32_t target);
+    bool unsubscribe(uint32_t subscriber, uint32_t target);
+    // Quita todas las suscripciones del usuario y lo devuelve a la presencia
+    // global (sesión eliminada). Quienes lo seguían lo siguen siguiendo.
+    void remove_subscriber(uint32_t subscriber);
+
+    bool is_subscriber(uint32_t subscriber) const;
+    bool subscribed(uint32_t subscriber, uint32_t target) const;
+    // Agrega a `out` los suscriptores de `target`.
+    void subscribers_of(uint32_t target, std::vector<uint32_t>& out) const;
+
+    size_t edges() const;
+    void clear();
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::vector<std::vector<uint32_t>> followers_;  // target -> suscriptores
+    std::vector<std::vector<uint32_t>> following_;  // suscriptor -> targets
+    std::vector<bool> subscriber_;
+    size_t edges_ = 0;
+};
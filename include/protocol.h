@@ -0,0 +1,182 @@
+#pragma once
+#include "frame_reader.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+// Esquema del protocolo binario. Cada mensaje se describe una sola vez como
+// Message<opcode, campos...>; de esa descripción salen el codificador (una
+// única reserva del tamaño exacto), el decodificador y, para los mensajes
+// del cliente, la entrada de la tabla de despacho. Agregar un opcode es
+// agregar una línea aquí.
+namespace proto
+{
+
+// Tipos de campo: tamaño en el cable, escritura y lectura.
+struct U8 {
+    using value_type = uint8_t;
+    static constexpr size_t size(uint8_t) { return 1; }
+    static void write(std::string& out, uint8_t v) { out.push_back(static_cast<char>(v)); }
+    static bool read(FrameReader& in, uint8_t& v) { return in.u8(v); }
+};
+
+// Entero de 64 bits en big endian.
+struct U64 {
+    using value_type = uint64_t;
+    static constexpr size_t size(uint64_t) { return 8; }
+    static void write(std::string& out, uint64_t v)
+    {
+        for (int i = 7; i >= 0; i--) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+    static bool read(FrameReader& in, uint64_t& v) { return in.u64(v); }
+};
+
+// Cadena con prefijo de largo u8; al codificar se recorta a 255 bytes.
+struct Str8 {
+    using value_type = std::string_view;
+    static constexpr size_t kMax = 255;
+    static size_t size(std::string_view v) { return 1 + std::min(v.size(), kMax); }
+    static void write(std::string& out, std::string_view v)
+    {
+        size_t n = std::min(v.size(), kMax);
+        out.push_back(static_cast<char>(n));
+        out.append(v.data(), n);
+    }
+    static bool read(FrameReader& in, std::string_view& v) { return in.str8(v); }
+};
+
+// Secuencia de campos sin opcode. Se usa como cuerpo de cada mensaje y para
+// las entradas repetidas de las respuestas con listas (51, 56, 57, 58, 59, 62, 63).
+template <typename... Fields>
+struct Record {
+    using values = std::tuple<typename Fields::value_type...>;
+
+    static size_t size(const typename Fields::value_type&... v) { return (size_t(0) + ... + Fields::size(v)); }
+
+    static void write(std::string& out, const typename Fields::value_type&... v) { (Fields::write(out, v), ...); }
+
+    // Agrega el registro al final de `out` con una sola reserva.
+    static void append(std::string& out, const typename Fields::value_type&... v)
+    {
+        out.reserve(out.size() + size(v...));
+        write(out, v...);
+    }
+
+    static bool read(FrameReader& in, typename Fields::value_type&... v) { return (Fields::read(in, v) && ...); }
+    static bool read(FrameReader& in, values& v)
+    {
+        return std::apply([&](auto&... f) { return read(in, f...); }, v);
+    }
+};
+
+template <uint8_t Op, typename... Fields>
+struct Message {
+    static constexpr uint8_t opcode = Op;
+    using body = Record<Fields...>;
+    using values = typename body::values;
+
+    static size_t size(const typename Fields::value_type&... v) { return 1 + body::size(v...); }
+
+    static void append(std::string& out, const typename Fields::value_type&... v)
+    {
+        out.reserve(out.size() + size(v...));
+        out.push_back(static_cast<char>(Op));
+        body::write(out, v...);
+    }
+
+    static std::string encode(const typename Fields::value_type&... v)
+    {
+        std::string out;
+        append(out, v...);
+        return out;
+    }
+
+    // Verifica el opcode y lee los campos; deja `in` al inicio de las
+    // entradas repetidas, si el mensaje las tiene.
+    static bool decode_header(FrameReader& in, typename Fields::value_type&... v)
+    {
+        uint8_t op = 0;
+        return in.u8(op) && op == Op && body::read(in, v...);
+    }
+
+    // Decodifica un frame completo: opcode, todos los campos y nada más.
+    static bool decode(std::string_view frame, typename Fields::value_type&... v)
+    {
+        FrameReader in(frame);
+        return decode_header(in, v...) && in.remaining() == 0;
+    }
+};
+
+// Mensajes del cliente
+using ListUsers = Message<1>;
+using GetUser = Message<2, Str8>;                  // nombre
+using ChangeStatus = Message<3, Str8, U8>;         // nombre, estado
+using SendMessage = Message<4, Str8, Str8>;        // destino ("~" o usuario), mensaje
+using GetHistory = Message<5, Str8>;               // chat
+using GetHistoryPage = Message<6, Str8, U64, U8>;  // chat, cursor, tamaño de página
+using Search = Message<7, Str8, U8>;               // consulta, máximo de resultados
+using PresenceMode = Message<8, U8>;               // 0 = por evento (53/54), 1 = en lotes (59)
+using Subscribe = Message<9, Str8, U8>;            // usuario, 1 = seguir, 0 = dejar de seguir
+using CreateRoom = Message<10, Str8>;              // sala
+using JoinRoom = Message<11, Str8>;                // sala
+using LeaveRoom = Message<12, Str8>;               // sala
+using PostRoom = Message<13, Str8, Str8>;          // sala, mensaje
+using GetRoomHistory = Message<14, Str8, U64, U8>; // sala, cursor, tamaño de página
+
+// Mensajes del servidor
+using Error = Message<50, U8>;                     // código
+using UserList = Message<51, U8>;                  // cantidad, seguida de UserEntry
+using UserInfo = Message<52, Str8, U8>;            // nombre, estado
+using UserJoined = Message<53, Str8, U8>;          // nombre, estado
+using StatusChanged = Message<54, Str8, U8>;       // nombre, estado
+using NewMessage = Message<55, Str8, Str8>;        // remitente, mensaje
+using History = Message<56, U8>;                   // cantidad, seguida de HistoryEntry
+using HistoryPage = Message<57, Str8, U64, U8>;    // chat, cursor siguiente, cantidad, seguida de HistoryEntry
+using SearchResults = Message<58, Str8, U8>;       // consulta, cantidad, seguida de SearchHit
+using PresenceBatch = Message<59, U8>;             // cantidad, seguida de UserEntry
+using RoomEvent = Message<60, Str8, Str8, U8>;     // sala, usuario, evento (1 creada, 2 entró, 3 salió)
+using RoomMessage = Message<61, Str8, Str8, Str8>; // sala, remitente, mensaje
+using RoomHistory = Message<62, Str8, U64, U8>;    // sala, cursor siguiente, cantidad, seguida de HistoryEntry
+using OfflineMessages = Message<63, U8>;           // cantidad, seguida de HistoryEntry
+
+using UserEntry = Record<Str8, U8>;                // nombre, estado
+using HistoryEntry = Record<Str8, Str8>;           // autor, mensaje
+using SearchHit = Record<Str8, U64, Str8, Str8>;   // chat, secuencia, autor, mensaje
+
+// Asocia un mensaje del cliente con su handler. El handler recibe los
+// argumentos de contexto del despacho seguidos de los campos decodificados,
+// que son vistas al frame.
+template <typename Msg, auto Handler>
+struct Route {
+    using message = Msg;
+
+    template <typename... Context>
+    static void invoke(FrameReader& in, Context... ctx)
+    {
+        typename Msg::values fields;
+        if (!Msg::body::read(in, fields)) return;
+        std::apply([&](auto&... f) { Handler(ctx..., f...); }, fields);
+    }
+};
+
+// Tabla de despacho por opcode, armada en tiempo de compilación a partir de
+// las rutas. Los opcodes sin ruta quedan en nullptr.
+template <typename... Context>
+struct Dispatcher {
+    using Fn = void (*)(FrameReader&, Context...);
+    using Table = std::array<Fn, 256>;
+
+    template <typename... Routes>
+    static constexpr Table table()
+    {
+        Table t{};
+        ((t[Routes::message::opcode] = &Routes::template invoke<Context...>), ...);
+        return t;
+    }
+};
+
+} // namespace proto
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace crow
+{
+    namespace websocket
+    {
+        struct connection;
+    }
+}
+
+// Salas de chat con nombre. Cada sala guarda a sus miembros en un arreglo
+// contiguo ordenado por ID de usuario, junto con la conexión actual de cada
+// uno (nullptr si está desconectado), así que el fanout de un mensaje recorre
+// solo ese arreglo, sin tocar el registro de sesiones. La membresía es del
+// usuario: se conserva al desconectarse y attach() actualiza la conexión en
+// todas sus salas al volver. Los IDs de sala son densos, desde 1.
+class RoomRegistry {
+public:
+    static constexpr size_t kMaxRooms = 4096;
+    static constexpr size_t kMaxName = 32;
+
+    using Connection = crow::websocket::connection;
+
+    // Devuelve el ID de la sala nueva, con `creator` como primer miembro, o
+    // 0 si el nombre ya existe o se alcanzó kMaxRooms.
+    uint32_t create(std::string_view name, uint32_t creator, Connection* conn);
+    uint32_t find(std::string_view name) const;
+    std::string name(uint32_t room) const;
+
+    // Devuelven false si no hubo cambios (ya era miembro / no lo era).
+    bool join(uint32_t room, uint32_t user, Connection* conn);
+    bool leave(uint32_t room, uint32_t user);
+    bool is_member(uint32_t room, uint32_t user) const;
+
+    // Conexión actual del usuario en todas sus salas (nullptr al desconectarse).
+    void attach(uint32_t user, Connection* conn);
+    // Saca al usuario de todas sus salas (sesión eliminada).
+    void remove_user(uint32_t user);
+
+    // fn(Connection&) para cada miembro conectado, con el lock de la sala
+    // compartido: las conexiones siguen vivas durante el callback. Devuelve
+    // cuántos se visitaron.
+    template <typename Fn>
+    size_t for_each_connected(uint32_t room, Fn&& fn) const
+    {
+        const Room* r = get(room);
+        if (!r) return 0;
+        std::shared_lock<std::shared_mutex> lock(r->mutex);
+        size_t visited = 0;
+        for (const Member& m : r->members)
+        {
+            if (m.conn)
+            {
+                fn(*m.conn);
+                ++visited;
+            }
+        }
+        return visited;
+    }
+
+    size_t member_count(uint32_t room) const;
+    size_t size() const;
+    void clear();
+
+private:
+    struct Member {
+        uint32_t user;
+        Connection* conn;
+    };
+
+    struct Room {
+        std::string name;
+        mutable std::shared_mutex mutex;
+        std::vector<Member> members;  // ordenados por user
+    };
+
+    const Room* get(uint32_t room) const;
+    static std::vector<Member>::iterator lower_bound(std::vector<Member>& members, uint32_t user);
+    static bool insert_member(Room& room, uint32_t user, Connection* conn);
+    static bool erase_member(Room& room, uint32_t user);
+
+    // Protege el índice de nombres, el arreglo de salas y rooms_of_. Se toma
+    // antes que el lock de una sala, nunca al revés.
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::unique_ptr<Room>> rooms_;     // rooms_[id - 1]
+    std::vector<std::vector<uint32_t>> rooms_of_;  // salas de cada usuario
+};
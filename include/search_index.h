@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Índice invertido de trigramas sobre los mensajes del chat. Se actualiza en
+// cada mensaje enviado (no hay reindexado) y responde búsquedas de subcadenas
+// sin distinguir mayúsculas (ASCII). Los documentos se agrupan en segmentos de
+// tamaño fijo; al superar max_segments se descarta el segmento más antiguo
+// completo, así la memoria queda acotada sin borrar entradas de las listas.
+class SearchIndex {
+public:
+    // Conversación del chat general; las privadas usan HistoryStore::conversation_key.
+    static constexpr uint64_t kGeneral = 0;
+    static constexpr size_t kMinQuery = 3;
+
+    struct Hit {
+        uint64_t conversation;
+        uint64_t seq;      // secuencia del mensaje en su conversación (ver HistoryStore)
+        uint32_t author;   // ID de UserIdTable
+        std::string text;
+    };
+
+    explicit SearchIndex(size_t segment_docs = 1 << 20, size_t max_segments = 12);
+    ~SearchIndex();
+
+    void add(uint64_t conversation, uint64_t seq, uint32_t author, std::string_view text);
+
+    // Hasta `limit` mensajes que contienen `query`, del más nuevo al más viejo,
+    // restringidos al chat general y a las conversaciones privadas de `requester`.
+    // Consultas de menos de kMinQuery bytes no devuelven nada.
+    std::vector<Hit> search(std::string_view query, uint32_t requester, size_t limit) const;
+
+    size_t size() const;
+    void clear();
+
+private:
+    struct Segment;
+
+    static bool visible_to(uint64_t conversation, uint32_t requester);
+
+    size_t segment_docs_;
+    size_t max_segments_;
+    mutable std::shared_mutex mutex_;
+    std::deque<std::unique_ptr<Segment>> segments_;  // el más antiguo al frente
+    size_t total_docs_ = 0;
+};
@@ -0,0 +1,303 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include "presence_audience.h"
+#include "user_list_snapshot.h"
+
+namespace crow
+{
+    namespace websocket
+    {
+        struct connection;
+    }
+}
+
+enum class UserStatus {
+    DISCONNECTED = 0,
+    ACTIVO = 1,
+    OCUPADO = 2,
+    INACTIVO = 3
+};
+
+struct ConnectionData {
+    std::string username;
+    std::string uuid;
+    crow::websocket::connection* conn;
+    UserStatus status;
+    std::chrono::steady_clock::time_point last_active;
+    std::string ip_address;
+    uint32_t user_id = 0;  // ID denso asignado por UserIdTable en on_open
+    bool batched_presence = false;  // la conexión pidió presencia en lotes (opcode 8)
+    bool presence_subscriber = false;  // copia de PresenceSubscriptions::is_subscriber
+};
+
+// Registro de sesiones particionado en shards. Cada shard tiene su propio
+// lock lector/escritor, así que operaciones sobre usuarios distintos casi
+// nunca compiten entre los hilos de Crow. Los callbacks se ejecutan con el
+// lock del shard tomado: no deben volver a llamar al registro.
+//
+// El registro mantiene además el payload del opcode 51 (user_list()) y las
+// conexiones que reciben presencia (presence_audience()): toda operación que
+// agrega, quita o cambia una sesión los actualiza antes de soltar el lock del
+// shard.
+class SessionRegistry {
+private:
+    struct Shard;
+
+public:
+    using SessionMap = std::unordered_map<std::string, ConnectionData>;
+
+    // Referencia directa a una entrada del registro. Los nodos de un
+    // unordered_map no se mueven al crecer, así que el handle sigue siendo
+    // válido hasta que la entrada se elimina; solo se eliminan sesiones ya
+    // desconectadas, que no tienen conexión enlazada.
+    struct Handle {
+        Shard* shard = nullptr;
+        ConnectionData* data = nullptr;
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    explicit SessionRegistry(size_t shard_count = default_shard_count());
+
+    // fn(ConnectionData&) con lock exclusivo. Devuelve false si el usuario no existe.
+    template <typename Fn>
+    bool with_session(const std::string& username, Fn&& fn)
+    {
+        Shard& shard = shard_for(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.sessions.find(username);
+        if (it == shard.sessions.end()) return false;
+        UserStatus before = it->second.status;
+        PresenceState presence(it->second);
+        fn(it->second);
+        if (it->second.status != before) user_list_.set_status(username, status_byte(it->second.status));
+        sync_presence(presence, it->second);
+        return true;
+    }
+
+    // fn(const ConnectionData&) con lock compartido.
+    template <typename Fn>
+    bool with_session_shared(const std::string& username, Fn&& fn) const
+    {
+        const Shard& shard = shard_for(username);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.sessions.find(username);
+        if (it == shard.sessions.end()) return false;
+        fn(it->second);
+        return true;
+    }
+
+    // fn(SessionMap&) sobre el shard que le toca al usuario, para operaciones
+    // de "buscar o insertar" que deben ser atómicas.
+    template <typename Fn>
+    decltype(auto) with_shard(const std::string& username, Fn&& fn)
+    {
+        Shard& shard = shard_for(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        // El callback puede insertar, borrar o modificar: al salir (todavía
+        // con el lock) se vuelve a mirar la entrada del usuario.
+        SyncUserList sync{*this, shard.sessions, username};
+        return fn(shard.sessions);
+    }
+
+    // fn(const std::string&, const ConnectionData&) para cada sesión; un shard a la vez.
+    template <typename Fn>
+    void for_each(Fn&& fn) const
+    {
+        for (size_t i = 0; i < shard_count_; ++i)
+        {
+            std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+            for (const auto& [username, data] : shards_[i].sessions)
+            {
+                fn(username, data);
+            }
+        }
+    }
+
+    template <typename Fn>
+    void for_each_mut(Fn&& fn)
+    {
+        for (size_t i = 0; i < shard_count_; ++i)
+        {
+            std::unique_lock<std::shared_mutex> lock(shards_[i].mutex);
+            for (auto& [username, data] : shards_[i].sessions)
+            {
+                UserStatus before = data.status;
+                PresenceState presence(data);
+                fn(username, data);
+                if (data.status != before) user_list_.set_status(username, status_byte(data.status));
+                sync_presence(presence, data);
+            }
+        }
+    }
+
+    // Elimina las sesiones para las que pred(const ConnectionData&) es verdadero.
+    template <typename Pred>
+    size_t erase_if(Pred&& pred)
+    {
+        size_t erased = 0;
+        for (size_t i = 0; i < shard_count_; ++i)
+        {
+            std::unique_lock<std::shared_mutex> lock(shards_[i].mutex);
+            auto& sessions = shards_[i].sessions;
+            for (auto it = sessions.begin(); it != sessions.end(); )
+            {
+                if (pred(it->second)) {
+                    user_list_.remove(it->first);
+                    audience_.remove(it->second.user_id);
+                    it = sessions.erase(it);
+                    ++erased;
+                } else {
+                    ++it;
+                }
+            }
+        }
+        return erased;
+    }
+
+    // Elimina la sesión del usuario si pred(const ConnectionData&) es verdadero.
+    // Toma solo el lock de su shard, durante una búsqueda.
+    template <typename Pred>
+    bool erase_session_if(const std::string& username, Pred&& pred)
+    {
+        Shard& shard = shard_for(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.sessions.find(username);
+        if (it == shard.sessions.end() || !pred(static_cast<const ConnectionData&>(it->second))) return false;
+        user_list_.remove(username);
+        audience_.remove(it->second.user_id);
+        shard.sessions.erase(it);
+        return true;
+    }
+
+    // fn(ConnectionData&) sobre la entrada del handle, sin buscar en el mapa.
+    template <typename Fn>
+    bool with_handle(const Handle& handle, Fn&& fn)
+    {
+        if (!handle) return false;
+        std::unique_lock<std::shared_mutex> lock(handle.shard->mutex);
+        UserStatus before = handle.data->status;
+        PresenceState presence(*handle.data);
+        fn(*handle.data);
+        if (handle.data->status != before) user_list_.set_status(handle.data->username, status_byte(handle.data->status));
+        sync_presence(presence, *handle.data);
+        return true;
+    }
+
+    template <typename Fn>
+    bool with_handle_shared(const Handle& handle, Fn&& fn) const
+    {
+        if (!handle) return false;
+        std::shared_lock<std::shared_mutex> lock(handle.shard->mutex);
+        fn(static_cast<const ConnectionData&>(*handle.data));
+        return true;
+    }
+
+    Handle handle_for(const std::string& username);
+
+    void insert_or_assign(const std::string& username, const ConnectionData& data);
+    std::optional<ConnectionData> get(const std::string& username) const;
+    bool contains(const std::string& username) const;
+    bool erase(const std::string& username);
+    size_t size() const;
+    void clear();
+
+    size_t shard_count() const { return shard_count_; }
+    static size_t default_shard_count();
+
+    // Payload del opcode 51 listo para enviar; no toma locks de shard.
+    std::shared_ptr<const UserListSnapshot::View> user_list() const { return user_list_.current(); }
+    // Destinatarios de presencia por ID; no toma locks de shard.
+    const PresenceAudience& presence_audience() const { return audience_; }
+
+private:
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        SessionMap sessions;
+    };
+
+    Shard& shard_for(const std::string& username)
+    {
+        return shards_[std::hash<std::string>{}(username) & (shard_count_ - 1)];
+    }
+    const Shard& shard_for(const std::string& username) const
+    {
+        return shards_[std::hash<std::string>{}(username) & (shard_count_ - 1)];
+    }
+
+    static uint8_t status_byte(UserStatus status) { return static_cast<uint8_t>(status); }
+
+    // Campos de la sesión que deciden si recibe presencia y cómo.
+    struct PresenceState {
+        uint32_t user_id = 0;
+        const crow::websocket::connection* conn = nullptr;
+        bool batched = false;
+        bool subscriber = false;
+
+        PresenceState() = default;
+        explicit PresenceState(const ConnectionData& d)
+            : user_id(d.user_id), conn(d.conn), batched(d.batched_presence), subscriber(d.presence_subscriber)
+        {
+        }
+        bool operator==(const PresenceState& o) const
+        {
+            return user_id == o.user_id && conn == o.conn && batched == o.batched && subscriber == o.subscriber;
+        }
+    };
+
+    void sync_presence(const PresenceState& before, const ConnectionData& data)
+    {
+        if (PresenceState(data) == before) return;
+        if (before.user_id != data.user_id) audience_.remove(before.user_id);
+        audience_.update(data.user_id, data.conn, data.batched_presence, data.presence_subscriber);
+    }
+
+    struct SyncUserList {
+        SessionRegistry& registry;
+        const SessionMap& sessions;
+        const std::string& username;
+        PresenceState presence;
+
+        SyncUserList(SessionRegistry& r, const SessionMap& s, const std::string& u)
+            : registry(r), sessions(s), username(u)
+        {
+            auto it = sessions.find(username);
+            if (it != sessions.end()) presence = PresenceState(it->second);
+        }
+        ~SyncUserList()
+        {
+            auto it = sessions.find(username);
+            if (it != sessions.end())
+            {
+                registry.user_list_.upsert(username, status_byte(it->second.status));
+                registry.sync_presence(presence, it->second);
+            }
+            else
+            {
+                registry.user_list_.remove(username);
+                registry.audience_.remove(presence.user_id);
+            }
+        }
+    };
+
+    size_t shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+    UserListSnapshot user_list_;
+    PresenceAudience audience_;
+};
+
+// Sesión por conexión, guardada en conn.userdata(). Permite resolver el
+// remitente de cada frame y marcar actividad en O(1), sin recorrer el registro.
+struct ConnectionSession {
+    std::string username;
+    SessionRegistry::Handle handle;
+    uint32_t user_id = 0;
+};
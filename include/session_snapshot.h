@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "session_registry.h"
+
+// Estado de un usuario tal como se guarda en el snapshot. last_active va en
+// milisegundos de reloj de pared para que tenga sentido tras reiniciar.
+struct SessionRecord {
+    std::string username;
+    std::string uuid;
+    UserStatus status = UserStatus::DISCONNECTED;
+    std::string ip_address;
+    int64_t last_active_ms = 0;
+};
+
+// Snapshot binario de sesiones: "SSN1", cantidad u32 y luego cada registro como
+// [len][usuario][len][uuid][estado u8][len][ip][last_active i64], con un
+// crc32 final. Se escribe en un archivo temporal que reemplaza al anterior con
+// rename(), así un corte a mitad de escritura deja el snapshot previo intacto.
+class SessionSnapshot {
+public:
+    static bool write(const std::string& path, const std::vector<SessionRecord>& records);
+    // Devuelve false si el archivo no existe o está corrupto.
+    static bool load(const std::string& path, std::vector<SessionRecord>& records);
+};
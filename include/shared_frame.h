@@ -0,0 +1,37 @@
+#pragma once
+#include "crow.h"
+#include <memory>
+#include <string>
+
+// Frame binario inmutable y con conteo de referencias. El frame WebSocket
+// completo (encabezado + payload) se codifica una vez por evento y cada
+// destinatario encola una referencia a los mismos bytes, así que un broadcast
+// cuesta O(1) en memoria respecto al tamaño del payload y no recalcula el
+// encabezado por conexión. La clase indica si el frame se puede descartar
+// cuando la cola de un cliente lento se llena (ver outbound_limits).
+class SharedFrame {
+public:
+    explicit SharedFrame(const std::string& payload,
+                         crow::websocket::frame_class cls = crow::websocket::frame_class::data)
+        : frame_(crow::websocket::encode_frame(0x2, payload, cls))
+    {
+    }
+
+    std::string payload() const { return frame_.payload(); }
+    size_t size() const { return frame_.payload_size(); }
+    size_t wire_size() const { return frame_.wire->size(); }
+
+    void send_to(crow::websocket::connection& conn) const
+    {
+        conn.send_frame(frame_);
+    }
+
+    // Solo desde el hilo que corre el io_context de la conexión.
+    void queue_to(crow::websocket::connection& conn) const
+    {
+        conn.queue_frame(frame_);
+    }
+
+private:
+    crow::websocket::encoded_frame frame_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Rueda de temporizadores jerárquica (4 niveles de 64 ranuras) indexada por
+// llaves enteras densas, pensada para los IDs de UserIdTable. Cada llave
+// tiene como mucho un plazo pendiente: schedule() lo crea o lo mueve y
+// cancel() lo quita, ambos en O(1) porque las entradas forman listas
+// doblemente enlazadas dentro de un vector indexado por la llave. advance()
+// recorre solo las ranuras de los ticks transcurridos; las entradas de los
+// niveles altos bajan de nivel (cascade) cuando su ranura llega al frente.
+// Un plazo vence en el primer tick que empieza en o después de él, así que
+// el error máximo es un tick.
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kLevels = 4;
+    static constexpr size_t kSlotBits = 6;
+    static constexpr size_t kSlots = size_t(1) << kSlotBits;
+
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100),
+                         Clock::time_point start = Clock::now());
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // Programa (o reprograma) el plazo de `key`. Plazos más lejanos que el
+    // alcance de la rueda (kSlots^kLevels ticks) se recortan a ese alcance.
+    void schedule(uint32_t key, Clock::time_point deadline);
+    // Devuelve false si la llave no tenía plazo pendiente.
+    bool cancel(uint32_t key);
+    bool contains(uint32_t key) const;
+
+    // Avanza la rueda hasta `now` y agrega a `expired` las llaves vencidas,
+    // que dejan de estar programadas. Devuelve cuántas se agregaron.
+    size_t advance(Clock::time_point now, std::vector<uint32_t>& expired);
+
+    size_t size() const;
+    std::chrono::milliseconds tick() const { return tick_; }
+    void clear();
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr uint16_t kNoSlot = UINT16_MAX;
+
+    struct Node {
+        uint64_t deadline = 0;  // en ticks desde start
+        uint32_t prev = kNone;
+        uint32_t next = kNone;
+        uint16_t slot = kNoSlot;
+    };
+
+    uint64_t to_tick(Clock::time_point tp) const;
+    void link(uint32_t key);
+    void unlink(uint32_t key);
+    void cascade(size_t level);
+
+    const std::chrono::milliseconds tick_;
+    const Clock::time_point start_;
+
+    mutable std::mutex mutex_;
+    uint64_t current_ = 0;  // siguiente tick por procesar
+    size_t size_ = 0;
+    std::vector<Node> nodes_;
+    std::array<uint32_t, kLevels * kSlots> heads_;
+};
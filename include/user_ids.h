@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Asigna a cada nombre de usuario un ID entero denso (desde 1; 0 significa
+// "sin ID") la primera vez que se conecta. Los IDs no se reciclan, así que
+// pueden usarse como llave estable del historial aunque el usuario se
+// desconecte.
+//
+// Las búsquedas reciben vistas (por ejemplo, al frame recibido) y no copian
+// el nombre: las llaves del mapa son vistas a los nombres guardados en
+// names_, que no se mueven al crecer.
+class UserIdTable {
+public:
+    static constexpr uint32_t kInvalid = 0;
+
+    // Devuelve el ID del usuario, asignándole uno nuevo si no tenía.
+    uint32_t intern(std::string_view username);
+    // ID ya asignado, o kInvalid si el usuario nunca se conectó.
+    uint32_t find(std::string_view username) const;
+    std::string name(uint32_t id) const;
+    size_t size() const;
+    void clear();
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string_view, uint32_t> ids_;
+    std::deque<std::string> names_;
+};
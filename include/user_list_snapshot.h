@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Payload del opcode 51 (lista de usuarios) ya serializado. Las altas se
+// agregan al final del payload y los cambios de estado parchan un byte en su
+// lugar; no se vuelve a recorrer el registro. Una baja quita la entrada en
+// O(1) (se mueve la última a su lugar) y deja el payload para rearmar la
+// próxima vez que alguien lo pida. current() devuelve una copia inmutable con
+// conteo de referencias que se publica como mucho una vez por versión, así
+// que muchas solicitudes seguidas comparten los mismos bytes.
+class UserListSnapshot {
+public:
+    struct View {
+        uint64_t version;
+        std::string payload;  // [51][cantidad][UserEntry...]
+    };
+
+    UserListSnapshot();
+
+    // Alta o cambio de estado. Devuelve true si la lista cambió.
+    bool upsert(const std::string& username, uint8_t status);
+    // Solo cambio de estado: no agrega al usuario si no está.
+    bool set_status(const std::string& username, uint8_t status);
+    bool remove(const std::string& username);
+    void clear();
+
+    std::shared_ptr<const View> current() const;
+    uint64_t version() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        std::string username;
+        uint8_t status;
+        size_t offset;  // inicio de la entrada en payload_, válido si !stale_
+    };
+
+    void patch_status(Entry& entry, uint8_t status);
+    void rebuild() const;
+
+    mutable std::mutex mutex_;
+    mutable std::vector<Entry> entries_;
+    std::unordered_map<std::string, size_t> index_;  // posición en entries_
+    mutable std::string payload_;
+    mutable bool stale_ = false;
+    uint64_t version_ = 0;
+    mutable std::shared_ptr<const View> published_;
+};
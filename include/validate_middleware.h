@@ -20,15 +20,15 @@ struct ValidateMiddleware
                 return;
             }
 
-            {
-                std::lock_guard<std::mutex> lock(connections_mutex);
-                auto it = connections.find(name);
-                if (it != connections.end() && it->second.status != UserStatus::DISCONNECTED) {
-                    res.code = 400;
-                    res.write("Usuario ya conectado o activo");
-                    res.end();
-                    return;
-                }
+            bool en_uso = false;
+            connections.with_session_shared(name, [&](const ConnectionData& cd) {
+                en_uso = cd.status != UserStatus::DISCONNECTED;
+            });
+            if (en_uso) {
+                res.code = 400;
+                res.write("Usuario ya conectado o activo");
+                res.end();
+                return;
             }
 
             res.code = 200;
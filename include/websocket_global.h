@@ -3,12 +3,29 @@
 #include <string>
 #include <vector>
 #include "websocket_handler.h"
+#include "history_store.h"
+#include "user_ids.h"
+#include "message_log.h"
+#include "search_index.h"
+#include "timing_wheel.h"
+#include "presence_batcher.h"
+#include "presence_subscriptions.h"
+#include "room_registry.h"
+#include "offline_mailbox.h"
 
-extern std::unordered_map<std::string, ConnectionData> connections;
-extern std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> chat_history;
+extern SessionRegistry connections;
 extern std::unordered_map<std::string, UserStatus> last_user_status;
-extern std::mutex connections_mutex;
-extern std::vector<std::pair<std::string, std::string>> general_chat_history;
+extern std::mutex last_user_status_mutex;
+extern HistoryStore history_store;
+extern UserIdTable user_ids;
+extern MessageLog message_log;
+extern SearchIndex search_index;
+extern TimingWheel inactivity_timers;
+extern TimingWheel disconnect_timers;
+extern PresenceBatcher presence_batcher;
+extern PresenceSubscriptions presence_subscriptions;
+extern RoomRegistry rooms;
+extern OfflineMailboxes offline_mailboxes;
 extern std::condition_variable inactivity_cv;
 extern std::mutex inactivity_mutex;
 extern bool user_marked_inactive;
\ No newline at end of file
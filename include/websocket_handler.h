@@ -6,25 +6,11 @@
 #include <chrono>
 #include <thread>
 #include <future>
+#include "session_registry.h"
+#include "protocol.h"
+#include "fanout_executor.h"
 
-enum class UserStatus { 
-    DISCONNECTED = 0,
-    ACTIVO = 1, 
-    OCUPADO = 2, 
-    INACTIVO = 3 
-};
-
-struct ConnectionData {
-    std::string username;
-    std::string uuid;
-    crow::websocket::connection* conn;
-    UserStatus status;
-    std::chrono::steady_clock::time_point last_active;
-    std::string ip_address;
-};
-
-extern std::unordered_map<std::string, ConnectionData> connections;
-extern std::mutex connections_mutex;
+extern SessionRegistry connections;
 
 class WebSocketHandler {
 public:
@@ -33,18 +19,52 @@ public:
     static void on_close(crow::websocket::connection& conn, const std::string& reason, uint16_t code);
     static void update_status(const std::string& username, UserStatus status, bool notify = true);
     static std::string list_users();
+    static void set_outbound_limits(const crow::websocket::outbound_limits& limits);
+    static crow::websocket::outbound_limits get_outbound_limits();
+    // Abre el log de mensajes en `dir` y reconstruye el historial en memoria.
+    static size_t restore_history(const std::string& dir);
+    // Snapshot de sesiones y estados para que un reinicio conserve el estado de cada usuario.
+    static bool save_snapshot(const std::string& path);
+    static size_t load_snapshot(const std::string& path);
+    static void start_snapshotter(const std::string& path, std::chrono::seconds interval);
     static void start_inactivity_monitor();
+    // Avanza la rueda de inactividad hasta `now`, marca INACTIVO a los usuarios
+    // cuyo plazo venció y lo notifica. Devuelve cuántos se marcaron.
+    static size_t expire_inactive(std::chrono::steady_clock::time_point now);
     static void start_disconnection_cleanup();
-    static void handle_list_users(crow::websocket::connection& conn);
-    static void handle_get_user_info(crow::websocket::connection& conn, const std::string& data, size_t& offset);
-    static void handle_change_status(crow::websocket::connection& conn, const std::string& sender, const std::string& data, size_t& offset);
-    static void handle_send_message(crow::websocket::connection& conn, const std::string& sender, const std::string& data, size_t& offset);
-    static void handle_get_history(crow::websocket::connection& conn, const std::string& sender, const std::string& data, size_t& offset);
-    static uint8_t read_uint8(const std::string& data, size_t& offset);
-    static std::string read_string_8(const std::string& data, size_t& offset);
+    // Elimina las sesiones desconectadas cuyo plazo de retención venció hasta
+    // `now`, en lotes pequeños. Devuelve cuántas se eliminaron.
+    static size_t evict_disconnected(std::chrono::steady_clock::time_point now);
+    // Handlers de los mensajes del cliente (ver proto:: en protocol.h). Los
+    // campos llegan ya decodificados, como vistas al frame recibido.
+    static void handle_list_users(crow::websocket::connection& conn, const std::string& sender);
+    static void handle_get_user_info(crow::websocket::connection& conn, const std::string& sender, std::string_view name);
+    static void handle_change_status(crow::websocket::connection& conn, const std::string& sender, std::string_view username, uint8_t raw_status);
+    static void handle_send_message(crow::websocket::connection& conn, const std::string& sender, std::string_view destino, std::string_view mensaje);
+    static void handle_get_history(crow::websocket::connection& conn, const std::string& sender, std::string_view target);
+    static void handle_get_history_page(crow::websocket::connection& conn, const std::string& sender, std::string_view target, uint64_t cursor, uint8_t page_size);
+    static void handle_search(crow::websocket::connection& conn, const std::string& sender, std::string_view query, uint8_t max_results);
+    static void handle_presence_mode(crow::websocket::connection& conn, const std::string& sender, uint8_t mode);
+    static void handle_subscribe(crow::websocket::connection& conn, const std::string& sender, std::string_view username, uint8_t action);
+    static void handle_create_room(crow::websocket::connection& conn, const std::string& sender, std::string_view room);
+    static void handle_join_room(crow::websocket::connection& conn, const std::string& sender, std::string_view room);
+    static void handle_leave_room(crow::websocket::connection& conn, const std::string& sender, std::string_view room);
+    static void handle_post_room(crow::websocket::connection& conn, const std::string& sender, std::string_view room, std::string_view mensaje);
+    static void handle_get_room_history(crow::websocket::connection& conn, const std::string& sender, std::string_view room, uint64_t cursor, uint8_t page_size);
     static void notify_user_joined(const std::string& username, UserStatus st);
     static void notify_user_status_change(const std::string& username, UserStatus st);
-    static void notify_new_message(const std::string& sender, const std::string& msg, bool is_private, const std::string& recipient);
-    static void send_private_message(const std::string& sender, const std::string& recipient, const std::string& msg);
-    static void send_broadcast(const std::string& sender, const std::string& msg);
+    // Entrega las transiciones acumuladas como frames 59 a los clientes que
+    // pidieron presencia en lotes. Devuelve cuántos frames se armaron.
+    static size_t flush_presence();
+    static void start_presence_flusher();
+    // Ventana de acumulación de presencia (por defecto 30 ms, entre 1 y 1000).
+    static void set_presence_window(std::chrono::milliseconds window);
+    static std::chrono::milliseconds get_presence_window();
+    // Un privado llega con sus destinatarios (remitente y destinatario) ya
+    // resueltos; un mensaje general se entrega a todos los conectados.
+    static void notify_new_message(std::string_view sender, std::string_view msg, bool is_private, std::vector<FanoutTarget> targets = {});
+    // `sender_conn` es la conexión del remitente si el mensaje llegó por un
+    // frame; sin ella se busca por nombre.
+    static void send_private_message(const std::string& sender, std::string_view recipient, std::string_view msg, uint32_t sender_id = 0, crow::websocket::connection* sender_conn = nullptr);
+    static void send_broadcast(const std::string& sender, std::string_view msg, uint32_t sender_id = 0);
 };
\ No newline at end of file
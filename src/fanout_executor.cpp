@@ -0,0 +1,62 @@
+#include "../include/fanout_executor.h"
+
+FanoutExecutor& FanoutExecutor::getInstance()
+{
+    static FanoutExecutor instance;
+    return instance;
+}
+
+FanoutTarget FanoutExecutor::target_for(crow::websocket::connection& conn)
+{
+    return FanoutTarget{&conn, conn.get_io_context(), conn.lifetime()};
+}
+
+void FanoutExecutor::deliver(const SharedFrame& frame, const std::vector<FanoutTarget>& targets)
+{
+    // Hay pocos io_context (uno por hilo de Crow), así que basta una búsqueda lineal.
+    struct Batch {
+        crow::asio::io_context* context;
+        std::vector<FanoutTarget> targets;
+    };
+    std::vector<Batch> batches;
+
+    for (const auto& target : targets)
+    {
+        if (!target.context)
+        {
+            frame.send_to(*target.conn);
+            inline_deliveries_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        Batch* batch = nullptr;
+        for (auto& b : batches)
+        {
+            if (b.context == target.context)
+            {
+                batch = &b;
+                break;
+            }
+        }
+        if (!batch)
+        {
+            batches.push_back(Batch{target.context, {}});
+            batch = &batches.back();
+        }
+        batch->targets.push_back(target);
+    }
+
+    for (auto& batch : batches)
+    {
+        batches_posted_.fetch_add(1, std::memory_order_relaxed);
+        crow::asio::post(*batch.context, [frame, targets = std::move(batch.targets)]() {
+            for (const auto& target : targets)
+            {
+                if (auto alive = target.lifetime.lock())
+                {
+                    frame.queue_to(*target.conn);
+                }
+            }
+        });
+    }
+}
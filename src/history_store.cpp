@@ -0,0 +1,406 @@
+#include "../include/history_store.h"
+#include <algorithm>
+#include <cstring>
+#include <shared_mutex>
+
+// Buffer circular de una conversación. El mensaje i vive en el slot
+// i % capacidad; su secuencia vale 2*(i+1) cuando está completo y es impar
+// mientras se escribe, así un lector detecta tanto una escritura en curso
+// como un slot reutilizado por un mensaje más nuevo.
+class HistoryStore::Ring {
+public:
+    explicit Ring(size_t capacity)
+    {
+        capacity_ = kChunkSlots;
+        while (capacity_ < capacity) capacity_ <<= 1;
+        chunk_count_ = capacity_ / kChunkSlots;
+        chunks_.reset(new std::atomic<Slot*>[chunk_count_]);
+        for (size_t i = 0; i < chunk_count_; ++i)
+        {
+            chunks_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~Ring()
+    {
+        reset();
+    }
+
+    uint64_t append(std::string_view author, std::string_view text)
+    {
+        uint64_t record[kWords] = {};
+        auto* bytes = reinterpret_cast<unsigned char*>(record);
+        size_t alen = std::min(author.size(), kMaxAuthor);
+        size_t tlen = std::min(text.size(), kMaxText);
+        bytes[0] = static_cast<unsigned char>(alen);
+        bytes[1] = static_cast<unsigned char>(tlen);
+        std::memcpy(bytes + 2, author.data(), alen);
+        std::memcpy(bytes + 2 + alen, text.data(), tlen);
+        size_t words = words_for(2 + alen + tlen);
+
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        uint64_t index = count_.load(std::memory_order_relaxed);
+        Slot& slot = slot_for_write(index);
+
+        slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t w = 0; w < words; ++w)
+        {
+            slot.words[w].store(record[w], std::memory_order_relaxed);
+        }
+        slot.seq.store(2 * (index + 1), std::memory_order_release);
+        count_.store(index + 1, std::memory_order_release);
+        return index + 1;
+    }
+
+    // fn(author, author_len, text, text_len) para los últimos max_entries
+    // mensajes, del más antiguo al más nuevo. Los slots sobrescritos durante
+    // la lectura se omiten. Devuelve cuántos se visitaron.
+    template <typename Fn>
+    size_t for_each_recent(size_t max_entries, Fn&& fn) const
+    {
+        return for_each_before(0, max_entries, fn).count;
+    }
+
+    // Igual que for_each_recent pero solo con mensajes de secuencia menor a
+    // `before` (las secuencias empiezan en 1; 0 significa "desde el final").
+    template <typename Fn>
+    Page for_each_before(uint64_t before, size_t max_entries, Fn&& fn) const
+    {
+        uint64_t count = count_.load(std::memory_order_acquire);
+        uint64_t retained = count - std::min<uint64_t>(count, capacity_);
+        uint64_t end = (before == 0 || before > count) ? count : before - 1;
+
+        Page page;
+        page.oldest_retained = retained + 1;
+        if (end <= retained) return page;
+        uint64_t first = end - std::min<uint64_t>(end - retained, max_entries);
+
+        uint64_t record[kWords];
+        for (uint64_t index = first; index < end; ++index)
+        {
+            if (!read(index, record)) continue;
+            const auto* bytes = reinterpret_cast<const unsigned char*>(record);
+            const char* author = reinterpret_cast<const char*>(bytes + 2);
+            fn(author, bytes[0], author + bytes[0], bytes[1]);
+            if (page.count++ == 0) page.first_seq = index + 1;
+        }
+        return page;
+    }
+
+    size_t size() const
+    {
+        return static_cast<size_t>(std::min<uint64_t>(count_.load(std::memory_order_acquire), capacity_));
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < chunk_count_; ++i)
+        {
+            delete[] chunks_[i].exchange(nullptr, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t kChunkSlots = 32;
+    static constexpr size_t kWords = (2 + kMaxAuthor + kMaxText + 7) / 8;
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<uint64_t> words[kWords];
+    };
+
+    static size_t words_for(size_t bytes) { return (bytes + 7) / 8; }
+
+    // Los slots se reservan por bloques la primera vez que se usan, así una
+    // conversación corta no ocupa la capacidad completa.
+    Slot& slot_for_write(uint64_t index)
+    {
+        size_t pos = static_cast<size_t>(index & (capacity_ - 1));
+        auto& chunk = chunks_[pos / kChunkSlots];
+        Slot* slots = chunk.load(std::memory_order_relaxed);
+        if (!slots)
+        {
+            slots = new Slot[kChunkSlots];
+            chunk.store(slots, std::memory_order_release);
+        }
+        return slots[pos % kChunkSlots];
+    }
+
+    bool read(uint64_t index, uint64_t (&record)[kWords]) const
+    {
+        size_t pos = static_cast<size_t>(index & (capacity_ - 1));
+        const Slot* slots = chunks_[pos / kChunkSlots].load(std::memory_order_acquire);
+        if (!slots) return false;
+        const Slot& slot = slots[pos % kChunkSlots];
+
+        uint64_t expected = 2 * (index + 1);
+        if (slot.seq.load(std::memory_order_acquire) != expected) return false;
+
+        record[0] = slot.words[0].load(std::memory_order_relaxed);
+        const auto* bytes = reinterpret_cast<const unsigned char*>(record);
+        size_t alen = std::min<size_t>(bytes[0], kMaxAuthor);
+        size_t tlen = bytes[1];
+        size_t words = words_for(2 + alen + tlen);
+        for (size_t w = 1; w < words; ++w)
+        {
+            record[w] = slot.words[w].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == expected;
+    }
+
+    size_t capacity_;
+    size_t chunk_count_;
+    std::unique_ptr<std::atomic<Slot*>[]> chunks_;
+    std::atomic<uint64_t> count_{0};
+    std::mutex write_mutex_;
+};
+
+// Mapa de llave de conversación a buffer con direccionamiento abierto y
+// sondeo lineal: llaves y punteros en arreglos contiguos, sin nodos ni
+// strings. La llave 0 marca un slot vacío (los IDs de usuario empiezan en 1).
+class HistoryStore::ConversationTable {
+public:
+    // Finalizador de splitmix64: reparte bien IDs consecutivos.
+    static uint64_t hash_key(uint64_t key)
+    {
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    Ring* find(uint64_t key, uint64_t hash) const
+    {
+        if (keys_.empty()) return nullptr;
+        size_t mask = keys_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            if (keys_[i] == key) return rings_[i].get();
+            if (keys_[i] == 0) return nullptr;
+        }
+    }
+
+    Ring* insert(uint64_t key, uint64_t hash, size_t capacity)
+    {
+        if ((count_ + 1) * 2 > keys_.size()) grow();
+        size_t mask = keys_.size() - 1;
+        size_t i = hash & mask;
+        while (keys_[i] != 0 && keys_[i] != key) i = (i + 1) & mask;
+        if (keys_[i] == 0)
+        {
+            keys_[i] = key;
+            rings_[i].reset(new Ring(capacity));
+            ++count_;
+        }
+        return rings_[i].get();
+    }
+
+    void clear()
+    {
+        keys_.clear();
+        rings_.clear();
+        count_ = 0;
+    }
+
+private:
+    void grow()
+    {
+        std::vector<uint64_t> keys(keys_.empty() ? 16 : keys_.size() * 2, 0);
+        std::vector<std::unique_ptr<Ring>> rings(keys.size());
+        size_t mask = keys.size() - 1;
+        for (size_t j = 0; j < keys_.size(); ++j)
+        {
+            if (keys_[j] == 0) continue;
+            size_t i = hash_key(keys_[j]) & mask;
+            while (keys[i] != 0) i = (i + 1) & mask;
+            keys[i] = keys_[j];
+            rings[i] = std::move(rings_[j]);
+        }
+        keys_.swap(keys);
+        rings_.swap(rings);
+    }
+
+    std::vector<uint64_t> keys_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+    size_t count_ = 0;
+};
+
+struct alignas(64) HistoryStore::Stripe {
+    mutable std::shared_mutex mutex;
+    ConversationTable conversations;
+};
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static void append_entry(std::string& out, const char* author, size_t alen, const char* text, size_t tlen)
+{
+    out.push_back(static_cast<char>(alen));
+    out.append(author, alen);
+    out.push_back(static_cast<char>(tlen));
+    out.append(text, tlen);
+}
+
+HistoryStore::HistoryStore(size_t general_capacity, size_t private_capacity, size_t stripe_count)
+    : private_capacity_(private_capacity),
+      stripe_count_(round_up_pow2(stripe_count == 0 ? 1 : stripe_count)),
+      general_(new Ring(general_capacity)),
+      stripes_(new Stripe[stripe_count_])
+{
+}
+
+HistoryStore::~HistoryStore() = default;
+
+// Los bits altos del hash eligen el stripe y los bajos el slot dentro de él.
+HistoryStore::Stripe& HistoryStore::stripe_for(uint64_t hash) const
+{
+    return stripes_[(hash >> 48) & (stripe_count_ - 1)];
+}
+
+const HistoryStore::Ring* HistoryStore::find_ring(uint64_t key) const
+{
+    uint64_t hash = ConversationTable::hash_key(key);
+    Stripe& stripe = stripe_for(hash);
+    std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+    return stripe.conversations.find(key, hash);
+}
+
+HistoryStore::Ring* HistoryStore::ring_for_append(uint64_t key)
+{
+    uint64_t hash = ConversationTable::hash_key(key);
+    Stripe& stripe = stripe_for(hash);
+    Ring* ring = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+        ring = stripe.conversations.find(key, hash);
+    }
+    if (!ring)
+    {
+        std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+        ring = stripe.conversations.insert(key, hash, private_capacity_);
+    }
+    // Los buffers no se liberan mientras el store existe (salvo clear()),
+    // así que se puede escribir sin el lock del stripe.
+    return ring;
+}
+
+const HistoryStore::Ring* HistoryStore::find_private(uint32_t user_a, uint32_t user_b) const
+{
+    if (user_a == 0 || user_b == 0) return nullptr;
+    return find_ring(conversation_key(user_a, user_b));
+}
+
+uint64_t HistoryStore::append_general(std::string_view author, std::string_view text)
+{
+    return general_->append(author, text);
+}
+
+uint64_t HistoryStore::append_private(uint32_t user_a, uint32_t user_b, std::string_view author, std::string_view text)
+{
+    if (user_a == 0 || user_b == 0) return 0;
+    return ring_for_append(conversation_key(user_a, user_b))->append(author, text);
+}
+
+uint64_t HistoryStore::append_room(uint32_t room_id, std::string_view author, std::string_view text)
+{
+    if (room_id == 0) return 0;
+    return ring_for_append(room_key(room_id))->append(author, text);
+}
+
+size_t HistoryStore::write_general(std::string& out, size_t max_entries) const
+{
+    return general_->for_each_recent(max_entries, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        append_entry(out, a, alen, t, tlen);
+    });
+}
+
+size_t HistoryStore::write_private(uint32_t user_a, uint32_t user_b, std::string& out, size_t max_entries) const
+{
+    const Ring* ring = find_private(user_a, user_b);
+    if (!ring) return 0;
+    return ring->for_each_recent(max_entries, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        append_entry(out, a, alen, t, tlen);
+    });
+}
+
+HistoryStore::Page HistoryStore::write_general_page(std::string& out, uint64_t before, size_t max_entries) const
+{
+    return general_->for_each_before(before, max_entries, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        append_entry(out, a, alen, t, tlen);
+    });
+}
+
+HistoryStore::Page HistoryStore::write_private_page(uint32_t user_a, uint32_t user_b, std::string& out, uint64_t before, size_t max_entries) const
+{
+    const Ring* ring = find_private(user_a, user_b);
+    if (!ring) return Page{};
+    return ring->for_each_before(before, max_entries, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        append_entry(out, a, alen, t, tlen);
+    });
+}
+
+HistoryStore::Page HistoryStore::write_room_page(uint32_t room_id, std::string& out, uint64_t before, size_t max_entries) const
+{
+    const Ring* ring = room_id != 0 ? find_ring(room_key(room_id)) : nullptr;
+    if (!ring) return Page{};
+    return ring->for_each_before(before, max_entries, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        append_entry(out, a, alen, t, tlen);
+    });
+}
+
+size_t HistoryStore::general_size() const
+{
+    return general_->size();
+}
+
+size_t HistoryStore::private_size(uint32_t user_a, uint32_t user_b) const
+{
+    const Ring* ring = find_private(user_a, user_b);
+    return ring ? ring->size() : 0;
+}
+
+size_t HistoryStore::room_size(uint32_t room_id) const
+{
+    const Ring* ring = room_id != 0 ? find_ring(room_key(room_id)) : nullptr;
+    return ring ? ring->size() : 0;
+}
+
+std::vector<std::pair<std::string, std::string>> HistoryStore::general_messages() const
+{
+    std::vector<std::pair<std::string, std::string>> messages;
+    general_->for_each_recent(SIZE_MAX, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        messages.emplace_back(std::string(a, alen), std::string(t, tlen));
+    });
+    return messages;
+}
+
+std::vector<std::pair<std::string, std::string>> HistoryStore::private_messages(uint32_t user_a, uint32_t user_b) const
+{
+    std::vector<std::pair<std::string, std::string>> messages;
+    const Ring* ring = find_private(user_a, user_b);
+    if (!ring) return messages;
+    ring->for_each_recent(SIZE_MAX, [&](const char* a, size_t alen, const char* t, size_t tlen) {
+        messages.emplace_back(std::string(a, alen), std::string(t, tlen));
+    });
+    return messages;
+}
+
+void HistoryStore::clear()
+{
+    general_->reset();
+    for (size_t i = 0; i < stripe_count_; ++i)
+    {
+        std::unique_lock<std::shared_mutex> lock(stripes_[i].mutex);
+        stripes_[i].conversations.clear();
+    }
+}
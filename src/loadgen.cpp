@@ -0,0 +1,251 @@
+// Generador de carga: abre N conexiones WebSocket contra el servidor y cada
+// una envía mensajes al chat general (opcode 4) a un ritmo fijo. Los frames
+// se codifican y decodifican con el esquema de protocol.h. Cada mensaje lleva
+// la marca de tiempo de envío, así que el eco que recibe el propio remitente
+// (opcode 55) da la latencia de punta a punta.
+//
+//   loadgen [--host H] [--port P] [--clients N] [--seconds S] [--rate R] [--size B]
+#include "../include/protocol.h"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+using tcp = asio::ip::tcp;
+using load_clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "18080";
+    int clients = 50;
+    int seconds = 10;
+    double rate = 10;   // mensajes por segundo por cliente
+    size_t size = 64;   // bytes por mensaje (mínimo 16: la marca de tiempo)
+};
+
+struct Stats {
+    size_t connected = 0;
+    size_t failed = 0;
+    size_t sent = 0;
+    size_t received[256] = {};
+    std::vector<double> latencies_us;
+};
+
+class Client : public std::enable_shared_from_this<Client> {
+public:
+    Client(asio::io_context& io, const Options& options, Stats& stats, int index)
+        : ws_(io), timer_(io), options_(options), stats_(stats), name_("load" + std::to_string(index))
+    {
+    }
+
+    void start(const tcp::resolver::results_type& endpoints)
+    {
+        asio::async_connect(ws_.next_layer(), endpoints,
+                            [self = shared_from_this()](beast::error_code ec, const tcp::endpoint&) {
+                                if (ec) return self->fail("connect", ec);
+                                self->ws_.next_layer().set_option(tcp::no_delay(true));
+                                self->handshake();
+                            });
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+        timer_.cancel();
+        if (!ws_.is_open())
+        {
+            // Todavía conectando: se corta el socket y el handshake falla.
+            beast::error_code ignored;
+            beast::get_lowest_layer(ws_).close(ignored);
+        }
+        else if (outbox_.empty())
+        {
+            close();
+        }
+    }
+
+private:
+    void handshake()
+    {
+        ws_.binary(true);
+        ws_.async_handshake(options_.host + ":" + options_.port, "/?name=" + name_,
+                            [self = shared_from_this()](beast::error_code ec) {
+                                if (ec) return self->fail("handshake", ec);
+                                self->stats_.connected++;
+                                self->read();
+                                self->schedule_send();
+                            });
+    }
+
+    void read()
+    {
+        ws_.async_read(buffer_, [self = shared_from_this()](beast::error_code ec, size_t) {
+            if (ec) return;
+            self->on_frame();
+            self->read();
+        });
+    }
+
+    void on_frame()
+    {
+        auto data = buffer_.data();
+        std::string_view frame(static_cast<const char*>(data.data()), data.size());
+        if (!frame.empty())
+        {
+            stats_.received[static_cast<uint8_t>(frame[0])]++;
+            std::string_view sender, text;
+            if (proto::NewMessage::decode(frame, sender, text) && sender == name_ && text.size() >= 16)
+            {
+                uint64_t sent_ns = std::strtoull(std::string(text.substr(0, 16)).c_str(), nullptr, 16);
+                uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(load_clock::now().time_since_epoch()).count();
+                stats_.latencies_us.push_back((now_ns - sent_ns) / 1000.0);
+            }
+        }
+        buffer_.consume(buffer_.size());
+    }
+
+    void schedule_send()
+    {
+        if (stopped_) return;
+        timer_.expires_after(std::chrono::microseconds(static_cast<int64_t>(1e6 / options_.rate)));
+        timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (ec || self->stopped_) return;
+            self->send_one();
+            self->schedule_send();
+        });
+    }
+
+    void send_one()
+    {
+        char stamp[17];
+        uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(load_clock::now().time_since_epoch()).count();
+        std::snprintf(stamp, sizeof(stamp), "%016llx", static_cast<unsigned long long>(now_ns));
+        std::string text(stamp, 16);
+        text.resize(std::max<size_t>(options_.size, 16), 'x');
+
+        outbox_.push_back(proto::SendMessage::encode("~", text));
+        stats_.sent++;
+        if (outbox_.size() == 1) write();
+    }
+
+    void write()
+    {
+        ws_.async_write(asio::buffer(outbox_.front()), [self = shared_from_this()](beast::error_code ec, size_t) {
+            if (ec) return self->fail("write", ec);
+            self->outbox_.pop_front();
+            if (!self->outbox_.empty()) self->write();
+            else if (self->stopped_) self->close();
+        });
+    }
+
+    // El cierre cuenta como escritura: solo se inicia con la cola vacía.
+    void close()
+    {
+        if (closing_ || !ws_.is_open()) return;
+        closing_ = true;
+        ws_.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {});
+    }
+
+    void fail(const char* what, beast::error_code ec)
+    {
+        if (stopped_) return;
+        stats_.failed++;
+        std::cerr << name_ << ": " << what << ": " << ec.message() << "\n";
+        stopped_ = true;
+        timer_.cancel();
+        beast::error_code ignored;
+        beast::get_lowest_layer(ws_).close(ignored);
+    }
+
+    websocket::stream<tcp::socket> ws_;
+    asio::steady_timer timer_;
+    const Options& options_;
+    Stats& stats_;
+    std::string name_;
+    beast::flat_buffer buffer_;
+    std::deque<std::string> outbox_;
+    bool stopped_ = false;
+    bool closing_ = false;
+};
+
+static bool parse_args(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--host") options.host = value;
+        else if (arg == "--port") options.port = value;
+        else if (arg == "--clients") options.clients = std::atoi(value.c_str());
+        else if (arg == "--seconds") options.seconds = std::atoi(value.c_str());
+        else if (arg == "--rate") options.rate = std::atof(value.c_str());
+        else if (arg == "--size") options.size = std::strtoul(value.c_str(), nullptr, 10);
+        else return false;
+    }
+    return options.clients > 0 && options.seconds > 0 && options.rate > 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_args(argc, argv, options))
+    {
+        std::cerr << "uso: loadgen [--host H] [--port P] [--clients N] [--seconds S] [--rate R] [--size B]\n";
+        return 2;
+    }
+
+    asio::io_context io;
+    Stats stats;
+    tcp::resolver resolver(io);
+    beast::error_code ec;
+    auto endpoints = resolver.resolve(options.host, options.port, ec);
+    if (ec)
+    {
+        std::cerr << "loadgen: no se pudo resolver " << options.host << ": " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::vector<std::shared_ptr<Client>> clients;
+    for (int i = 0; i < options.clients; i++)
+    {
+        clients.push_back(std::make_shared<Client>(io, options, stats, i));
+        clients.back()->start(endpoints);
+    }
+
+    asio::steady_timer deadline(io, std::chrono::seconds(options.seconds));
+    deadline.async_wait([&](beast::error_code) {
+        for (auto& c : clients) c->stop();
+    });
+
+    auto begin = load_clock::now();
+    io.run();
+    double secs = std::chrono::duration<double>(load_clock::now() - begin).count();
+
+    size_t delivered = stats.received[proto::NewMessage::opcode];
+    std::printf("clientes: %zu conectados, %zu fallidos\n", stats.connected, stats.failed);
+    std::printf("enviados: %zu (%.0f msgs/s), recibidos 55: %zu (%.0f msgs/s), errores 50: %zu\n", stats.sent,
+                stats.sent / secs, delivered, delivered / secs, stats.received[proto::Error::opcode]);
+    if (!stats.latencies_us.empty())
+    {
+        auto& l = stats.latencies_us;
+        std::sort(l.begin(), l.end());
+        std::printf("latencia eco: p50 %.0f us, p99 %.0f us, máx %.0f us (%zu muestras)\n", l[l.size() / 2],
+                    l[l.size() * 99 / 100], l.back(), l.size());
+    }
+    return stats.failed == 0 ? 0 : 1;
+}
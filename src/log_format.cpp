@@ -0,0 +1,322 @@
+#include "../include/log_format.h"
+#include <cstdio>
+#include <ctime>
+#include <strings.h>
+
+static const char* const level_names[] = {"DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+static const char* const component_names[] = {"server", "session", "chat", "presence", "history", "storage"};
+
+const char* log_level_name(LogLevel level)
+{
+    return level_names[static_cast<size_t>(level)];
+}
+
+const char* log_component_name(LogComponent component)
+{
+    return component_names[static_cast<size_t>(component)];
+}
+
+bool parse_log_level(std::string_view name, LogLevel& level)
+{
+    for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++)
+    {
+        if (name.size() == std::strlen(level_names[i]) && strncasecmp(name.data(), level_names[i], name.size()) == 0)
+        {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_log_component(std::string_view name, LogComponent& component)
+{
+    for (size_t i = 0; i < static_cast<size_t>(LogComponent::Count); i++)
+    {
+        if (name.size() == std::strlen(component_names[i]) && strncasecmp(name.data(), component_names[i], name.size()) == 0)
+        {
+            component = static_cast<LogComponent>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace logfmt {
+
+static uint16_t get_u16(const unsigned char* p)
+{
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static uint64_t get_u64(const unsigned char* p)
+{
+    return uint64_t(get_u32(p)) | uint64_t(get_u32(p + 4)) << 32;
+}
+
+static void begin_record(std::string& out, RecordKind kind, size_t& start)
+{
+    start = out.size();
+    out.push_back(static_cast<char>(kind));
+    put_u32(out, 0);
+}
+
+static void end_record(std::string& out, size_t start)
+{
+    uint32_t len = static_cast<uint32_t>(out.size() - start - kRecordHeader);
+    for (int i = 0; i < 4; ++i) out[start + 1 + i] = static_cast<char>((len >> (8 * i)) & 0xFF);
+}
+
+static void put_string16(std::string& out, std::string_view s)
+{
+    size_t n = s.size() < UINT16_MAX ? s.size() : UINT16_MAX;
+    put_u16(out, static_cast<uint16_t>(n));
+    out.append(s.data(), n);
+}
+
+void encode_header(std::string& out, uint64_t wall_ns, uint64_t steady_ns)
+{
+    size_t start;
+    begin_record(out, RecordKind::Header, start);
+    out.append("SLOG", 4);
+    put_u16(out, kVersion);
+    put_u64(out, wall_ns);
+    put_u64(out, steady_ns);
+    end_record(out, start);
+}
+
+void encode_format(std::string& out, uint32_t id, const FormatInfo& info)
+{
+    size_t start;
+    begin_record(out, RecordKind::Format, start);
+    put_u32(out, id);
+    out.push_back(static_cast<char>(info.level));
+    out.push_back(static_cast<char>(info.component));
+    put_string16(out, info.format);
+    put_string16(out, info.file);
+    put_u32(out, info.line);
+    end_record(out, start);
+}
+
+// Cursor acotado sobre el cuerpo de un registro.
+namespace {
+    struct Cursor {
+        const unsigned char* p;
+        const unsigned char* end;
+
+        bool has(size_t n) const { return static_cast<size_t>(end - p) >= n; }
+        bool u8(uint8_t& v) { if (!has(1)) return false; v = *p++; return true; }
+        bool u16(uint16_t& v) { if (!has(2)) return false; v = get_u16(p); p += 2; return true; }
+        bool u32(uint32_t& v) { if (!has(4)) return false; v = get_u32(p); p += 4; return true; }
+        bool u64(uint64_t& v) { if (!has(8)) return false; v = get_u64(p); p += 8; return true; }
+        bool str(std::string_view& s)
+        {
+            uint16_t n;
+            if (!u16(n) || !has(n)) return false;
+            s = std::string_view(reinterpret_cast<const char*>(p), n);
+            p += n;
+            return true;
+        }
+    };
+}
+
+static bool decode_args(Cursor& c, std::vector<Arg>& args)
+{
+    args.clear();
+    while (c.p < c.end)
+    {
+        uint8_t type;
+        c.u8(type);
+        Arg arg;
+        arg.type = static_cast<ArgType>(type);
+        uint64_t raw;
+        uint8_t b;
+        switch (arg.type)
+        {
+        case ArgType::Int:
+            if (!c.u64(raw)) return false;
+            arg.i = static_cast<int64_t>(raw);
+            break;
+        case ArgType::Uint:
+            if (!c.u64(arg.u)) return false;
+            break;
+        case ArgType::Double:
+            if (!c.u64(raw)) return false;
+            std::memcpy(&arg.d, &raw, sizeof(raw));
+            break;
+        case ArgType::Bool:
+            if (!c.u8(b)) return false;
+            arg.u = b;
+            break;
+        case ArgType::String:
+            if (!c.str(arg.s)) return false;
+            break;
+        default:
+            return false;
+        }
+        args.push_back(arg);
+    }
+    return true;
+}
+
+bool decode_entry(std::string_view record, uint32_t& format_id, uint64_t& steady_ns, std::vector<Arg>& args)
+{
+    if (record.size() < kRecordHeader) return false;
+    const auto* base = reinterpret_cast<const unsigned char*>(record.data());
+    Cursor c{base + kRecordHeader, base + record.size()};
+    return c.u32(format_id) && c.u64(steady_ns) && decode_args(c, args);
+}
+
+static void append_arg(std::string& out, const Arg& arg)
+{
+    char buf[32];
+    switch (arg.type)
+    {
+    case ArgType::Int:
+        out += std::to_string(arg.i);
+        break;
+    case ArgType::Uint:
+        out += std::to_string(arg.u);
+        break;
+    case ArgType::Double:
+        std::snprintf(buf, sizeof(buf), "%g", arg.d);
+        out += buf;
+        break;
+    case ArgType::Bool:
+        out += arg.u ? "true" : "false";
+        break;
+    case ArgType::String:
+        out.append(arg.s.data(), arg.s.size());
+        break;
+    }
+}
+
+void format_message(std::string_view format, const std::vector<Arg>& args, std::string& out)
+{
+    size_t next = 0;
+    size_t i = 0;
+    while (i < format.size())
+    {
+        if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && next < args.size())
+        {
+            append_arg(out, args[next++]);
+            i += 2;
+        }
+        else
+        {
+            out.push_back(format[i++]);
+        }
+    }
+}
+
+void append_timestamp(std::string& out, uint64_t wall_ns)
+{
+    std::time_t seconds = static_cast<std::time_t>(wall_ns / 1000000000ull);
+    std::tm tm;
+    localtime_r(&seconds, &tm);
+    char buf[32];
+    size_t n = std::strftime(buf, sizeof(buf), "[%Y-%m-%d %H:%M:%S] ", &tm);
+    out.append(buf, n);
+}
+
+void append_tag(std::string& out, const FormatInfo& info)
+{
+    if (info.level == LogLevel::Off) return;
+    out += log_level_name(info.level);
+    out.push_back(' ');
+    out += log_component_name(info.component);
+    out += ": ";
+}
+
+bool Reader::next(Line& line)
+{
+    while (offset_ < data_.size())
+    {
+        const auto* base = reinterpret_cast<const unsigned char*>(data_.data()) + offset_;
+        size_t remaining = data_.size() - offset_;
+        if (remaining < kRecordHeader)
+        {
+            error_ = "registro truncado al final";
+            return false;
+        }
+        uint32_t len = get_u32(base + 1);
+        if (remaining - kRecordHeader < len)
+        {
+            error_ = "registro truncado al final";
+            return false;
+        }
+        auto kind = static_cast<RecordKind>(base[0]);
+        std::string_view record(data_.data() + offset_, kRecordHeader + len);
+        Cursor c{base + kRecordHeader, base + kRecordHeader + len};
+        size_t at = offset_;
+        offset_ += kRecordHeader + len;
+
+        if (kind == RecordKind::Header)
+        {
+            uint16_t version;
+            if (!c.has(4) || std::memcmp(c.p, "SLOG", 4) != 0)
+            {
+                error_ = "encabezado inválido en el offset " + std::to_string(at);
+                return false;
+            }
+            c.p += 4;
+            if (!c.u16(version) || version != kVersion || !c.u64(anchor_wall_) || !c.u64(anchor_steady_))
+            {
+                error_ = "versión no soportada en el offset " + std::to_string(at);
+                return false;
+            }
+            formats_.clear();
+            known_.clear();
+        }
+        else if (kind == RecordKind::Format)
+        {
+            uint32_t id;
+            uint8_t level, component;
+            std::string_view format, file;
+            FormatInfo info;
+            if (!c.u32(id) || !c.u8(level) || !c.u8(component) || !c.str(format) || !c.str(file) || !c.u32(info.line) ||
+                level > static_cast<uint8_t>(LogLevel::Off) || component >= static_cast<uint8_t>(LogComponent::Count))
+            {
+                error_ = "formato corrupto en el offset " + std::to_string(at);
+                return false;
+            }
+            info.level = static_cast<LogLevel>(level);
+            info.component = static_cast<LogComponent>(component);
+            info.format.assign(format);
+            info.file.assign(file);
+            if (id >= formats_.size())
+            {
+                formats_.resize(id + 1);
+                known_.resize(id + 1, false);
+            }
+            formats_[id] = std::move(info);
+            known_[id] = true;
+        }
+        else if (kind == RecordKind::Entry)
+        {
+            uint32_t id;
+            uint64_t steady_ns;
+            if (!decode_entry(record, id, steady_ns, line.args) || id >= formats_.size() || !known_[id])
+            {
+                error_ = "mensaje corrupto o sin formato en el offset " + std::to_string(at);
+                return false;
+            }
+            line.format = &formats_[id];
+            line.wall_ns = anchor_wall_ + (steady_ns - anchor_steady_);
+            return true;
+        }
+        else
+        {
+            error_ = "tipo de registro desconocido en el offset " + std::to_string(at);
+            return false;
+        }
+    }
+    return false;
+}
+
+}  // namespace logfmt
@@ -0,0 +1,149 @@
+// Convierte un log binario del servidor (server_logs.bin, ver log_format.h)
+// a texto, con el mismo formato que server_logs.txt, o a JSON (una línea
+// por mensaje).
+//
+//   logdecode [--json] [archivo]
+#include "../include/log_format.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+static void append_json_string(std::string &out, std::string_view s)
+{
+    out.push_back('"');
+    for (unsigned char c : s)
+    {
+        switch (c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+            {
+                out.push_back(static_cast<char>(c));
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+static void append_json_arg(std::string &out, const logfmt::Arg &arg)
+{
+    char buf[32];
+    switch (arg.type)
+    {
+    case logfmt::ArgType::Int: out += std::to_string(arg.i); break;
+    case logfmt::ArgType::Uint: out += std::to_string(arg.u); break;
+    case logfmt::ArgType::Double:
+        std::snprintf(buf, sizeof(buf), "%.17g", arg.d);
+        out += buf;
+        break;
+    case logfmt::ArgType::Bool: out += arg.u ? "true" : "false"; break;
+    case logfmt::ArgType::String: append_json_string(out, arg.s); break;
+    }
+}
+
+static void append_json(std::string &out, const logfmt::Reader::Line &line)
+{
+    const logfmt::FormatInfo &info = *line.format;
+    std::string message;
+    logfmt::format_message(info.format, line.args, message);
+
+    out += "{\"ts_ns\":" + std::to_string(line.wall_ns);
+    if (info.level != LogLevel::Off)
+    {
+        out += ",\"level\":\"";
+        out += log_level_name(info.level);
+        out += "\",\"component\":\"";
+        out += log_component_name(info.component);
+        out += "\"";
+    }
+    out += ",\"message\":";
+    append_json_string(out, message);
+    out += ",\"format\":";
+    append_json_string(out, info.format);
+    out += ",\"args\":[";
+    for (size_t i = 0; i < line.args.size(); i++)
+    {
+        if (i) out.push_back(',');
+        append_json_arg(out, line.args[i]);
+    }
+    out += "]";
+    if (!info.file.empty())
+    {
+        out += ",\"file\":";
+        append_json_string(out, info.file);
+        out += ",\"line\":" + std::to_string(info.line);
+    }
+    out += "}\n";
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    std::string path = "server_logs.bin";
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--json") == 0) json = true;
+        else if (std::strcmp(argv[i], "--text") == 0) json = false;
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Uso: " << argv[0] << " [--json|--text] [archivo]\n";
+            return 2;
+        }
+        else path = argv[i];
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "No se pudo abrir " << path << "\n";
+        return 1;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    logfmt::Reader reader(data);
+    logfmt::Reader::Line line;
+    std::string out;
+    size_t count = 0;
+    while (reader.next(line))
+    {
+        if (json)
+        {
+            append_json(out, line);
+        }
+        else
+        {
+            logfmt::append_timestamp(out, line.wall_ns);
+            logfmt::append_tag(out, *line.format);
+            logfmt::format_message(line.format->format, line.args, out);
+            out.push_back('\n');
+        }
+        if (out.size() >= (1 << 16))
+        {
+            std::cout << out;
+            out.clear();
+        }
+        count++;
+    }
+    std::cout << out;
+
+    if (!reader.error().empty())
+    {
+        std::cerr << path << ": " << reader.error() << " (" << count << " mensajes decodificados)\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,20 +1,72 @@
 #include "../include/logger.h"
 #include <iostream>
 #include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <climits>
 #include <ctime>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
 
-Logger::Logger() {
-    logFile.open("server_logs.txt", std::ios::app);
-    if (!logFile.is_open()) {
-        std::cerr << "Error: No se pudo abrir el archivo de logs." << std::endl;
+// Formatos internos, registrados en el constructor.
+static constexpr uint32_t kPlainFormat = 0;
+static constexpr uint32_t kDropFormat = 1;
+
+// Buffer circular de un solo productor: el hilo dueño avanza head y el
+// consumidor avanza tail. Los strings de los slots se reutilizan, así que en
+// régimen estable registrar una línea no reserva memoria.
+struct Logger::Ring {
+    explicit Ring(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    std::vector<std::string> slots;
+    const size_t mask;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> orphaned{false};  // el hilo dueño terminó
+};
+
+// Dueño del buffer en cada hilo; al terminar el hilo, el consumidor lo
+// libera cuando termina de vaciarlo.
+struct Logger::ThreadRing {
+    std::shared_ptr<Ring> ring;
+    ~ThreadRing() {
+        if (ring) ring->orphaned.store(true, std::memory_order_release);
     }
-    running = true;
+};
+
+static size_t roundUpPow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+Logger::Logger()
+    : logFd(-1), output(OutputFormat::Text), running(false), consumerWaiting(false), policy(OverflowPolicy::Block),
+      ringCapacity(4096), dropped(0), reportedDrops(0), formatsWritten(0), cachedSecond(-1),
+      rotateBytes(64 * 1024 * 1024), rotateAgeSeconds(24 * 60 * 60), keepRotated(10), rotateRequested(false),
+      fileSize(0), lastRotatedSeq(-1), compressStop(false), compressBusy(false) {
+    setLevel(LOG_MIN_LEVEL > 0 ? LogLevel::Info : LogLevel::Debug);
+
+    anchorWallNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    anchorSteadyNs = steadyNanos();
+
+    registerFormat(LogLevel::Off, LogComponent::Server, "{}", "", 0);
+    registerFormat(LogLevel::Warn, LogComponent::Server, "Logger: {} mensajes descartados por buffer lleno", __FILE__, __LINE__);
 }
 
 Logger::~Logger() {
     stopLogging();
-    if (logFile.is_open()) {
-        logFile.close();
+    if (logFd >= 0) {
+        ::close(logFd);
     }
 }
 
@@ -23,37 +75,593 @@ Logger& Logger::getInstance() {
     return instance;
 }
 
+void Logger::setLevel(LogLevel level) {
+    for (auto& componentLevel : componentLevels) {
+        componentLevel.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+}
+
+void Logger::setComponentLevel(LogComponent component, LogLevel level) {
+    componentLevels[static_cast<size_t>(component)].store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+LogLevel Logger::componentLevel(LogComponent component) const {
+    return static_cast<LogLevel>(componentLevels[static_cast<size_t>(component)].load(std::memory_order_relaxed));
+}
+
+bool Logger::configure(const std::string& spec) {
+    // Primero se valida todo y después se aplica, para no dejarlo a medias.
+    std::vector<std::pair<int, LogLevel>> changes;  // componente (-1: todos), nivel
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+
+        size_t eq = item.find('=');
+        LogLevel level;
+        if (eq == std::string::npos) {
+            if (!parse_log_level(item, level)) return false;
+            changes.emplace_back(-1, level);
+            continue;
+        }
+        LogComponent component;
+        if (!parse_log_component(item.substr(0, eq), component) || !parse_log_level(item.substr(eq + 1), level)) {
+            return false;
+        }
+        changes.emplace_back(static_cast<int>(component), level);
+    }
+
+    for (auto& [component, level] : changes) {
+        if (component < 0) setLevel(level);
+        else setComponentLevel(static_cast<LogComponent>(component), level);
+    }
+    return true;
+}
+
+uint32_t Logger::registerFormat(LogLevel level, LogComponent component, const char* format, const char* file, int line) {
+    logfmt::FormatInfo info;
+    info.level = level;
+    info.component = component;
+    info.format = format;
+    const char* slash = std::strrchr(file, '/');
+    info.file = slash ? slash + 1 : file;
+    info.line = static_cast<uint32_t>(line);
+
+    std::lock_guard<std::mutex> lock(formatsMutex);
+    formats.push_back(std::move(info));
+    return static_cast<uint32_t>(formats.size() - 1);
+}
+
 void Logger::log(const std::string& message) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    
-    // Obtener timestamp
-    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    char timeBuffer[20];
-    strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", localtime(&now));
-
-    logQueue.push("[" + std::string(timeBuffer) + "] " + message);
-    condition.notify_one();
+    write(kPlainFormat, message);
+}
+
+Logger::Ring& Logger::threadRing() {
+    thread_local ThreadRing local;
+    if (!local.ring) {
+        local.ring = std::make_shared<Ring>(roundUpPow2(ringCapacity.load(std::memory_order_relaxed)));
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(local.ring);
+    }
+    return *local.ring;
+}
+
+Logger::Slot Logger::acquireSlot() {
+    Ring& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+
+    while (head - ring.tail.load(std::memory_order_acquire) > ring.mask) {
+        // Sin consumidor no hay quién libere espacio: se descarta aunque la política sea Block.
+        if (policy.load(std::memory_order_relaxed) == OverflowPolicy::Drop || !running.load(std::memory_order_acquire)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return Slot{nullptr, nullptr};
+        }
+        if (consumerWaiting.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            condition.notify_one();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return Slot{&ring, &ring.slots[head & ring.mask]};
+}
+
+void Logger::publish(Slot slot) {
+    slot.ring->head.fetch_add(1, std::memory_order_seq_cst);
+
+    // Solo se toca el mutex si el consumidor está dormido.
+    if (consumerWaiting.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        condition.notify_one();
+    }
+}
+
+const char* Logger::fileFor(OutputFormat format) {
+    return format == OutputFormat::Binary ? "server_logs.bin" : "server_logs.txt";
+}
+
+// Solo se llama sin consumidor corriendo.
+void Logger::openOutput() {
+    if (logFd >= 0) return;
+    logFd = ::open(fileFor(output), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd < 0) {
+        std::cerr << "Error: No se pudo abrir el archivo de logs." << std::endl;
+        return;
+    }
+    struct stat st;
+    fileSize = fstat(logFd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+    fileOpenedAt = std::chrono::steady_clock::now();
+    if (output == OutputFormat::Binary) {
+        // Cada proceso empieza con su encabezado; los formatos se vuelven a escribir.
+        std::string header;
+        logfmt::encode_header(header, anchorWallNs, anchorSteadyNs);
+        writeAll(header);
+        formatsWritten = 0;
+    }
 }
 
 void Logger::startLogging() {
-    std::thread(&Logger::processLogs, this).detach();
+    std::lock_guard<std::mutex> lifecycle(lifecycleMutex);
+    if (running.load()) {
+        return;
+    }
+    openOutput();
+    startCompressor();
+    running.store(true);
+    consumer = std::thread(&Logger::processLogs, this);
 }
 
 void Logger::stopLogging() {
-    running = false;
-    condition.notify_one();
+    std::lock_guard<std::mutex> lifecycle(lifecycleMutex);
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        condition.notify_one();
+    }
+    consumer.join();
+    stopCompressor();
+}
+
+void Logger::setOutputFormat(OutputFormat format) {
+    bool wasRunning = running.load();
+    stopLogging();
+    {
+        std::lock_guard<std::mutex> lifecycle(lifecycleMutex);
+        if (format != output && logFd >= 0) {
+            ::close(logFd);
+            logFd = -1;
+        }
+        output = format;
+    }
+    if (wasRunning) startLogging();
+}
+
+void Logger::flush() {
+    std::vector<std::pair<std::shared_ptr<Ring>, uint64_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto& ring : rings) {
+            targets.emplace_back(ring, ring->head.load(std::memory_order_acquire));
+        }
+        condition.notify_one();
+    }
+    for (auto& [ring, head] : targets) {
+        while (ring->tail.load(std::memory_order_acquire) < head && running.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+void Logger::setOverflowPolicy(OverflowPolicy newPolicy) {
+    policy.store(newPolicy, std::memory_order_relaxed);
+}
+
+void Logger::setThreadBufferCapacity(size_t lines) {
+    ringCapacity.store(lines < 2 ? 2 : lines, std::memory_order_relaxed);
+}
+
+bool Logger::hasPending() {
+    for (auto& ring : rings) {
+        if (ring->head.load(std::memory_order_seq_cst) != ring->tail.load(std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::writeAll(const std::string& data) {
+    size_t written = 0;
+    while (logFd >= 0 && written < data.size()) {
+        ssize_t n = ::write(logFd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: No se pudo escribir en el archivo de logs: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        written += static_cast<size_t>(n);
+    }
+    fileSize += written;
+}
+
+// Trae los formatos registrados desde la última vez. Se llama después de
+// leer los head de los buffers, así que incluye todos los que usan esos
+// registros. En modo binario los nuevos se agregan a `preamble`.
+void Logger::refreshFormats(std::string& preamble) {
+    {
+        std::lock_guard<std::mutex> lock(formatsMutex);
+        for (size_t i = consumerFormats.size(); i < formats.size(); ++i) {
+            consumerFormats.push_back(formats[i]);
+        }
+    }
+    if (output == OutputFormat::Binary) {
+        for (; formatsWritten < consumerFormats.size(); ++formatsWritten) {
+            logfmt::encode_format(preamble, static_cast<uint32_t>(formatsWritten), consumerFormats[formatsWritten]);
+        }
+    }
+}
+
+void Logger::appendText(std::string_view record, std::string& out) {
+    thread_local std::vector<logfmt::Arg> args;
+    uint32_t id;
+    uint64_t steadyNs;
+    if (!logfmt::decode_entry(record, id, steadyNs, args) || id >= consumerFormats.size()) {
+        return;
+    }
+    const logfmt::FormatInfo& info = consumerFormats[id];
+
+    // El prefijo de fecha cambia una vez por segundo.
+    uint64_t wallNs = anchorWallNs + (steadyNs - anchorSteadyNs);
+    int64_t second = static_cast<int64_t>(wallNs / 1000000000ull);
+    if (second != cachedSecond) {
+        cachedPrefix.clear();
+        logfmt::append_timestamp(cachedPrefix, wallNs);
+        cachedSecond = second;
+    }
+    out += cachedPrefix;
+    logfmt::append_tag(out, info);
+    logfmt::format_message(info.format, args, out);
+    out.push_back('\n');
+}
+
+// Junta los registros pendientes de todos los buffers (hasta IOV_MAX por
+// lote) y luego libera los slots escritos. En modo binario los registros se
+// escriben tal cual con writev; en modo texto se formatean en un solo buffer.
+size_t Logger::drainOnce(std::vector<std::shared_ptr<Ring>>& snapshot) {
+    static constexpr size_t kMaxIov = IOV_MAX < 1024 ? IOV_MAX : 1024;
+    iovec iov[kMaxIov];
+    struct Taken { Ring* ring; uint64_t upTo; };
+    std::vector<Taken> taken;
+    std::string preamble;
+    std::string text;
+    size_t total = 0;
+
+    size_t next = 0;
+    while (next < snapshot.size()) {
+        // El primer iovec queda para los formatos nuevos.
+        size_t count = 1;
+        taken.clear();
+
+        for (; next < snapshot.size() && count < kMaxIov; ++next) {
+            Ring& ring = *snapshot[next];
+            uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            uint64_t upTo = tail;
+            for (; upTo < head && count < kMaxIov; ++upTo, ++count) {
+                const std::string& record = ring.slots[upTo & ring.mask];
+                iov[count].iov_base = const_cast<char*>(record.data());
+                iov[count].iov_len = record.size();
+            }
+            if (upTo != tail) taken.push_back(Taken{&ring, upTo});
+            if (upTo < head) break;  // sin iovecs libres: el resto de este buffer en el próximo lote
+        }
+        if (count == 1) break;
+
+        preamble.clear();
+        refreshFormats(preamble);
+
+        if (output == OutputFormat::Binary) {
+            iov[0].iov_base = const_cast<char*>(preamble.data());
+            iov[0].iov_len = preamble.size();
+
+            // writev puede escribir menos de lo pedido; se continúa desde donde quedó.
+            size_t first = preamble.empty() ? 1 : 0;
+            while (logFd >= 0 && first < count) {
+                ssize_t n = ::writev(logFd, iov + first, static_cast<int>(count - first));
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    std::cerr << "Error: No se pudo escribir en el archivo de logs: " << std::strerror(errno) << std::endl;
+                    break;
+                }
+                size_t written = static_cast<size_t>(n);
+                fileSize += written;
+                while (first < count && written >= iov[first].iov_len) {
+                    written -= iov[first].iov_len;
+                    ++first;
+                }
+                if (first < count) {
+                    iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+                    iov[first].iov_len -= written;
+                }
+            }
+        } else {
+            text.clear();
+            for (size_t i = 1; i < count; ++i) {
+                appendText(std::string_view(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len), text);
+            }
+            writeAll(text);
+        }
+
+        for (auto& t : taken) {
+            t.ring->tail.store(t.upTo, std::memory_order_release);
+        }
+        total += count - 1;
+    }
+    return total;
 }
 
 void Logger::processLogs() {
-    while (running) {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        condition.wait(lock, [this]() { return !logQueue.empty() || !running; });
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    std::string notice;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(ringsMutex);
+            // Se liberan los buffers de hilos terminados que ya quedaron vacíos.
+            for (size_t i = 0; i < rings.size();) {
+                Ring& ring = *rings[i];
+                if (ring.orphaned.load(std::memory_order_acquire) &&
+                    ring.tail.load(std::memory_order_relaxed) == ring.head.load(std::memory_order_acquire)) {
+                    rings[i] = rings.back();
+                    rings.pop_back();
+                } else {
+                    ++i;
+                }
+            }
 
-        while (!logQueue.empty()) {
-            logFile << logQueue.front() << std::endl;
-            logQueue.pop();
+            consumerWaiting.store(true, std::memory_order_seq_cst);
+            condition.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+                return hasPending() || rotateRequested.load(std::memory_order_relaxed) ||
+                       !running.load(std::memory_order_acquire);
+            });
+            consumerWaiting.store(false, std::memory_order_relaxed);
+            snapshot = rings;
         }
 
-        logFile.flush();
+        drainOnce(snapshot);
+
+        uint64_t drops = dropped.load(std::memory_order_relaxed);
+        if (drops != reportedDrops) {
+            std::string record;
+            logfmt::begin_entry(record, kDropFormat, steadyNanos());
+            logfmt::encode_arg(record, drops - reportedDrops);
+            logfmt::end_entry(record);
+            notice.clear();
+            refreshFormats(notice);
+            if (output == OutputFormat::Binary) {
+                notice += record;
+            } else {
+                appendText(record, notice);
+            }
+            writeAll(notice);
+            reportedDrops = drops;
+        }
+
+        maybeRotate();
+
+        if (!running.load(std::memory_order_acquire)) {
+            // Última pasada para lo que llegó mientras se escribía.
+            {
+                std::lock_guard<std::mutex> lock(ringsMutex);
+                snapshot = rings;
+            }
+            while (drainOnce(snapshot) > 0) {}
+            break;
+        }
+    }
+}
+
+void Logger::setRotation(size_t maxBytes, std::chrono::seconds maxAge, size_t keep) {
+    rotateBytes.store(maxBytes, std::memory_order_relaxed);
+    rotateAgeSeconds.store(maxAge.count(), std::memory_order_relaxed);
+    keepRotated.store(keep, std::memory_order_relaxed);
+}
+
+void Logger::rotate() {
+    rotateRequested.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    condition.notify_one();
+}
+
+// "server_logs-AAAAMMDD-HHMMSS-NNN.txt": se ordena por nombre igual que por fecha.
+std::string Logger::rotatedName() {
+    std::string current = fileFor(output);
+    size_t dot = current.rfind('.');
+    std::string base = current.substr(0, dot);
+    std::string extension = current.substr(dot);
+
+    std::time_t now = std::time(nullptr);
+    std::tm tm;
+    localtime_r(&now, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    if (lastRotatedStamp != stamp) {
+        lastRotatedStamp = stamp;
+        lastRotatedSeq = -1;
+    }
+    for (int n = lastRotatedSeq + 1;; n++) {
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "-%03d", n);
+        std::string name = base + "-" + stamp + suffix + extension;
+        struct stat st;
+        if (::stat(name.c_str(), &st) != 0 && ::stat((name + ".gz").c_str(), &st) != 0) {
+            lastRotatedSeq = n;
+            return name;
+        }
+    }
+}
+
+// Corre en el consumidor después de cada lote. Renombrar y reabrir es
+// barato; la compresión queda para el otro hilo.
+void Logger::maybeRotate() {
+    bool requested = rotateRequested.exchange(false, std::memory_order_relaxed);
+    if (logFd < 0 || fileSize == 0) return;
+
+    size_t maxBytes = rotateBytes.load(std::memory_order_relaxed);
+    int64_t maxAge = rotateAgeSeconds.load(std::memory_order_relaxed);
+    bool due = requested || (maxBytes > 0 && fileSize >= maxBytes) ||
+               (maxAge > 0 && std::chrono::steady_clock::now() - fileOpenedAt >= std::chrono::seconds(maxAge));
+    if (!due) return;
+
+    std::string rotated = rotatedName();
+    ::close(logFd);
+    logFd = -1;
+    if (::rename(fileFor(output), rotated.c_str()) != 0) {
+        std::cerr << "Error: No se pudo rotar el archivo de logs: " << std::strerror(errno) << std::endl;
+    } else {
+        std::lock_guard<std::mutex> lock(compressMutex);
+        compressQueue.push_back(rotated);
+        compressCondition.notify_one();
+    }
+    openOutput();
+}
+
+void Logger::startCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(compressMutex);
+        compressStop = false;
+
+        // Rotados que quedaron sin comprimir (por ejemplo, si el proceso terminó antes).
+        std::vector<std::string> pending;
+        if (DIR* dir = opendir(".")) {
+            while (dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                bool rotated = name.rfind("server_logs-", 0) == 0;
+                bool plain = name.size() > 4 && (name.compare(name.size() - 4, 4, ".txt") == 0 ||
+                                                 name.compare(name.size() - 4, 4, ".bin") == 0);
+                if (rotated && plain) pending.push_back(name);
+            }
+            closedir(dir);
+        }
+        std::sort(pending.begin(), pending.end());
+        for (auto& name : pending) {
+            if (std::find(compressQueue.begin(), compressQueue.end(), name) == compressQueue.end()) {
+                compressQueue.push_back(name);
+            }
+        }
+    }
+    compressor = std::thread(&Logger::compressLoop, this);
+}
+
+// Termina el archivo en curso; lo que quede en la cola se retoma al volver a iniciar.
+void Logger::stopCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(compressMutex);
+        compressStop = true;
+    }
+    compressCondition.notify_all();
+    if (compressor.joinable()) compressor.join();
+}
+
+void Logger::waitForCompression() {
+    std::unique_lock<std::mutex> lock(compressMutex);
+    compressCondition.wait(lock, [this]() {
+        return (compressQueue.empty() && !compressBusy) || compressStop;
+    });
+}
+
+void Logger::compressLoop() {
+    // Solo usa CPU que nadie más quiere; si no se puede, al menos nice 19.
+    sched_param param{};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+        setpriority(PRIO_PROCESS, 0, 19);
+    }
+
+    std::unique_lock<std::mutex> lock(compressMutex);
+    while (true) {
+        compressCondition.wait(lock, [this]() { return compressStop || !compressQueue.empty(); });
+        if (compressStop) break;
+
+        std::string path = compressQueue.front();
+        compressQueue.pop_front();
+        compressBusy = true;
+        lock.unlock();
+
+        compressFile(path);
+        pruneRotated(path.substr(path.rfind('.')));
+
+        lock.lock();
+        compressBusy = false;
+        compressCondition.notify_all();
+    }
+    compressBusy = false;
+    compressCondition.notify_all();
+}
+
+// path -> path.gz, escribiendo primero a .gz.tmp para no dejar un .gz a medias.
+void Logger::compressFile(const std::string& path) {
+    int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        std::cerr << "Error: No se pudo abrir " << path << " para comprimir: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    std::string target = path + ".gz";
+    std::string tmp = target + ".tmp";
+    gzFile out = gzopen(tmp.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Error: No se pudo crear " << tmp << std::endl;
+        ::close(in);
+        return;
+    }
+
+    std::vector<char> buffer(1 << 16);
+    bool ok = true;
+    while (true) {
+        ssize_t n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        if (gzwrite(out, buffer.data(), static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    ::close(in);
+    ok = gzclose(out) == Z_OK && ok;
+
+    if (!ok || ::rename(tmp.c_str(), target.c_str()) != 0) {
+        std::cerr << "Error: No se pudo comprimir " << path << std::endl;
+        ::unlink(tmp.c_str());
+        return;
+    }
+    ::unlink(path.c_str());
+}
+
+// Borra los comprimidos más viejos con la misma extensión (.txt o .bin).
+void Logger::pruneRotated(const std::string& extension) {
+    size_t keep = keepRotated.load(std::memory_order_relaxed);
+    if (keep == 0) return;
+
+    std::string suffix = extension + ".gz";
+    std::vector<std::string> compressed;
+    if (DIR* dir = opendir(".")) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.rfind("server_logs-", 0) == 0 && name.size() > suffix.size() &&
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                compressed.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+    if (compressed.size() <= keep) return;
+    std::sort(compressed.begin(), compressed.end());
+    for (size_t i = 0; i + keep < compressed.size(); i++) {
+        ::unlink(compressed[i].c_str());
     }
 }
@@ -0,0 +1,404 @@
+#include "../include/message_log.h"
+#include "../include/logger.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t kHeaderSize = 8;
+// Un registro válido nunca se acerca a esto (nombres y texto de 255 bytes como máximo).
+static constexpr uint32_t kMaxRecord = 4096;
+// Espera antes de reintentar un lote que no se pudo escribir.
+static constexpr std::chrono::milliseconds kRetryDelay(100);
+
+uint32_t MessageLog::crc32(const void* data, size_t size)
+{
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void put_u32(std::string& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static std::string segment_path(const std::string& dir, uint32_t index)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08u.wal", index);
+    return dir + "/" + name;
+}
+
+static std::vector<uint32_t> list_segments(const std::string& dir)
+{
+    std::vector<uint32_t> segments;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return segments;
+    while (dirent* e = readdir(d))
+    {
+        unsigned index = 0;
+        char tail = 0;
+        if (std::strlen(e->d_name) == 12 && std::sscanf(e->d_name, "%8u.wa%c", &index, &tail) == 2 && tail == 'l')
+        {
+            segments.push_back(index);
+        }
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+MessageLog::~MessageLog()
+{
+    close();
+}
+
+size_t MessageLog::open(const std::string& dir, const ReplayFn& replay, const Options& options)
+{
+    close();
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec)
+    {
+        throw std::runtime_error("MessageLog: no se pudo crear " + dir + ": " + ec.message());
+    }
+    dir_ = dir;
+    options_ = options;
+
+    size_t replayed = 0;
+    std::vector<uint32_t> segments = list_segments(dir_);
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        replayed += replay_segment(segment_path(dir_, segments[i]), i + 1 == segments.size(), replay);
+    }
+
+    open_segment(segments.empty() ? 1 : segments.back());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = false;
+        pending_.clear();
+        next_seq_ = 1;
+        pending_last_seq_ = 0;
+    }
+    durable_seq_.store(0, std::memory_order_release);
+    commit_thread_ = std::thread(&MessageLog::commit_loop, this);
+    open_.store(true, std::memory_order_release);
+
+    LOG_INFO(Storage, "MessageLog: {} mensajes recuperados de {} segmentos en {}", replayed, segments.size(), dir_);
+    return replayed;
+}
+
+size_t MessageLog::replay_segment(const std::string& path, bool last, const ReplayFn& replay)
+{
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        throw std::runtime_error("MessageLog: no se pudo abrir " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        ::close(fd);
+        throw std::runtime_error("MessageLog: mmap falló en " + path + ": " + std::strerror(errno));
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const auto* base = static_cast<const unsigned char*>(map);
+    size_t offset = 0;
+    size_t records = 0;
+    while (offset + kHeaderSize <= size)
+    {
+        uint32_t len = get_u32(base + offset);
+        uint32_t crc = get_u32(base + offset + 4);
+        if (len < 4 || len > kMaxRecord || offset + kHeaderSize + len > size) break;
+        const unsigned char* p = base + offset + kHeaderSize;
+        if (crc32(p, len) != crc) break;
+
+        // [tipo][len autor][autor][len destinatario][destinatario][len texto][texto]
+        const unsigned char* end = p + len;
+        LogRecord record;
+        record.kind = static_cast<LogRecord::Kind>(*p++);
+        auto field = [&](std::string_view& out) {
+            if (p >= end || p + 1 + *p > end) return false;
+            out = std::string_view(reinterpret_cast<const char*>(p + 1), *p);
+            p += 1 + *p;
+            return true;
+        };
+        if (!field(record.author) || !field(record.recipient) || !field(record.text) || p != end) break;
+
+        if (replay) replay(record);
+        ++records;
+        offset += kHeaderSize + len;
+    }
+    munmap(map, size);
+
+    if (offset != size)
+    {
+        if (last)
+        {
+            // Cola de una escritura interrumpida: se corta para seguir agregando detrás.
+            LOG_WARN(Storage, "MessageLog: descartando {} bytes incompletos al final de {}", size - offset, path);
+            if (ftruncate(fd, static_cast<off_t>(offset)) != 0)
+            {
+                LOG_ERROR(Storage, "MessageLog: ftruncate falló en {}: {}", path, std::strerror(errno));
+            }
+        }
+        else
+        {
+            LOG_WARN(Storage, "MessageLog: registro corrupto en {} (offset {}), se ignora el resto del segmento", path, offset);
+        }
+    }
+    ::close(fd);
+    return records;
+}
+
+void MessageLog::open_segment(uint32_t index)
+{
+    if (fd_ >= 0)
+    {
+        fdatasync(fd_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    std::string path = segment_path(dir_, index);
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("MessageLog: no se pudo abrir " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    segment_size_ = fstat(fd_, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+    segment_index_ = index;
+
+    // La entrada del directorio también debe ser durable.
+    int dir_fd = ::open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+void MessageLog::close()
+{
+    if (!open_.exchange(false, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    commit_thread_.join();
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+uint64_t MessageLog::append_general(std::string_view author, std::string_view text)
+{
+    return append(LogRecord::Kind::General, author, "", text);
+}
+
+uint64_t MessageLog::append_private(std::string_view author, std::string_view recipient, std::string_view text)
+{
+    return append(LogRecord::Kind::Private, author, recipient, text);
+}
+
+uint64_t MessageLog::append(LogRecord::Kind kind, std::string_view author, std::string_view recipient, std::string_view text)
+{
+    if (!is_open()) return 0;
+
+    auto clamp = [](std::string_view s) { return std::min<size_t>(s.size(), 255); };
+    uint32_t len = static_cast<uint32_t>(4 + clamp(author) + clamp(recipient) + clamp(text));
+    char payload[4 + 3 * 255];
+    char* p = payload;
+    *p++ = static_cast<char>(kind);
+    for (std::string_view s : {author, recipient, text})
+    {
+        size_t n = clamp(s);
+        *p++ = static_cast<char>(n);
+        std::memcpy(p, s.data(), n);
+        p += n;
+    }
+    uint32_t crc = crc32(payload, len);
+
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        put_u32(pending_, len);
+        put_u32(pending_, crc);
+        pending_.append(payload, len);
+        seq = next_seq_++;
+        pending_last_seq_ = seq;
+    }
+    work_cv_.notify_one();
+    return seq;
+}
+
+bool MessageLog::flush(uint64_t seq)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (durable_seq_.load(std::memory_order_acquire) >= seq) return true;
+    if (seq >= next_seq_) return false;
+    ++flush_waiters_;
+    work_cv_.notify_one();
+    uint64_t failures = write_errors_.load(std::memory_order_relaxed);
+    durable_cv_.wait(lock, [&] {
+        return durable_seq_.load(std::memory_order_acquire) >= seq || stop_ ||
+               write_errors_.load(std::memory_order_relaxed) != failures;
+    });
+    --flush_waiters_;
+    return durable_seq_.load(std::memory_order_acquire) >= seq;
+}
+
+void MessageLog::commit_loop()
+{
+    std::string batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        work_cv_.wait(lock, [&] { return stop_ || !pending_.empty(); });
+        if (pending_.empty() && stop_) break;
+
+        // Ventana de group commit: se juntan más registros salvo que alguien espere.
+        if (!stop_ && flush_waiters_ == 0 && options_.commit_window.count() > 0)
+        {
+            work_cv_.wait_for(lock, options_.commit_window, [&] { return stop_ || flush_waiters_ > 0; });
+        }
+
+        batch.swap(pending_);
+        uint64_t last_seq = pending_last_seq_;
+        lock.unlock();
+
+        bool ok = write_batch(batch);
+
+        lock.lock();
+        if (ok)
+        {
+            durable_seq_.store(last_seq, std::memory_order_release);
+            batch.clear();
+            durable_cv_.notify_all();
+            continue;
+        }
+
+        // El lote no llegó a disco: durable_seq_ no avanza y quien espera en
+        // flush() recibe false. Se reintenta delante de lo nuevo, en orden.
+        write_errors_.fetch_add(1, std::memory_order_relaxed);
+        durable_cv_.notify_all();
+        if (stop_)
+        {
+            LOG_ERROR(Storage, "MessageLog: se descartan {} bytes sin escribir al cerrar", batch.size() + pending_.size());
+            pending_.clear();
+            batch.clear();
+            break;
+        }
+        pending_.insert(0, batch);
+        batch.clear();
+        work_cv_.wait_for(lock, kRetryDelay, [&] { return stop_; });
+    }
+    durable_cv_.notify_all();
+}
+
+bool MessageLog::write_batch(const std::string& batch)
+{
+    // fd_ < 0 si falló la rotación anterior: se vuelve a intentar.
+    if (fd_ < 0 || (segment_size_ > 0 && segment_size_ + batch.size() > options_.segment_bytes))
+    {
+        try
+        {
+            open_segment(segment_index_ + 1);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR(Storage, "{}", e.what());
+            return false;
+        }
+    }
+
+    size_t written = 0;
+    while (written < batch.size())
+    {
+        ssize_t n = ::write(fd_, batch.data() + written, batch.size() - written);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            LOG_ERROR(Storage, "MessageLog: error al escribir: {}", std::strerror(errno));
+            discard_tail(written);
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    if (fdatasync(fd_) != 0)
+    {
+        LOG_ERROR(Storage, "MessageLog: fdatasync falló: {}", std::strerror(errno));
+        discard_tail(written);
+        return false;
+    }
+    segment_size_ += written;
+    syncs_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Deja el segmento como estaba antes del lote fallido, para que el reintento
+// no quede detrás de un registro a medias (al abrir, el replay se cortaría
+// ahí). Si no se puede truncar, se sigue en un segmento nuevo: el registro
+// roto queda al final de un segmento que ya no es el último.
+void MessageLog::discard_tail(size_t written)
+{
+    if (written == 0) return;
+    if (ftruncate(fd_, static_cast<off_t>(segment_size_)) == 0) return;
+    LOG_ERROR(Storage, "MessageLog: ftruncate falló: {}", std::strerror(errno));
+    try
+    {
+        open_segment(segment_index_ + 1);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR(Storage, "{}", e.what());
+    }
+}
@@ -0,0 +1,105 @@
+#include "../include/offline_mailbox.h"
+#include "../include/protocol.h"
+#include <algorithm>
+
+OfflineMailboxes::OfflineMailboxes() : OfflineMailboxes(Limits()) {}
+
+OfflineMailboxes::OfflineMailboxes(const Limits& limits)
+{
+    set_limits(limits);
+}
+
+void OfflineMailboxes::set_limits(const Limits& limits)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    limits_ = limits;
+    // La cantidad del opcode 63 es un u8.
+    limits_.max_messages = std::min<size_t>(limits_.max_messages, 255);
+}
+
+OfflineMailboxes::Limits OfflineMailboxes::limits() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limits_;
+}
+
+void OfflineMailboxes::expire(Mailbox& box, Clock::time_point now)
+{
+    while (!box.entries.empty() && now - box.entries.front().queued >= limits_.ttl)
+    {
+        box.bytes -= box.entries.front().record.size();
+        total_bytes_ -= box.entries.front().record.size();
+        box.entries.pop_front();
+    }
+}
+
+bool OfflineMailboxes::push(uint32_t recipient, std::string_view sender, std::string_view text, Clock::time_point now)
+{
+    std::string record;
+    proto::HistoryEntry::append(record, sender, text);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Mailbox& box = boxes_[recipient];
+    expire(box, now);
+    if (box.entries.size() >= limits_.max_messages ||
+        box.bytes + record.size() > limits_.max_bytes ||
+        total_bytes_ + record.size() > limits_.max_total_bytes)
+    {
+        if (box.entries.empty()) boxes_.erase(recipient);
+        return false;
+    }
+    box.bytes += record.size();
+    total_bytes_ += record.size();
+    box.entries.push_back(Entry{now, std::move(record)});
+    return true;
+}
+
+std::string OfflineMailboxes::take(uint32_t recipient, Clock::time_point now)
+{
+    Mailbox box;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = boxes_.find(recipient);
+        if (it == boxes_.end()) return {};
+        expire(it->second, now);
+        total_bytes_ -= it->second.bytes;
+        box = std::move(it->second);
+        boxes_.erase(it);
+    }
+    if (box.entries.empty()) return {};
+
+    std::string payload;
+    payload.reserve(proto::OfflineMessages::size(0) + box.bytes);
+    proto::OfflineMessages::append(payload, static_cast<uint8_t>(box.entries.size()));
+    for (const Entry& entry : box.entries) payload += entry.record;
+    return payload;
+}
+
+void OfflineMailboxes::drop(uint32_t recipient)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = boxes_.find(recipient);
+    if (it == boxes_.end()) return;
+    total_bytes_ -= it->second.bytes;
+    boxes_.erase(it);
+}
+
+size_t OfflineMailboxes::size(uint32_t recipient) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = boxes_.find(recipient);
+    return it == boxes_.end() ? 0 : it->second.entries.size();
+}
+
+size_t OfflineMailboxes::total_bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_bytes_;
+}
+
+void OfflineMailboxes::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    boxes_.clear();
+    total_bytes_ = 0;
+}
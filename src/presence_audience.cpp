@@ -0,0 +1,60 @@
+#include "../include/presence_audience.h"
+
+void PresenceAudience::place(std::vector<uint32_t>& list, uint32_t Entry::*pos, uint32_t user, bool member)
+{
+    Entry& e = entries_[user];
+    if (member == (e.*pos != kNone)) return;
+    if (member)
+    {
+        e.*pos = static_cast<uint32_t>(list.size());
+        list.push_back(user);
+        return;
+    }
+    uint32_t last = list.back();
+    list[e.*pos] = last;
+    entries_[last].*pos = e.*pos;
+    list.pop_back();
+    e.*pos = kNone;
+}
+
+void PresenceAudience::update(uint32_t user, Connection* conn, bool batched, bool subscriber)
+{
+    if (user == 0) return;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (user >= entries_.size())
+    {
+        if (!conn) return;
+        entries_.resize(size_t(user) + 1);
+    }
+    Entry& e = entries_[user];
+    e.conn = conn;
+    e.batched = batched;
+    e.subscriber = subscriber;
+    place(global_, &Entry::global_pos, user, conn && !batched && !subscriber);
+    place(batched_, &Entry::batched_pos, user, conn && batched);
+}
+
+void PresenceAudience::remove(uint32_t user)
+{
+    update(user, nullptr, false, false);
+}
+
+void PresenceAudience::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    entries_.clear();
+    global_.clear();
+    batched_.clear();
+}
+
+size_t PresenceAudience::global_size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return global_.size();
+}
+
+size_t PresenceAudience::batched_size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return batched_.size();
+}
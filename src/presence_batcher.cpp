@@ -0,0 +1,91 @@
+#include "../include/presence_batcher.h"
+#include "../include/protocol.h"
+
+void PresenceBatcher::record(const std::string& username, uint8_t status)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(username);
+    if (it != index_.end())
+    {
+        pending_[it->second].status = status;
+        ++collapsed_;
+        return;
+    }
+    auto last = last_sent_.find(username);
+    uint8_t origin = last != last_sent_.end() ? last->second : kUnknown;
+    index_.emplace(username, pending_.size());
+    pending_.push_back(Pending{username, origin, status});
+    if (pending_.size() == 1) pending_cv_.notify_one();
+}
+
+std::vector<PresenceBatcher::Change> PresenceBatcher::drain_changes()
+{
+    std::vector<Pending> batch;
+    std::vector<Change> changes;
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch.swap(pending_);
+    index_.clear();
+    changes.reserve(batch.size());
+    for (Pending& p : batch)
+    {
+        if (p.status == p.origin)
+        {
+            ++collapsed_;
+            continue;
+        }
+        last_sent_[p.username] = p.status;
+        changes.push_back(Change{std::move(p.username), p.status});
+    }
+    return changes;
+}
+
+std::vector<std::string> PresenceBatcher::encode(const std::vector<Change>& changes)
+{
+    std::vector<std::string> payloads;
+    for (const Change& c : changes)
+    {
+        // La cantidad es un u8: a partir de 255 entradas se abre otro frame.
+        if (payloads.empty() || static_cast<uint8_t>(payloads.back()[1]) == 255)
+        {
+            payloads.emplace_back();
+            proto::PresenceBatch::append(payloads.back(), 0);
+        }
+        std::string& payload = payloads.back();
+        proto::UserEntry::write(payload, c.username, c.status);
+        payload[1] = static_cast<char>(static_cast<uint8_t>(payload[1]) + 1);
+    }
+    return payloads;
+}
+
+void PresenceBatcher::wait_pending()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_cv_.wait(lock, [this] { return !pending_.empty(); });
+}
+
+void PresenceBatcher::forget(const std::string& username)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_sent_.erase(username);
+}
+
+void PresenceBatcher::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.clear();
+    index_.clear();
+    last_sent_.clear();
+    collapsed_ = 0;
+}
+
+size_t PresenceBatcher::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+size_t PresenceBatcher::collapsed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return collapsed_;
+}
@@ -0,0 +1,97 @@
+#include "../include/presence_subscriptions.h"
+#include <algorithm>
+#include <mutex>
+
+static bool insert_sorted(std::vector<uint32_t>& v, uint32_t id)
+{
+    auto it = std::lower_bound(v.begin(), v.end(), id);
+    if (it != v.end() && *it == id) return false;
+    v.insert(it, id);
+    return true;
+}
+
+static bool erase_sorted(std::vector<uint32_t>& v, uint32_t id)
+{
+    auto it = std::lower_bound(v.begin(), v.end(), id);
+    if (it == v.end() || *it != id) return false;
+    v.erase(it);
+    return true;
+}
+
+bool PresenceSubscriptions::subscribe(uint32_t subscriber, uint32_t target)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t needed = size_t(std::max(subscriber, target)) + 1;
+    if (needed > followers_.size())
+    {
+        followers_.resize(needed);
+        following_.resize(needed);
+        subscriber_.resize(needed);
+    }
+    subscriber_[subscriber] = true;
+    if (!insert_sorted(following_[subscriber], target)) return false;
+    insert_sorted(followers_[target], subscriber);
+    ++edges_;
+    return true;
+}
+
+bool PresenceSubscriptions::unsubscribe(uint32_t subscriber, uint32_t target)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (subscriber >= following_.size() || target >= followers_.size()) return false;
+    // Cancelar también deja al usuario en modo suscripción, aunque quede sin contactos.
+    subscriber_[subscriber] = true;
+    if (!erase_sorted(following_[subscriber], target)) return false;
+    erase_sorted(followers_[target], subscriber);
+    --edges_;
+    return true;
+}
+
+void PresenceSubscriptions::remove_subscriber(uint32_t subscriber)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (subscriber >= following_.size()) return;
+    for (uint32_t target : following_[subscriber])
+    {
+        erase_sorted(followers_[target], subscriber);
+        --edges_;
+    }
+    std::vector<uint32_t>().swap(following_[subscriber]);
+    subscriber_[subscriber] = false;
+}
+
+bool PresenceSubscriptions::is_subscriber(uint32_t subscriber) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return subscriber < subscriber_.size() && subscriber_[subscriber];
+}
+
+bool PresenceSubscriptions::subscribed(uint32_t subscriber, uint32_t target) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (subscriber >= following_.size()) return false;
+    const auto& targets = following_[subscriber];
+    return std::binary_search(targets.begin(), targets.end(), target);
+}
+
+void PresenceSubscriptions::subscribers_of(uint32_t target, std::vector<uint32_t>& out) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (target >= followers_.size()) return;
+    out.insert(out.end(), followers_[target].begin(), followers_[target].end());
+}
+
+size_t PresenceSubscriptions::edges() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return edges_;
+}
+
+void PresenceSubscriptions::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    followers_.clear();
+    following_.clear();
+    subscriber_.clear();
+    edges_ = 0;
+}
@@ -0,0 +1,143 @@
+#include "../include/room_registry.h"
+#include <algorithm>
+#include <mutex>
+
+std::vector<RoomRegistry::Member>::iterator RoomRegistry::lower_bound(std::vector<Member>& members, uint32_t user)
+{
+    return std::lower_bound(members.begin(), members.end(), user,
+                            [](const Member& m, uint32_t u) { return m.user < u; });
+}
+
+const RoomRegistry::Room* RoomRegistry::get(uint32_t room) const
+{
+    // Las salas no se borran (salvo clear()), así que el puntero sigue
+    // siendo válido al soltar el lock.
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (room == 0 || room > rooms_.size()) return nullptr;
+    return rooms_[room - 1].get();
+}
+
+bool RoomRegistry::insert_member(Room& room, uint32_t user, Connection* conn)
+{
+    std::unique_lock<std::shared_mutex> lock(room.mutex);
+    auto it = lower_bound(room.members, user);
+    if (it != room.members.end() && it->user == user)
+    {
+        it->conn = conn;
+        return false;
+    }
+    room.members.insert(it, Member{user, conn});
+    return true;
+}
+
+bool RoomRegistry::erase_member(Room& room, uint32_t user)
+{
+    std::unique_lock<std::shared_mutex> lock(room.mutex);
+    auto it = lower_bound(room.members, user);
+    if (it == room.members.end() || it->user != user) return false;
+    room.members.erase(it);
+    return true;
+}
+
+uint32_t RoomRegistry::create(std::string_view name, uint32_t creator, Connection* conn)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (rooms_.size() >= kMaxRooms) return 0;
+    std::string key(name);
+    if (ids_.count(key)) return 0;
+    rooms_.push_back(std::make_unique<Room>());
+    uint32_t id = static_cast<uint32_t>(rooms_.size());
+    Room& room = *rooms_.back();
+    room.name = key;
+    ids_.emplace(std::move(key), id);
+    room.members.push_back(Member{creator, conn});
+    if (creator >= rooms_of_.size()) rooms_of_.resize(size_t(creator) + 1);
+    rooms_of_[creator].push_back(id);
+    return id;
+}
+
+uint32_t RoomRegistry::find(std::string_view name) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(std::string(name));
+    return it == ids_.end() ? 0 : it->second;
+}
+
+std::string RoomRegistry::name(uint32_t room) const
+{
+    const Room* r = get(room);
+    return r ? r->name : std::string();
+}
+
+bool RoomRegistry::join(uint32_t room, uint32_t user, Connection* conn)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (room == 0 || room > rooms_.size()) return false;
+    if (!insert_member(*rooms_[room - 1], user, conn)) return false;
+    if (user >= rooms_of_.size()) rooms_of_.resize(size_t(user) + 1);
+    rooms_of_[user].push_back(room);
+    return true;
+}
+
+bool RoomRegistry::leave(uint32_t room, uint32_t user)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (room == 0 || room > rooms_.size()) return false;
+    if (!erase_member(*rooms_[room - 1], user)) return false;
+    auto& mine = rooms_of_[user];
+    mine.erase(std::find(mine.begin(), mine.end(), room));
+    return true;
+}
+
+bool RoomRegistry::is_member(uint32_t room, uint32_t user) const
+{
+    const Room* r = get(room);
+    if (!r) return false;
+    std::shared_lock<std::shared_mutex> lock(r->mutex);
+    auto it = std::lower_bound(r->members.begin(), r->members.end(), user,
+                               [](const Member& m, uint32_t u) { return m.user < u; });
+    return it != r->members.end() && it->user == user;
+}
+
+void RoomRegistry::attach(uint32_t user, Connection* conn)
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (user >= rooms_of_.size()) return;
+    for (uint32_t id : rooms_of_[user])
+    {
+        Room& room = *rooms_[id - 1];
+        std::unique_lock<std::shared_mutex> room_lock(room.mutex);
+        auto it = lower_bound(room.members, user);
+        if (it != room.members.end() && it->user == user) it->conn = conn;
+    }
+}
+
+void RoomRegistry::remove_user(uint32_t user)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (user >= rooms_of_.size()) return;
+    for (uint32_t id : rooms_of_[user]) erase_member(*rooms_[id - 1], user);
+    std::vector<uint32_t>().swap(rooms_of_[user]);
+}
+
+size_t RoomRegistry::member_count(uint32_t room) const
+{
+    const Room* r = get(room);
+    if (!r) return 0;
+    std::shared_lock<std::shared_mutex> lock(r->mutex);
+    return r->members.size();
+}
+
+size_t RoomRegistry::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return rooms_.size();
+}
+
+void RoomRegistry::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    ids_.clear();
+    rooms_.clear();
+    rooms_of_.clear();
+}
@@ -0,0 +1,196 @@
+#include "../include/search_index.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+    unsigned char lower(unsigned char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+
+    // Trigramas distintos del texto, en minúsculas y empacados en 24 bits.
+    void trigrams(std::string_view text, std::vector<uint32_t>& out)
+    {
+        out.clear();
+        if (text.size() < 3) return;
+        for (size_t i = 0; i + 2 < text.size(); ++i)
+        {
+            out.push_back(uint32_t(lower(text[i])) << 16 | uint32_t(lower(text[i + 1])) << 8 | lower(text[i + 2]));
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    using Postings = std::vector<uint32_t>;
+
+    // lower_bound de `id` en [begin, end) buscando hacia atrás desde `end` con
+    // saltos exponenciales: los candidatos consecutivos suelen estar cerca.
+    Postings::const_iterator gallop_back(Postings::const_iterator begin, Postings::const_iterator end, uint32_t id)
+    {
+        size_t step = 1;
+        auto hi = end;
+        while (static_cast<size_t>(hi - begin) > step && *(hi - step) >= id)
+        {
+            hi -= step;
+            step *= 2;
+        }
+        auto lo = static_cast<size_t>(hi - begin) > step ? hi - step : begin;
+        return std::lower_bound(lo, hi, id);
+    }
+
+    bool contains_ci(std::string_view text, std::string_view lowered_query)
+    {
+        auto it = std::search(text.begin(), text.end(), lowered_query.begin(), lowered_query.end(),
+                              [](char a, char b) { return lower(a) == static_cast<unsigned char>(b); });
+        return it != text.end();
+    }
+}
+
+struct SearchIndex::Segment {
+    struct Doc {
+        uint64_t conversation;
+        uint64_t seq;
+        uint32_t author;
+        uint32_t text_offset;
+        uint16_t text_len;
+    };
+
+    std::vector<Doc> docs;
+    std::string text;
+    // Listas de documentos por trigrama, en orden creciente de ID local.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+
+    std::string_view text_of(const Doc& d) const
+    {
+        return std::string_view(text.data() + d.text_offset, d.text_len);
+    }
+};
+
+SearchIndex::SearchIndex(size_t segment_docs, size_t max_segments)
+    : segment_docs_(segment_docs == 0 ? 1 : segment_docs),
+      max_segments_(max_segments == 0 ? 1 : max_segments)
+{
+}
+
+SearchIndex::~SearchIndex() = default;
+
+bool SearchIndex::visible_to(uint64_t conversation, uint32_t requester)
+{
+    if (conversation == kGeneral) return true;
+    if (requester == 0) return false;
+    return static_cast<uint32_t>(conversation >> 32) == requester ||
+           static_cast<uint32_t>(conversation) == requester;
+}
+
+void SearchIndex::add(uint64_t conversation, uint64_t seq, uint32_t author, std::string_view text)
+{
+    if (text.size() > UINT16_MAX) text = text.substr(0, UINT16_MAX);
+
+    // Los trigramas se calculan fuera del lock.
+    thread_local std::vector<uint32_t> grams;
+    trigrams(text, grams);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (segments_.empty() || segments_.back()->docs.size() >= segment_docs_)
+    {
+        if (segments_.size() >= max_segments_)
+        {
+            total_docs_ -= segments_.front()->docs.size();
+            segments_.pop_front();
+        }
+        segments_.push_back(std::make_unique<Segment>());
+        segments_.back()->docs.reserve(std::min<size_t>(segment_docs_, 1 << 16));
+    }
+
+    Segment& seg = *segments_.back();
+    uint32_t id = static_cast<uint32_t>(seg.docs.size());
+    seg.docs.push_back(Segment::Doc{conversation, seq, author, static_cast<uint32_t>(seg.text.size()), static_cast<uint16_t>(text.size())});
+    seg.text.append(text.data(), text.size());
+    for (uint32_t g : grams)
+    {
+        seg.postings[g].push_back(id);
+    }
+    ++total_docs_;
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::search(std::string_view query, uint32_t requester, size_t limit) const
+{
+    std::vector<Hit> hits;
+    if (query.size() < kMinQuery || limit == 0) return hits;
+
+    std::string lowered(query);
+    for (char& c : lowered) c = static_cast<char>(lower(c));
+    std::vector<uint32_t> grams;
+    trigrams(lowered, grams);
+
+    std::vector<const std::vector<uint32_t>*> lists;
+    std::vector<std::vector<uint32_t>::const_iterator> bounds;
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (auto seg_it = segments_.rbegin(); seg_it != segments_.rend() && hits.size() < limit; ++seg_it)
+    {
+        const Segment& seg = **seg_it;
+
+        lists.clear();
+        bool missing = false;
+        for (uint32_t g : grams)
+        {
+            auto it = seg.postings.find(g);
+            if (it == seg.postings.end())
+            {
+                missing = true;
+                break;
+            }
+            lists.push_back(&it->second);
+        }
+        if (missing) continue;
+
+        // Se recorre la lista más corta del más nuevo al más viejo y se busca
+        // cada candidato en las demás; como los candidatos bajan, cada búsqueda
+        // parte de donde terminó la anterior.
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+        bounds.clear();
+        for (auto* l : lists) bounds.push_back(l->end());
+
+        const auto& driver = *lists[0];
+        for (auto it = driver.rbegin(); it != driver.rend() && hits.size() < limit; ++it)
+        {
+            uint32_t id = *it;
+            bool all = true;
+            for (size_t i = 1; i < lists.size(); ++i)
+            {
+                auto pos = gallop_back(lists[i]->begin(), bounds[i], id);
+                bounds[i] = pos;
+                if (pos == lists[i]->end() || *pos != id)
+                {
+                    all = false;
+                    break;
+                }
+                bounds[i] = pos + 1;
+            }
+            if (!all) continue;
+
+            const Segment::Doc& doc = seg.docs[id];
+            if (!visible_to(doc.conversation, requester)) continue;
+            std::string_view text = seg.text_of(doc);
+            if (!contains_ci(text, lowered)) continue;
+            hits.push_back(Hit{doc.conversation, doc.seq, doc.author, std::string(text)});
+        }
+    }
+    return hits;
+}
+
+size_t SearchIndex::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return total_docs_;
+}
+
+void SearchIndex::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    segments_.clear();
+    total_docs_ = 0;
+}
@@ -1,12 +1,32 @@
 #include "../include/server.h"
 #include "../include/websocket_handler.h"
 #include "../include/logger.h"
+#include <cstdlib>
 
 void setup_routes(App& app)
 {
+    // LOG_FORMAT=binary escribe server_logs.bin (se lee con logdecode)
+    if (const char *format = std::getenv("LOG_FORMAT"); format && std::string(format) == "binary")
+    {
+        Logger::getInstance().setOutputFormat(Logger::OutputFormat::Binary);
+    }
     Logger::getInstance().startLogging();
+    // Niveles de log en tiempo de ejecución, p. ej. LOG_LEVEL=info,chat=debug
+    if (const char *spec = std::getenv("LOG_LEVEL"))
+    {
+        if (!Logger::getInstance().configure(spec))
+        {
+            LOG_WARN(Server, "LOG_LEVEL inválido, se ignora: {}", spec);
+        }
+    }
 
 
+    // Ventana de acumulación de la presencia en lotes, p. ej. PRESENCE_BATCH_MS=50
+    if (const char *window = std::getenv("PRESENCE_BATCH_MS"))
+    {
+        WebSocketHandler::set_presence_window(std::chrono::milliseconds(std::atoi(window)));
+    }
+
     CROW_WEBSOCKET_ROUTE(app, "/")
         .onaccept([](const crow::request &req, void **userdata)
                   {
@@ -18,12 +38,12 @@ void setup_routes(App& app)
                           return false;
                       }
 
-                      *userdata = new std::string(name);
+                      *userdata = new ConnectionSession{name, {}};
                       return true;
                   })
         .onopen([](crow::websocket::connection &conn)
                 {
-                    std::string username = *(static_cast<std::string *>(conn.userdata()));
+                    std::string username = static_cast<ConnectionSession *>(conn.userdata())->username;
                     WebSocketHandler::on_open(conn, username);
                 })
         .onmessage(WebSocketHandler::on_message)
@@ -33,7 +53,7 @@ void setup_routes(App& app)
 
                     if (conn.userdata())
                     {
-                        delete static_cast<std::string *>(conn.userdata());
+                        delete static_cast<ConnectionSession *>(conn.userdata());
                         conn.userdata(nullptr);
                     } });
                 
@@ -44,15 +64,22 @@ void start_server()
 {
     App app;
     setup_routes(app);
+
+    size_t restored = WebSocketHandler::restore_history("data/messages");
+    LOG_INFO(Storage, "Historial restaurado: {} mensajes", restored);
+    WebSocketHandler::load_snapshot("data/sessions.snap");
+    WebSocketHandler::start_snapshotter("data/sessions.snap", std::chrono::seconds(30));
     
     // Determinar número óptimo de hilos (usar hardware_concurrency o un valor específico)
     unsigned int num_threads = std::thread::hardware_concurrency();
     if (num_threads == 0) num_threads = 4; // Valor por defecto si no se puede determinar
     
-    Logger::getInstance().log("Iniciando servidor con " + std::to_string(num_threads) + " hilos");
+    LOG_INFO(Server, "Iniciando servidor con {} hilos", num_threads);
     
     app.bindaddr("0.0.0.0")
        .port(18080)
        .concurrency(num_threads)
        .run();
+
+    WebSocketHandler::save_snapshot("data/sessions.snap");
 }
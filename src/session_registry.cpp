@@ -0,0 +1,100 @@
+#include "../include/session_registry.h"
+#include <thread>
+#include <vector>
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+SessionRegistry::SessionRegistry(size_t shard_count)
+    : shard_count_(round_up_pow2(shard_count == 0 ? 1 : shard_count)),
+      shards_(new Shard[shard_count_])
+{
+}
+
+size_t SessionRegistry::default_shard_count()
+{
+    // Unos 4 shards por hilo de Crow deja la probabilidad de colisión baja
+    // sin desperdiciar memoria cuando hay pocos usuarios.
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 4;
+    size_t shards = static_cast<size_t>(threads) * 4;
+    return shards < 16 ? 16 : shards;
+}
+
+SessionRegistry::Handle SessionRegistry::handle_for(const std::string& username)
+{
+    Shard& shard = shard_for(username);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(username);
+    if (it == shard.sessions.end()) return {};
+    return Handle{&shard, &it->second};
+}
+
+void SessionRegistry::insert_or_assign(const std::string& username, const ConnectionData& data)
+{
+    Shard& shard = shard_for(username);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(username);
+    PresenceState presence = it != shard.sessions.end() ? PresenceState(it->second) : PresenceState();
+    shard.sessions.insert_or_assign(username, data);
+    user_list_.upsert(username, status_byte(data.status));
+    sync_presence(presence, data);
+}
+
+std::optional<ConnectionData> SessionRegistry::get(const std::string& username) const
+{
+    const Shard& shard = shard_for(username);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(username);
+    if (it == shard.sessions.end()) return std::nullopt;
+    return it->second;
+}
+
+bool SessionRegistry::contains(const std::string& username) const
+{
+    const Shard& shard = shard_for(username);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.sessions.find(username) != shard.sessions.end();
+}
+
+bool SessionRegistry::erase(const std::string& username)
+{
+    Shard& shard = shard_for(username);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(username);
+    if (it == shard.sessions.end()) return false;
+    audience_.remove(it->second.user_id);
+    shard.sessions.erase(it);
+    user_list_.remove(username);
+    return true;
+}
+
+size_t SessionRegistry::size() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < shard_count_; ++i)
+    {
+        std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+        total += shards_[i].sessions.size();
+    }
+    return total;
+}
+
+void SessionRegistry::clear()
+{
+    // Todos los shards a la vez (en orden, nadie más toma dos) para que el
+    // snapshot de la lista quede vacío junto con el registro.
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    locks.reserve(shard_count_);
+    for (size_t i = 0; i < shard_count_; ++i)
+    {
+        locks.emplace_back(shards_[i].mutex);
+        shards_[i].sessions.clear();
+    }
+    user_list_.clear();
+    audience_.clear();
+}
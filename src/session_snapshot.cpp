@@ -0,0 +1,111 @@
+#include "../include/session_snapshot.h"
+#include "../include/message_log.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char kMagic[4] = {'S', 'S', 'N', '1'};
+
+static void put_u32(std::string& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+static void put_i64(std::string& out, int64_t v)
+{
+    uint64_t u = static_cast<uint64_t>(v);
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((u >> (8 * i)) & 0xFF));
+}
+
+static void put_string_8(std::string& out, const std::string& s)
+{
+    size_t n = s.size() > 255 ? 255 : s.size();
+    out.push_back(static_cast<char>(n));
+    out.append(s, 0, n);
+}
+
+static bool sync_path(const std::string& path, int flags)
+{
+    int fd = ::open(path.c_str(), flags);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool SessionSnapshot::write(const std::string& path, const std::vector<SessionRecord>& records)
+{
+    std::string data(kMagic, sizeof(kMagic));
+    put_u32(data, static_cast<uint32_t>(records.size()));
+    for (const auto& r : records)
+    {
+        put_string_8(data, r.username);
+        put_string_8(data, r.uuid);
+        data.push_back(static_cast<char>(r.status));
+        put_string_8(data, r.ip_address);
+        put_i64(data, r.last_active_ms);
+    }
+    put_u32(data, MessageLog::crc32(data.data(), data.size()));
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.write(data.data(), static_cast<std::streamsize>(data.size()))) return false;
+    }
+    if (!sync_path(tmp, O_RDONLY)) return false;
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) return false;
+
+    size_t slash = path.find_last_of('/');
+    sync_path(slash == std::string::npos ? "." : path.substr(0, slash), O_RDONLY | O_DIRECTORY);
+    return true;
+}
+
+bool SessionSnapshot::load(const std::string& path, std::vector<SessionRecord>& records)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(kMagic) + 8 || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) return false;
+
+    const auto* base = reinterpret_cast<const unsigned char*>(data.data());
+    size_t end = data.size() - 4;
+    auto get_u32 = [&](size_t at) {
+        return uint32_t(base[at]) | uint32_t(base[at + 1]) << 8 | uint32_t(base[at + 2]) << 16 | uint32_t(base[at + 3]) << 24;
+    };
+    if (MessageLog::crc32(base, end) != get_u32(end)) return false;
+
+    size_t offset = sizeof(kMagic);
+    uint32_t count = get_u32(offset);
+    offset += 4;
+
+    auto string_8 = [&](std::string& out) {
+        if (offset >= end || offset + 1 + base[offset] > end) return false;
+        out.assign(data, offset + 1, base[offset]);
+        offset += 1 + base[offset];
+        return true;
+    };
+
+    std::vector<SessionRecord> loaded;
+    loaded.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        SessionRecord r;
+        if (!string_8(r.username) || !string_8(r.uuid) || offset >= end) return false;
+        uint8_t status = base[offset++];
+        if (status > static_cast<uint8_t>(UserStatus::INACTIVO)) return false;
+        r.status = static_cast<UserStatus>(status);
+        if (!string_8(r.ip_address) || offset + 8 > end) return false;
+        uint64_t u = 0;
+        for (int b = 0; b < 8; ++b) u |= uint64_t(base[offset + b]) << (8 * b);
+        r.last_active_ms = static_cast<int64_t>(u);
+        offset += 8;
+        loaded.push_back(std::move(r));
+    }
+    if (offset != end) return false;
+
+    records.swap(loaded);
+    return true;
+}
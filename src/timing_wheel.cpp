@@ -0,0 +1,165 @@
+#include "../include/timing_wheel.h"
+
+static constexpr uint64_t kReach = uint64_t(1) << (TimingWheel::kSlotBits * TimingWheel::kLevels);
+
+TimingWheel::TimingWheel(std::chrono::milliseconds tick, Clock::time_point start)
+    : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)), start_(start)
+{
+    heads_.fill(kNone);
+}
+
+uint64_t TimingWheel::to_tick(Clock::time_point tp) const
+{
+    if (tp <= start_) return 0;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(tp - start_).count();
+    return static_cast<uint64_t>(elapsed) / static_cast<uint64_t>(tick_.count());
+}
+
+void TimingWheel::schedule(uint32_t key, Clock::time_point deadline)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (key >= nodes_.size()) nodes_.resize(size_t(key) + 1);
+    Node& node = nodes_[key];
+    if (node.slot != kNoSlot)
+    {
+        unlink(key);
+    }
+    else
+    {
+        ++size_;
+    }
+    // Redondeo hacia arriba: el plazo nunca vence antes de tiempo.
+    uint64_t ticks = to_tick(deadline);
+    if (start_ + ticks * tick_ < deadline) ++ticks;
+    node.deadline = ticks;
+    link(key);
+}
+
+bool TimingWheel::cancel(uint32_t key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (key >= nodes_.size() || nodes_[key].slot == kNoSlot) return false;
+    unlink(key);
+    --size_;
+    return true;
+}
+
+bool TimingWheel::contains(uint32_t key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return key < nodes_.size() && nodes_[key].slot != kNoSlot;
+}
+
+size_t TimingWheel::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+void TimingWheel::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_.clear();
+    heads_.fill(kNone);
+    size_ = 0;
+}
+
+void TimingWheel::link(uint32_t key)
+{
+    Node& node = nodes_[key];
+    if (node.deadline < current_) node.deadline = current_;
+    uint64_t delta = node.deadline - current_;
+    if (delta >= kReach)
+    {
+        node.deadline = current_ + kReach - 1;
+        delta = kReach - 1;
+    }
+
+    size_t level = 0;
+    while (level + 1 < kLevels && delta >= (uint64_t(1) << (kSlotBits * (level + 1))))
+    {
+        ++level;
+    }
+    size_t slot = level * kSlots + ((node.deadline >> (kSlotBits * level)) & (kSlots - 1));
+
+    node.slot = static_cast<uint16_t>(slot);
+    node.prev = kNone;
+    node.next = heads_[slot];
+    if (node.next != kNone) nodes_[node.next].prev = key;
+    heads_[slot] = key;
+}
+
+void TimingWheel::unlink(uint32_t key)
+{
+    Node& node = nodes_[key];
+    if (node.prev != kNone)
+    {
+        nodes_[node.prev].next = node.next;
+    }
+    else
+    {
+        heads_[node.slot] = node.next;
+    }
+    if (node.next != kNone) nodes_[node.next].prev = node.prev;
+    node.prev = node.next = kNone;
+    node.slot = kNoSlot;
+}
+
+void TimingWheel::cascade(size_t level)
+{
+    size_t slot = level * kSlots + ((current_ >> (kSlotBits * level)) & (kSlots - 1));
+    uint32_t key = heads_[slot];
+    heads_[slot] = kNone;
+    while (key != kNone)
+    {
+        uint32_t next = nodes_[key].next;
+        link(key);
+        key = next;
+    }
+}
+
+size_t TimingWheel::advance(Clock::time_point now, std::vector<uint32_t>& expired)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t target = to_tick(now);
+    if (size_ == 0)
+    {
+        // Nada programado: se salta directo sin recorrer ranuras vacías.
+        if (target + 1 > current_) current_ = target + 1;
+        return 0;
+    }
+
+    size_t count = 0;
+    while (current_ <= target && size_ > 0)
+    {
+        // Al completar una vuelta de un nivel, su ranura siguiente baja un
+        // nivel. Se empieza por el nivel más alto que completó vuelta.
+        size_t top = 0;
+        while (top + 1 < kLevels && (current_ & ((uint64_t(1) << (kSlotBits * (top + 1))) - 1)) == 0)
+        {
+            ++top;
+        }
+        for (size_t level = top; level > 0; --level)
+        {
+            cascade(level);
+        }
+
+        size_t slot = current_ & (kSlots - 1);
+        uint32_t key = heads_[slot];
+        heads_[slot] = kNone;
+        while (key != kNone)
+        {
+            Node& node = nodes_[key];
+            uint32_t next = node.next;
+            node.prev = node.next = kNone;
+            node.slot = kNoSlot;
+            expired.push_back(key);
+            --size_;
+            ++count;
+            key = next;
+        }
+        ++current_;
+    }
+    if (target + 1 > current_) current_ = target + 1;
+    return count;
+}
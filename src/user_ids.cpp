@@ -0,0 +1,46 @@
+#include "../include/user_ids.h"
+#include <mutex>
+
+uint32_t UserIdTable::intern(std::string_view username)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(username);
+        if (it != ids_.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(username);
+    if (it != ids_.end()) return it->second;
+    // La llave apunta al nombre guardado, no a la vista recibida.
+    const std::string& stored = names_.emplace_back(username);
+    uint32_t id = static_cast<uint32_t>(names_.size());
+    ids_.emplace(stored, id);
+    return id;
+}
+
+uint32_t UserIdTable::find(std::string_view username) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(username);
+    return it == ids_.end() ? kInvalid : it->second;
+}
+
+std::string UserIdTable::name(uint32_t id) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (id == kInvalid || id > names_.size()) return {};
+    return names_[id - 1];
+}
+
+size_t UserIdTable::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_.size();
+}
+
+void UserIdTable::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    ids_.clear();
+    names_.clear();
+}
@@ -0,0 +1,113 @@
+#include "../include/user_list_snapshot.h"
+#include "../include/protocol.h"
+
+UserListSnapshot::UserListSnapshot()
+{
+    proto::UserList::append(payload_, 0);
+}
+
+void UserListSnapshot::patch_status(Entry& entry, uint8_t status)
+{
+    entry.status = status;
+    if (!stale_) payload_[entry.offset + proto::Str8::size(entry.username)] = static_cast<char>(status);
+    ++version_;
+}
+
+bool UserListSnapshot::upsert(const std::string& username, uint8_t status)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(username);
+    if (it != index_.end())
+    {
+        Entry& entry = entries_[it->second];
+        if (entry.status == status) return false;
+        patch_status(entry, status);
+        return true;
+    }
+
+    index_.emplace(username, entries_.size());
+    entries_.push_back(Entry{username, status, payload_.size()});
+    if (!stale_)
+    {
+        proto::UserEntry::append(payload_, username, status);
+        // La cantidad es un u8 en el cable; igual que antes, se trunca.
+        payload_[1] = static_cast<char>(entries_.size());
+    }
+    ++version_;
+    return true;
+}
+
+bool UserListSnapshot::set_status(const std::string& username, uint8_t status)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(username);
+    if (it == index_.end() || entries_[it->second].status == status) return false;
+    patch_status(entries_[it->second], status);
+    return true;
+}
+
+bool UserListSnapshot::remove(const std::string& username)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(username);
+    if (it == index_.end()) return false;
+    size_t pos = it->second;
+    index_.erase(it);
+    if (pos + 1 != entries_.size())
+    {
+        entries_[pos] = std::move(entries_.back());
+        index_[entries_[pos].username] = pos;
+    }
+    entries_.pop_back();
+    stale_ = true;
+    ++version_;
+    return true;
+}
+
+void UserListSnapshot::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.empty()) return;
+    entries_.clear();
+    index_.clear();
+    stale_ = true;
+    ++version_;
+}
+
+void UserListSnapshot::rebuild() const
+{
+    payload_.clear();
+    size_t total = proto::UserList::size(0);
+    for (const Entry& entry : entries_) total += proto::UserEntry::size(entry.username, entry.status);
+    payload_.reserve(total);
+    proto::UserList::append(payload_, static_cast<uint8_t>(entries_.size()));
+    for (Entry& entry : entries_)
+    {
+        entry.offset = payload_.size();
+        proto::UserEntry::write(payload_, entry.username, entry.status);
+    }
+    stale_ = false;
+}
+
+std::shared_ptr<const UserListSnapshot::View> UserListSnapshot::current() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!published_ || published_->version != version_)
+    {
+        if (stale_) rebuild();
+        published_ = std::make_shared<const View>(View{version_, payload_});
+    }
+    return published_;
+}
+
+uint64_t UserListSnapshot::version() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return version_;
+}
+
+size_t UserListSnapshot::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
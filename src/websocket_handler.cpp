@@ -1,25 +1,85 @@
 #include "../include/websocket_handler.h"
 #include "../include/logger.h"
 #include "../include/websocket_global.h"
+#include "../include/shared_frame.h"
+#include "../include/fanout_executor.h"
+#include "../include/session_snapshot.h"
+#include "../include/presence_batcher.h"
 #include <sstream>
 #include <iostream>
 #include <ctime>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <algorithm>
 
 bool testing_mode = false;
-std::unordered_map<std::string, ConnectionData> connections;
-std::mutex connections_mutex;
-std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> chat_history;
+SessionRegistry connections;
 std::unordered_map<std::string, UserStatus> last_user_status;
-std::vector<std::pair<std::string, std::string>> general_chat_history;
+std::mutex last_user_status_mutex;
+HistoryStore history_store;
+UserIdTable user_ids;
+MessageLog message_log;
+SearchIndex search_index;
+// Plazo de inactividad de cada sesión conectada, por ID de usuario. Se
+// reprograma con cada actividad; solo los plazos vencidos se revisan.
+TimingWheel inactivity_timers;
+// Plazo de retención de cada sesión desconectada (last_active + 5 min). La
+// reconexión lo cancela; la limpieza solo visita los vencidos.
+TimingWheel disconnect_timers(std::chrono::seconds(1));
+// Transiciones de presencia pendientes para los clientes que pidieron lotes
+// (opcode 8). Se entregan como 59 al cerrar cada ventana.
+PresenceBatcher presence_batcher;
+// Contactos de cada usuario (opcode 9). Quien se suscribió recibe presencia
+// solo de sus contactos; el resto, la de todos.
+PresenceSubscriptions presence_subscriptions;
+// Salas con nombre (opcodes 10-14); su historial vive en history_store.
+RoomRegistry rooms;
+// Mensajes privados para sesiones sin conexión, entregados como 63 al
+// reconectar. Se descartan al eliminar la sesión.
+OfflineMailboxes offline_mailboxes;
+static std::atomic<int> presence_window_ms{30};
+
+// Sesiones cargadas del snapshot cuyo usuario todavía no volvió a conectarse.
+// Conservan su UUID; el estado anterior queda en last_user_status. Vencen como
+// las desconectadas del registro: DISCONNECT_RETENTION después de su
+// last_active_ms. Protegido por last_user_status_mutex.
+static std::unordered_map<std::string, SessionRecord> restored_sessions;
 std::condition_variable inactivity_cv;
 std::mutex inactivity_mutex;
 bool user_marked_inactive = false;
 
+// Límites de la cola de salida de cada conexión. Por defecto se descartan
+// notificaciones de presencia y se desconecta solo si los mensajes no caben.
+static crow::websocket::outbound_limits connection_outbound_limits = {
+    4 * 1024 * 1024,
+    8192,
+    crow::websocket::overflow_policy::drop_presence,
+    crow::websocket::CloseStatusCode::PolicyViolated,
+};
+static std::mutex outbound_limits_mutex;
+
 // Constantes según el protocolo
 const uint8_t MAX_MESSAGE_LENGTH = 255;
 const char* GENERAL_CHAT = "~";
+const uint8_t DEFAULT_HISTORY_PAGE = 50;
+const uint8_t DEFAULT_SEARCH_RESULTS = 20;
+const std::chrono::seconds INACTIVITY_TIMEOUT(60);
+const std::chrono::minutes DISCONNECT_RETENTION(5);
+// Sesiones eliminadas por lote antes de ceder el CPU a los hilos de Crow.
+const size_t EVICTION_BATCH = 64;
+
+static int64_t wall_clock_ms()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Una sesión restaurada vence igual que una desconectada del registro.
+static bool restored_expired(const SessionRecord &r, int64_t wall_now_ms)
+{
+    return wall_now_ms - r.last_active_ms >= std::chrono::duration_cast<std::chrono::milliseconds>(DISCONNECT_RETENTION).count();
+}
 
 std::string generate_uuid()
 {
@@ -31,12 +91,9 @@ std::string generate_uuid()
 
 static void send_error(crow::websocket::connection &conn, uint8_t error_code)
 {
-    std::string payload;
-    payload.push_back((char)50);  // Código de ERROR (antes 0x50, ahora 50)
-    payload.push_back((char)error_code);
-    conn.send_binary(payload);
+    conn.send_binary(proto::Error::encode(error_code));
     
-    Logger::getInstance().log("Enviando error " + std::to_string(error_code) + " al cliente");
+    LOG_INFO(Server, "Enviando error {} al cliente", error_code);
 }
 
 static uint8_t userStatusToByte(UserStatus st)
@@ -55,186 +112,239 @@ static uint8_t userStatusToByte(UserStatus st)
     return 0;
 }
 
-uint8_t WebSocketHandler::read_uint8(const std::string &data, size_t &offset)
+// Enlaza la sesión de la conexión con su entrada del registro.
+static void bind_session(crow::websocket::connection &conn, const std::string &username, uint32_t user_id)
 {
-    if (offset >= data.size())
+    auto *session = static_cast<ConnectionSession *>(conn.userdata());
+    if (!session)
     {
-        throw std::runtime_error("read_uint8 out of range");
+        session = new ConnectionSession{username, {}};
+        conn.userdata(session);
     }
-    uint8_t val = static_cast<uint8_t>(data[offset]);
-    offset += 1;
-    return val;
+    session->username = username;
+    session->handle = connections.handle_for(username);
+    session->user_id = user_id;
 }
 
-std::string WebSocketHandler::read_string_8(const std::string &data, size_t &offset)
+// Sesión que on_open enlazó a la conexión. Una conexión sin sesión (rechazada
+// en on_open) o ya cerrada es un remitente desconocido: nunca se busca en el registro.
+static ConnectionSession *resolve_session(crow::websocket::connection &conn)
 {
-    uint8_t length = read_uint8(data, offset);
-    if (offset + length > data.size())
+    return static_cast<ConnectionSession *>(conn.userdata());
+}
+
+// ID del usuario dueño de la conexión, sin volver a buscar su nombre si ya
+// está en la sesión.
+static uint32_t session_user_id(crow::websocket::connection &conn, const std::string &username)
+{
+    auto *session = static_cast<ConnectionSession *>(conn.userdata());
+    if (session && session->user_id != UserIdTable::kInvalid && session->username == username)
     {
-        throw std::runtime_error("read_string_8 out of range");
+        return session->user_id;
     }
-    std::string s = data.substr(offset, length);
-    offset += length;
-    return s;
+    return user_ids.intern(username);
+}
+
+// Destinatarios de la presencia de `username` por evento (53/54): los
+// clientes sin suscripciones y los suscriptores de `username`, tomados del
+// índice del registro por ID, sin recorrer las sesiones. Los que pidieron
+// lotes la reciben en flush_presence.
+static std::vector<FanoutTarget> presence_targets(const std::string &username, bool include_self)
+{
+    const PresenceAudience &audience = connections.presence_audience();
+    uint32_t self = user_ids.find(username);
+    std::vector<FanoutTarget> targets;
+    targets.reserve(audience.global_size());
+    audience.for_each_global([&](uint32_t user, crow::websocket::connection &conn) {
+        if (include_self || user != self) targets.push_back(FanoutExecutor::target_for(conn));
+    });
+
+    static thread_local std::vector<uint32_t> followers;
+    followers.clear();
+    presence_subscriptions.subscribers_of(self, followers);
+    audience.for_each_of(followers, [&](uint32_t user, crow::websocket::connection &conn) {
+        if (include_self || user != self) targets.push_back(FanoutExecutor::target_for(conn));
+    });
+    return targets;
 }
 
 void WebSocketHandler::notify_user_joined(const std::string &username, UserStatus st)
 {   
+    presence_batcher.record(username, userStatusToByte(st));
     if (testing_mode) return;
-    Logger::getInstance().log("ENTRO A NOTIFY ");
-    std::lock_guard<std::mutex> lock(connections_mutex);
-    Logger::getInstance().log("Enviando 53 a todos excepto: " + username);
-
-    std::string payload;
-    payload.push_back((char)53);  // Usuario se acaba de registrar (antes 0x53, ahora 53)
-    payload.push_back((char)username.size());
-    payload += username;
-    payload.push_back((char)userStatusToByte(st));
-
-    for (auto &[uname, conn_data] : connections)
-    {
-        Logger::getInstance().log("¿Enviar a " + uname + "? conn=" + (conn_data.conn ? "sí" : "no"));
+    LOG_DEBUG(Presence, "Enviando 53 sobre el ingreso de: {}", username);
 
-        if (uname != username && conn_data.conn)
-        {
-            Logger::getInstance().log("Notificando a: " + uname + " sobre ingreso de " + username);
-            conn_data.conn->send_binary(payload);
-        }
-    }
+    SharedFrame frame(proto::UserJoined::encode(username, userStatusToByte(st)), crow::websocket::frame_class::presence);
+    std::vector<FanoutTarget> targets = presence_targets(username, false);
+    LOG_DEBUG(Presence, "Notificando ingreso de {} a {} clientes", username, targets.size());
+    FanoutExecutor::getInstance().deliver(frame, targets);
 }
 
 void WebSocketHandler::notify_user_status_change(const std::string &username, UserStatus st)
 {
-    std::lock_guard<std::mutex> lock(connections_mutex);
-    std::string payload;
-    payload.push_back((char)54);  // Usuario cambió estatus (antes 0x54, ahora 54)
-    payload.push_back((char)username.size());
-    payload += username;
-    payload.push_back((char)userStatusToByte(st));
+    SharedFrame frame(proto::StatusChanged::encode(username, userStatusToByte(st)), crow::websocket::frame_class::presence);
     
-    Logger::getInstance().log("Notificando cambio de estado de " + username + " a " + 
-                            std::to_string(userStatusToByte(st)));
+    LOG_INFO(Presence, "Notificando cambio de estado de {} a {}", username, userStatusToByte(st));
+    presence_batcher.record(username, userStatusToByte(st));
     
-    for (auto &[_, conn_data] : connections)
+    std::vector<FanoutTarget> targets = presence_targets(username, true);
+    LOG_DEBUG(Presence, "Enviando 54 a {} clientes", targets.size());
+    FanoutExecutor::getInstance().deliver(frame, targets);
+}
+
+size_t WebSocketHandler::flush_presence()
+{
+    std::vector<PresenceBatcher::Change> changes = presence_batcher.drain_changes();
+    if (changes.empty()) return 0;
+
+    // Los clientes sin suscripciones comparten los mismos frames; cada
+    // suscriptor recibe solo los cambios de sus contactos.
+    std::vector<FanoutTarget> targets;
+    std::vector<std::pair<uint32_t, FanoutTarget>> subscribers;
+    connections.presence_audience().for_each_batched([&](uint32_t user, bool subscriber, crow::websocket::connection &conn) {
+        if (subscriber)
+        {
+            subscribers.emplace_back(user, FanoutExecutor::target_for(conn));
+        }
+        else
+        {
+            targets.push_back(FanoutExecutor::target_for(conn));
+        }
+    });
+
+    size_t frames = 0;
+    auto deliver = [&](const std::vector<PresenceBatcher::Change> &batch, const std::vector<FanoutTarget> &to) {
+        for (const auto &payload : PresenceBatcher::encode(batch))
+        {
+            SharedFrame frame(payload, crow::websocket::frame_class::presence);
+            FanoutExecutor::getInstance().deliver(frame, to);
+            ++frames;
+        }
+    };
+    if (!targets.empty())
     {
-        if (conn_data.conn)
+        deliver(changes, targets);
+    }
+    if (!subscribers.empty())
+    {
+        std::vector<uint32_t> ids;
+        ids.reserve(changes.size());
+        for (const auto &change : changes) ids.push_back(user_ids.find(change.username));
+        std::vector<PresenceBatcher::Change> filtered;
+        for (const auto &[subscriber_id, target] : subscribers)
         {
-            Logger::getInstance().log("Enviando 54 a: " + conn_data.username);
-            conn_data.conn->send_binary(payload);
+            filtered.clear();
+            for (size_t i = 0; i < changes.size(); i++)
+            {
+                if (presence_subscriptions.subscribed(subscriber_id, ids[i])) filtered.push_back(changes[i]);
+            }
+            if (!filtered.empty()) deliver(filtered, {target});
         }
     }
+    LOG_DEBUG(Presence, "Enviados {} frame(s) 59 ({} cambios) a {} clientes", frames, changes.size(),
+              targets.size() + subscribers.size());
+    return frames;
 }
 
-void WebSocketHandler::notify_new_message(const std::string &sender, const std::string &msg, bool is_private, const std::string &recipient)
+void WebSocketHandler::start_presence_flusher()
 {
-    std::string payload;
-    payload.push_back((char)55);  // Código de Recibió mensaje (antes 0x55, ahora 55)
-    payload.push_back((char)sender.size());
-    payload += sender;
-    payload.push_back((char)msg.size());
-    payload += msg;
-
-    auto send_task = std::async(std::launch::async, [payload, is_private, sender, recipient]() {
-        Logger::getInstance().log("Iniciando envío desde un thread separado. Thread ID: " + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())));
-        if (is_private)
-        {
-            std::lock_guard<std::mutex> lock(connections_mutex);
-            auto itA = connections.find(sender);
-            auto itB = connections.find(recipient);
-            if (itA != connections.end() && itA->second.conn)
-            {
-                Logger::getInstance().log("Enviando 55 de " + sender + " a " + sender);
-                itA->second.conn->send_binary(payload);
-            }
-            if (itB != connections.end() && itB->second.conn)
-            {
-                Logger::getInstance().log("Enviando 55 de " + sender + " a " + recipient);
-                itB->second.conn->send_binary(payload);
-            }
+    std::thread([] {
+        while (true) {
+            // La ventana empieza con la primera transición pendiente.
+            presence_batcher.wait_pending();
+            std::this_thread::sleep_for(std::chrono::milliseconds(presence_window_ms.load()));
+            flush_presence();
         }
-        else
+    }).detach();
+}
+
+void WebSocketHandler::set_presence_window(std::chrono::milliseconds window)
+{
+    presence_window_ms = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(window.count(), 1, 1000));
+}
+
+std::chrono::milliseconds WebSocketHandler::get_presence_window()
+{
+    return std::chrono::milliseconds(presence_window_ms.load());
+}
+
+void WebSocketHandler::notify_new_message(std::string_view sender, std::string_view msg, bool is_private, std::vector<FanoutTarget> targets)
+{
+    SharedFrame frame(proto::NewMessage::encode(sender, msg));
+
+    // Solo se capturan los destinatarios bajo lock; la entrega la hacen los
+    // hilos de Crow dueños de cada socket. Un privado ya trae resueltos al
+    // remitente y al destinatario.
+    if (!is_private)
+    {
+        connections.for_each([&](const std::string &uname, const ConnectionData &cd)
         {
-            std::lock_guard<std::mutex> lock(connections_mutex);
-            for (auto &[uname, cd] : connections)
+            if (cd.conn)
             {
-                if (cd.conn)
-                {
-                    Logger::getInstance().log("Enviando 55 de " + sender + " a " + uname);
-                    cd.conn->send_binary(payload);
-                }
+                LOG_DEBUG(Chat, "Enviando 55 de {} a {}", sender, uname);
+                targets.push_back(FanoutExecutor::target_for(*cd.conn));
             }
-        }
-        Logger::getInstance().log("Envío completado desde el thread. Thread ID: " + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())));
-    });
-    send_task.wait();
+        });
+    }
+    FanoutExecutor::getInstance().deliver(frame, targets);
 }
 
-void WebSocketHandler::handle_list_users(crow::websocket::connection &conn)
+// Frame del opcode 51 ya codificado para la versión actual de la lista. Se
+// arma una vez por versión y todas las solicitudes siguientes encolan una
+// referencia a los mismos bytes.
+struct UserListFrame {
+    uint64_t version;
+    SharedFrame frame;
+};
+static std::shared_ptr<const UserListFrame> user_list_frame;
+
+void WebSocketHandler::handle_list_users(crow::websocket::connection &conn, const std::string &)
 {   
-    Logger::getInstance().log("ENTRO A HANDLE LIST USERS");
-    std::lock_guard<std::mutex> lock(connections_mutex);
-    std::string payload;
-    payload.push_back((char)51);  // Código de respuesta a listar usuarios (antes 0x51, ahora 51)
-    payload.push_back((char)connections.size());
-    for (const auto &[username, conn_data] : connections)
+    auto view = connections.user_list();
+    auto cached = std::atomic_load(&user_list_frame);
+    if (!cached || cached->version != view->version)
     {
-        payload.push_back((char)username.size());
-        payload += username;
-        payload.push_back((char)userStatusToByte(conn_data.status));
+        cached = std::make_shared<const UserListFrame>(UserListFrame{view->version, SharedFrame(view->payload)});
+        std::atomic_store(&user_list_frame, cached);
     }
-    Logger::getInstance().log("Enviando 51 a " + conn.get_remote_ip() + " (" + std::to_string(connections.size()) + " usuarios)");
-    Logger::getInstance().log("Payload: " + std::to_string(payload.size()) + " bytes");
-    conn.send_binary(payload);
+    LOG_DEBUG(Session, "Enviando 51 a {} ({} usuarios, versión {})", conn.get_remote_ip(), (uint8_t)view->payload[1], view->version);
+    cached->frame.send_to(conn);
 }
 
-void WebSocketHandler::handle_get_user_info(crow::websocket::connection &conn, const std::string &data, size_t &offset)
+void WebSocketHandler::handle_get_user_info(crow::websocket::connection &conn, const std::string &, std::string_view name)
 {
-    std::string requested_name = read_string_8(data, offset);
-    std::lock_guard<std::mutex> lock(connections_mutex);
-    auto it = connections.find(requested_name);
-    if (it == connections.end())
+    std::string requested_name(name);
+    UserStatus st = UserStatus::DISCONNECTED;
+    bool found = connections.with_session_shared(requested_name, [&](const ConnectionData &cd) {
+        st = cd.status;
+    });
+    if (!found)
     {
         send_error(conn, 1);  // Error: el usuario no existe
         return;
     }
     
-    UserStatus st = it->second.status;
-    
     // Crear payload según el protocolo (solo nombre y status)
-    std::string payload;
-    payload.push_back((char)52);  // Código de respuesta a obtener usuario (antes 0x52, ahora 52)
-    payload.push_back((char)requested_name.size());
-    payload += requested_name;
-    payload.push_back((char)userStatusToByte(st));
-    
-    Logger::getInstance().log("Enviando 52 info de usuario: " + requested_name + " (estado = " + 
-                            std::to_string(userStatusToByte(st)) + ")");    
-    conn.send_binary(payload);
+    LOG_DEBUG(Session, "Enviando 52 info de usuario: {} (estado = {})", requested_name, userStatusToByte(st));
+    conn.send_binary(proto::UserInfo::encode(requested_name, userStatusToByte(st)));
 }
 
-void WebSocketHandler::handle_change_status(crow::websocket::connection &conn, const std::string &sender, const std::string &data, size_t &offset)
+void WebSocketHandler::handle_change_status(crow::websocket::connection &conn, const std::string &sender, std::string_view username, uint8_t raw_status)
 {
-    std::string username = read_string_8(data, offset);
-    uint8_t raw_status = read_uint8(data, offset);
-    
     // Verificar que el usuario solo puede cambiar su propio estado
     if (username != sender)
     {
-        Logger::getInstance().log("Error: " + sender + " intentó cambiar el estado de " + username);
+        LOG_WARN(Presence, "Error: {} intentó cambiar el estado de {}", sender, username);
         send_error(conn, 2);  // Estado inválido
         return;
     }
 
-    Logger::getInstance().log("Cambio de estado solicitado para " + username + ": " + std::to_string(raw_status));
+    LOG_INFO(Presence, "Cambio de estado solicitado para {}: {}", username, raw_status);
 
     UserStatus oldStatus = UserStatus::DISCONNECTED;
-    {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        auto it = connections.find(username);
-        if (it != connections.end()) {
-            oldStatus = it->second.status;
-        }
-    }
+    connections.with_session_shared(sender, [&](const ConnectionData &cd) {
+        oldStatus = cd.status;
+    });
 
     UserStatus newStatus;
     switch (raw_status)
@@ -255,16 +365,15 @@ void WebSocketHandler::handle_change_status(crow::websocket::connection &conn, c
         send_error(conn, 2);  // Estado inválido
         return;
     }
-    Logger::getInstance().log("Transición de estado: " + std::to_string(userStatusToByte(oldStatus)) + " -> " + std::to_string(raw_status));
+    LOG_DEBUG(Presence, "Transición de estado: {} -> {}", userStatusToByte(oldStatus), raw_status);
 
     update_status(sender, newStatus);
 }
 
-void WebSocketHandler::handle_send_message(crow::websocket::connection &conn, const std::string &sender, const std::string &data, size_t &offset)
+void WebSocketHandler::handle_send_message(crow::websocket::connection &conn, const std::string &sender, std::string_view destino, std::string_view mensaje)
 {
-    std::string destino = read_string_8(data, offset);
-    std::string mensaje = read_string_8(data, offset);
-    Logger::getInstance().log("Mensaje recibido de " + sender + " para " + destino + ": " + mensaje);
+    // Destino y mensaje son vistas al frame: el camino hasta send_broadcast no copia.
+    LOG_DEBUG(Chat, "Mensaje recibido de {} para {}: {}", sender, destino, mensaje);
     
     // Verificar que el mensaje no esté vacío
     if (mensaje.empty())
@@ -276,58 +385,308 @@ void WebSocketHandler::handle_send_message(crow::websocket::connection &conn, co
     // Verificar si el mensaje excede la longitud máxima
     if (mensaje.size() > MAX_MESSAGE_LENGTH)
     {
-        Logger::getInstance().log("Mensaje truncado por exceder longitud máxima: " + std::to_string(mensaje.size()) + " > " + std::to_string(MAX_MESSAGE_LENGTH));
+        LOG_WARN(Chat, "Mensaje truncado por exceder longitud máxima: {} > {}", mensaje.size(), MAX_MESSAGE_LENGTH);
         mensaje = mensaje.substr(0, MAX_MESSAGE_LENGTH);
     }
     
     // Enviar al chat general o a un usuario específico
     if (destino == GENERAL_CHAT)
     {
-        send_broadcast(sender, mensaje);
+        send_broadcast(sender, mensaje, session_user_id(conn, sender));
+    }
+    else
+    {
+        send_private_message(sender, destino, mensaje, session_user_id(conn, sender), &conn);
+    }
+}
+
+void WebSocketHandler::handle_get_history(crow::websocket::connection &conn, const std::string &sender, std::string_view target)
+{
+    std::string payload;
+    proto::History::append(payload, 0);  // Cantidad, se completa al final
+
+    // Los últimos 255 mensajes se escriben directo en el payload, sin locks
+    size_t num_msgs;
+    if (target == GENERAL_CHAT)
+    {
+        num_msgs = history_store.write_general(payload, 255);
     }
     else
     {
-        send_private_message(sender, destino, mensaje);
+        num_msgs = history_store.write_private(session_user_id(conn, sender), user_ids.find(target), payload, 255);
     }
+    payload[1] = (char)num_msgs;
+
+    LOG_DEBUG(History, "Enviando 56 historial ({} mensajes)", num_msgs);
+    conn.send_binary(payload);
 }
 
-void WebSocketHandler::handle_get_history(crow::websocket::connection &conn, const std::string &sender, const std::string &data, size_t &offset)
+// Completa el cursor siguiente y la cantidad de una respuesta paginada (57,
+// 62), reservados en `cursor_at`. Devuelve el cursor.
+static uint64_t finish_page(std::string &payload, size_t cursor_at, const HistoryStore::Page &page)
 {
-    std::string target = read_string_8(data, offset);
-    std::vector<std::pair<std::string, std::string>> messages;
+    // 0 indica que no hay mensajes más antiguos en el historial
+    uint64_t next_cursor = page.has_older() ? page.first_seq : 0;
+    for (int i = 0; i < 8; i++)
+    {
+        payload[cursor_at + i] = (char)((next_cursor >> (8 * (7 - i))) & 0xFF);
+    }
+    payload[cursor_at + 8] = (char)page.count;
+    return next_cursor;
+}
 
+void WebSocketHandler::handle_get_history_page(crow::websocket::connection &conn, const std::string &sender, std::string_view target, uint64_t cursor, uint8_t page_size)
+{
+    if (page_size == 0)
+    {
+        page_size = DEFAULT_HISTORY_PAGE;
+    }
+
+    // Cursor siguiente y cantidad se completan al final
+    std::string payload;
+    proto::HistoryPage::append(payload, target, 0, 0);
+    size_t cursor_at = payload.size() - proto::U64::size(0) - proto::U8::size(0);
+
+    HistoryStore::Page page;
     if (target == GENERAL_CHAT)
     {
-        // Obtener historial del chat general
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        messages = general_chat_history;
+        page = history_store.write_general_page(payload, cursor, page_size);
     }
     else
     {
-        // Obtener historial de chat privado
-        std::string chat_id = (sender < target) ? (sender + "|" + target) : (target + "|" + sender);
-        auto it = chat_history.find(chat_id);
-        if (it != chat_history.end())
+        page = history_store.write_private_page(session_user_id(conn, sender), user_ids.find(target), payload, cursor, page_size);
+    }
+
+    uint64_t next_cursor = finish_page(payload, cursor_at, page);
+    LOG_DEBUG(History, "Enviando 57 página de historial ({} mensajes, cursor {})", page.count, next_cursor);
+    conn.send_binary(payload);
+}
+
+void WebSocketHandler::handle_search(crow::websocket::connection &conn, const std::string &sender, std::string_view query, uint8_t max_results)
+{
+    if (max_results == 0)
+    {
+        max_results = DEFAULT_SEARCH_RESULTS;
+    }
+
+    if (query.size() < SearchIndex::kMinQuery)
+    {
+        send_error(conn, 5);  // Búsqueda demasiado corta
+        return;
+    }
+
+    uint32_t requester = session_user_id(conn, sender);
+    std::vector<SearchIndex::Hit> hits = search_index.search(query, requester, max_results);
+
+    std::string payload;
+    proto::SearchResults::append(payload, query, (uint8_t)hits.size());
+    for (const auto &hit : hits)
+    {
+        // El chat se identifica como en el opcode 5: "~" o el otro participante
+        std::string chat = GENERAL_CHAT;
+        if (hit.conversation != SearchIndex::kGeneral)
         {
-            messages = it->second;
+            uint32_t lo = (uint32_t)(hit.conversation >> 32);
+            uint32_t hi = (uint32_t)hit.conversation;
+            chat = user_ids.name(lo == requester ? hi : lo);
         }
+        std::string author = user_ids.name(hit.author);
+
+        proto::SearchHit::append(payload, chat, hit.seq, author, hit.text);
     }
 
-    uint8_t num_msgs = (messages.size() > 255) ? 255 : static_cast<uint8_t>(messages.size());
-    std::string payload;
-    payload.push_back((char)56);  // Código de respuesta a obtener historial (antes 0x56, ahora 56)
-    payload.push_back((char)num_msgs);
+    LOG_DEBUG(History, "Enviando 58 resultados de búsqueda ({} mensajes)", hits.size());
+    conn.send_binary(payload);
+}
 
-    for (size_t i = 0; i < num_msgs; i++)
+void WebSocketHandler::handle_subscribe(crow::websocket::connection &conn, const std::string &sender, std::string_view username, uint8_t action)
+{
+    if (action > 1)
     {
-        const auto &[author, text] = messages[i];
-        payload.push_back((char)author.size());
-        payload += author;
-        payload.push_back((char)text.size());
-        payload += text;
+        send_error(conn, 6);  // Acción de presencia inválida
+        return;
     }
+    uint32_t subscriber_id = user_ids.find(sender);
+    if (subscriber_id == UserIdTable::kInvalid) return;
 
-    Logger::getInstance().log("Enviando 56 historial (" + std::to_string(num_msgs) + " mensajes)");
+    // Solo usuarios que se conectaron alguna vez: los IDs no se reciclan.
+    std::string target(username);
+    uint32_t target_id = user_ids.find(target);
+    if (target_id == UserIdTable::kInvalid)
+    {
+        send_error(conn, 1);  // Error: el usuario no existe
+        return;
+    }
+
+    if (action == 0)
+    {
+        presence_subscriptions.unsubscribe(subscriber_id, target_id);
+    }
+    else
+    {
+        presence_subscriptions.subscribe(subscriber_id, target_id);
+    }
+    // El registro copia el modo para sacar la conexión de la presencia global.
+    bool subscriber = presence_subscriptions.is_subscriber(subscriber_id);
+    ConnectionSession *session = resolve_session(conn);
+    connections.with_handle(session ? session->handle : SessionRegistry::Handle{}, [&](ConnectionData &cd) {
+        if (cd.conn == &conn) cd.presence_subscriber = subscriber;
+    });
+    if (action == 0)
+    {
+        LOG_INFO(Presence, "{} dejó de seguir la presencia de {}", sender, target);
+        return;
+    }
+
+    // Estado actual del contacto; desde aquí llegan solo sus cambios.
+    UserStatus st = UserStatus::DISCONNECTED;
+    connections.with_session_shared(target, [&](const ConnectionData &cd) { st = cd.status; });
+    LOG_INFO(Presence, "{} sigue la presencia de {}", sender, target);
+    conn.send_binary(proto::UserInfo::encode(target, userStatusToByte(st)));
+}
+
+void WebSocketHandler::handle_presence_mode(crow::websocket::connection &conn, const std::string &sender, uint8_t mode)
+{
+    if (mode > 1)
+    {
+        send_error(conn, 6);  // Modo de presencia inválido
+        return;
+    }
+    connections.with_session(sender, [&](ConnectionData &cd) {
+        if (cd.conn == &conn) cd.batched_presence = (mode == 1);
+    });
+    LOG_INFO(Presence, "{} recibe la presencia {}", sender, mode == 1 ? "en lotes (59)" : "por evento (53/54)");
+}
+
+// Eventos de sala (opcode 60)
+const uint8_t ROOM_CREATED = 1;
+const uint8_t ROOM_JOINED = 2;
+const uint8_t ROOM_LEFT = 3;
+
+static bool valid_room_name(std::string_view name)
+{
+    return !name.empty() && name.size() <= RoomRegistry::kMaxName && name != GENERAL_CHAT;
+}
+
+// Entrega un frame a los miembros conectados de la sala. Solo se recorre el
+// arreglo de miembros de la sala, no el registro de sesiones.
+static size_t deliver_to_room(uint32_t room_id, const SharedFrame &frame)
+{
+    std::vector<FanoutTarget> targets;
+    rooms.for_each_connected(room_id, [&](crow::websocket::connection &member) {
+        targets.push_back(FanoutExecutor::target_for(member));
+    });
+    FanoutExecutor::getInstance().deliver(frame, targets);
+    return targets.size();
+}
+
+void WebSocketHandler::handle_create_room(crow::websocket::connection &conn, const std::string &sender, std::string_view room)
+{
+    if (!valid_room_name(room))
+    {
+        send_error(conn, 8);  // No se pudo crear la sala
+        return;
+    }
+    if (rooms.create(room, session_user_id(conn, sender), &conn) == 0)
+    {
+        LOG_WARN(Chat, "{} no pudo crear la sala {} (ya existe o se alcanzó el límite)", sender, room);
+        send_error(conn, 8);
+        return;
+    }
+    LOG_INFO(Chat, "{} creó la sala {}", sender, room);
+    conn.send_binary(proto::RoomEvent::encode(room, sender, ROOM_CREATED));
+}
+
+void WebSocketHandler::handle_join_room(crow::websocket::connection &conn, const std::string &sender, std::string_view room)
+{
+    uint32_t room_id = rooms.find(room);
+    if (room_id == 0)
+    {
+        send_error(conn, 7);  // La sala no existe
+        return;
+    }
+    SharedFrame frame(proto::RoomEvent::encode(room, sender, ROOM_JOINED));
+    if (!rooms.join(room_id, session_user_id(conn, sender), &conn))
+    {
+        frame.send_to(conn);  // Ya era miembro: solo se confirma
+        return;
+    }
+    size_t notified = deliver_to_room(room_id, frame);
+    LOG_INFO(Chat, "{} entró a la sala {} ({} miembros conectados)", sender, room, notified);
+}
+
+void WebSocketHandler::handle_leave_room(crow::websocket::connection &conn, const std::string &sender, std::string_view room)
+{
+    uint32_t room_id = rooms.find(room);
+    if (room_id == 0)
+    {
+        send_error(conn, 7);
+        return;
+    }
+    if (!rooms.leave(room_id, session_user_id(conn, sender)))
+    {
+        send_error(conn, 9);  // No es miembro de la sala
+        return;
+    }
+    SharedFrame frame(proto::RoomEvent::encode(room, sender, ROOM_LEFT));
+    frame.send_to(conn);
+    deliver_to_room(room_id, frame);
+    LOG_INFO(Chat, "{} salió de la sala {}", sender, room);
+}
+
+void WebSocketHandler::handle_post_room(crow::websocket::connection &conn, const std::string &sender, std::string_view room, std::string_view mensaje)
+{
+    uint32_t room_id = rooms.find(room);
+    if (room_id == 0)
+    {
+        send_error(conn, 7);
+        return;
+    }
+    if (!rooms.is_member(room_id, session_user_id(conn, sender)))
+    {
+        send_error(conn, 9);
+        return;
+    }
+    if (mensaje.empty())
+    {
+        send_error(conn, 3);  // Mensaje vacío
+        return;
+    }
+    if (mensaje.size() > MAX_MESSAGE_LENGTH)
+    {
+        mensaje = mensaje.substr(0, MAX_MESSAGE_LENGTH);
+    }
+
+    history_store.append_room(room_id, sender, mensaje);
+    SharedFrame frame(proto::RoomMessage::encode(room, sender, mensaje));
+    size_t delivered = deliver_to_room(room_id, frame);
+    LOG_DEBUG(Chat, "Enviando 61 de {} en {} a {} miembros", sender, room, delivered);
+}
+
+void WebSocketHandler::handle_get_room_history(crow::websocket::connection &conn, const std::string &sender, std::string_view room, uint64_t cursor, uint8_t page_size)
+{
+    uint32_t room_id = rooms.find(room);
+    if (room_id == 0)
+    {
+        send_error(conn, 7);
+        return;
+    }
+    if (!rooms.is_member(room_id, session_user_id(conn, sender)))
+    {
+        send_error(conn, 9);
+        return;
+    }
+    if (page_size == 0)
+    {
+        page_size = DEFAULT_HISTORY_PAGE;
+    }
+
+    std::string payload;
+    proto::RoomHistory::append(payload, room, 0, 0);
+    size_t cursor_at = payload.size() - proto::U64::size(0) - proto::U8::size(0);
+    HistoryStore::Page page = history_store.write_room_page(room_id, payload, cursor, page_size);
+    uint64_t next_cursor = finish_page(payload, cursor_at, page);
+    LOG_DEBUG(History, "Enviando 62 historial de la sala {} ({} mensajes, cursor {})", room, page.count, next_cursor);
     conn.send_binary(payload);
 }
 
@@ -339,33 +698,36 @@ void WebSocketHandler::on_open(crow::websocket::connection &conn, const std::str
     // Validar nombre de usuario
     if (username.empty() || username.size() > 20 || username == GENERAL_CHAT)
     {
-        Logger::getInstance().log("Conexión rechazada: Nombre de usuario inválido: " + username);
+        LOG_WARN(Session, "Conexión rechazada: Nombre de usuario inválido: {}", username);
         conn.send_text("Error: Nombre de usuario inválido o reservado.");
         conn.close("Nombre inválido.");
         return;
     }
 
     bool is_reconnection = false;
+    bool is_duplicate = false;
     UserStatus status_to_notify = UserStatus::ACTIVO;
+    uint32_t user_id = user_ids.intern(username);
+    // Las suscripciones sobreviven a la desconexión: la sesión copia el modo.
+    bool subscriber = presence_subscriptions.is_subscriber(user_id);
 
+    connections.with_shard(username, [&](SessionRegistry::SessionMap &sessions)
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-
-        auto it = connections.find(username);
-        if (it != connections.end())
+        auto it = sessions.find(username);
+        if (it != sessions.end())
         {
             if (it->second.conn != nullptr)
             {
-                Logger::getInstance().log("Conexión rechazada: Nombre duplicado: " + username);
-                conn.send_text("Error: Nombre duplicado.");
-                conn.close("Duplicado.");
-                return;
+                is_duplicate = true;
             }
             else
             {
                 it->second.conn = &conn;
                 it->second.last_active = std::chrono::steady_clock::now();
                 it->second.ip_address = client_ip;
+                it->second.user_id = user_id;
+                it->second.batched_presence = false;  // cada conexión vuelve a pedir lotes
+                it->second.presence_subscriber = subscriber;
                 is_reconnection = true;
                 status_to_notify = it->second.status;
                 
@@ -378,38 +740,79 @@ void WebSocketHandler::on_open(crow::websocket::connection &conn, const std::str
         }
         else
         {
-            user_uuid = generate_uuid();
-            if (last_user_status.find(username) != last_user_status.end())
             {
-                status_to_notify = last_user_status[username];
-                if (status_to_notify == UserStatus::DISCONNECTED) {
-                    status_to_notify = UserStatus::ACTIVO;
+                std::lock_guard<std::mutex> lock(last_user_status_mutex);
+                auto restored = restored_sessions.find(username);
+                if (restored != restored_sessions.end())
+                {
+                    if (!restored_expired(restored->second, wall_clock_ms()))
+                    {
+                        user_uuid = restored->second.uuid;
+                        LOG_INFO(Session, "{} retoma su sesión del snapshot (IP anterior {})", username, restored->second.ip_address);
+                    }
+                    restored_sessions.erase(restored);
+                }
+                auto last = last_user_status.find(username);
+                if (last != last_user_status.end())
+                {
+                    status_to_notify = last->second;
+                    if (status_to_notify == UserStatus::DISCONNECTED) {
+                        status_to_notify = UserStatus::ACTIVO;
+                    }
                 }
             }
-            connections[username] = {
+            if (user_uuid.empty())
+            {
+                user_uuid = generate_uuid();
+            }
+            sessions[username] = {
                 username, 
                 user_uuid, 
                 &conn, 
                 status_to_notify, 
                 std::chrono::steady_clock::now(),
-                client_ip
+                client_ip,
+                user_id,
+                false,
+                subscriber
             };
         }
+    });
+
+    if (is_duplicate)
+    {
+        LOG_WARN(Session, "Conexión rechazada: Nombre duplicado: {}", username);
+        conn.send_text("Error: Nombre duplicado.");
+        conn.close("Duplicado.");
+        return;
+    }
+
+    bind_session(conn, username, user_id);
+    rooms.attach(user_id, &conn);
+    // Los mensajes se encolan con el lock del shard y sin conexión; como la
+    // conexión ya quedó registrada, no puede llegar uno nuevo al buzón.
+    std::string offline = offline_mailboxes.take(user_id);
+    if (!offline.empty())
+    {
+        LOG_INFO(Chat, "Entregando {} mensajes privados pendientes a {}", static_cast<uint8_t>(offline[1]), username);
+        conn.send_binary(offline);
     }
+    inactivity_timers.schedule(user_id, std::chrono::steady_clock::now() + INACTIVITY_TIMEOUT);
+    disconnect_timers.cancel(user_id);
+    conn.set_outbound_limits(get_outbound_limits());
 
     if (is_reconnection)
     {
-        Logger::getInstance().log("Reconexión de: " + username + " IP=" + client_ip);
+        LOG_INFO(Session, "Reconexión de: {} IP={}", username, client_ip);
     }
     else
     {
-        Logger::getInstance().log("Nueva conexión: " + username + " (UUID: " + user_uuid + ") desde " + client_ip);
-        Logger::getInstance().log("Tamaño actual de conexiones: " + std::to_string(connections.size()));
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        for (const auto &[uname, cd] : connections)
+        LOG_INFO(Session, "Nueva conexión: {} (UUID: {}) desde {}", username, user_uuid, client_ip);
+        LOG_DEBUG(Session, "Tamaño actual de conexiones: {}", connections.size());
+        connections.for_each([](const std::string &uname, const ConnectionData &cd)
         {
-            Logger::getInstance().log(" - " + uname + " conn=" + (cd.conn ? "sí" : "no"));
-        }
+            LOG_DEBUG(Session, " - {} conn={}", uname, cd.conn ? "sí" : "no");
+        });
     }
 
     static bool monitor_started = false;
@@ -417,122 +820,139 @@ void WebSocketHandler::on_open(crow::websocket::connection &conn, const std::str
     {
         WebSocketHandler::start_inactivity_monitor();
         WebSocketHandler::start_disconnection_cleanup();
+        if (!testing_mode) WebSocketHandler::start_presence_flusher();
         monitor_started = true;
     }
 
     notify_user_joined(username, status_to_notify);
 }
 
+// Opcodes del cliente y sus handlers.
+using ClientDispatcher = proto::Dispatcher<crow::websocket::connection &, const std::string &>;
+static constexpr ClientDispatcher::Table client_dispatch = ClientDispatcher::table<
+    proto::Route<proto::ListUsers, &WebSocketHandler::handle_list_users>,
+    proto::Route<proto::GetUser, &WebSocketHandler::handle_get_user_info>,
+    proto::Route<proto::ChangeStatus, &WebSocketHandler::handle_change_status>,
+    proto::Route<proto::SendMessage, &WebSocketHandler::handle_send_message>,
+    proto::Route<proto::GetHistory, &WebSocketHandler::handle_get_history>,
+    proto::Route<proto::GetHistoryPage, &WebSocketHandler::handle_get_history_page>,
+    proto::Route<proto::Search, &WebSocketHandler::handle_search>,
+    proto::Route<proto::PresenceMode, &WebSocketHandler::handle_presence_mode>,
+    proto::Route<proto::Subscribe, &WebSocketHandler::handle_subscribe>,
+    proto::Route<proto::CreateRoom, &WebSocketHandler::handle_create_room>,
+    proto::Route<proto::JoinRoom, &WebSocketHandler::handle_join_room>,
+    proto::Route<proto::LeaveRoom, &WebSocketHandler::handle_leave_room>,
+    proto::Route<proto::PostRoom, &WebSocketHandler::handle_post_room>,
+    proto::Route<proto::GetRoomHistory, &WebSocketHandler::handle_get_room_history>>();
+
 void WebSocketHandler::on_message(crow::websocket::connection &conn, const std::string &data, bool is_binary)
 {
-    Logger::getInstance().log("on_message: is_binary=" + std::string(is_binary ? "true" : "false"));
+    LOG_DEBUG(Server, "on_message: is_binary={}", is_binary);
     if (!is_binary)
     {
-        Logger::getInstance().log("Mensaje de texto recibido. El protocolo exige binario, se ignora.");
+        LOG_WARN(Server, "Mensaje de texto recibido. El protocolo exige binario, se ignora.");
         return;
     }
     
     // Verificar longitud mínima para un mensaje válido
     if (data.size() < 1) {
-        Logger::getInstance().log("Mensaje demasiado corto para ser válido");
+        LOG_WARN(Server, "Mensaje demasiado corto para ser válido");
         return;
     }
     
-    std::string sender = "Desconocido";
-    std::string usuario_a_reactivar;
-    uint8_t opcode = 0;
-    
-    // Leer el opcode del mensaje antes de procesar
-    if (data.size() >= 1) {
-        opcode = (uint8_t)data[0];
-    }
+    // El remitente es el nombre guardado en la sesión de la conexión, que vive
+    // tanto como ella: no se copia por cada frame.
+    static const std::string unknown_sender = "Desconocido";
+    const std::string *sender = &unknown_sender;
+    bool reactivar = false;
+    uint32_t sender_id = UserIdTable::kInvalid;
+    std::chrono::steady_clock::time_point activity;
+    uint8_t opcode = (uint8_t)data[0];
 
+    ConnectionSession *session = resolve_session(conn);
+    connections.with_handle(session ? session->handle : SessionRegistry::Handle{}, [&](ConnectionData &conn_data)
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        for (auto &[uname, conn_data] : connections)
-        {
-            if (conn_data.conn == &conn)
-            {
-                sender = uname;
-                conn_data.last_active = std::chrono::steady_clock::now();
-    
-                // Solo considerar la reactivación si el mensaje es de tipo "enviar mensaje" (opcode 4)
-                if (conn_data.status == UserStatus::INACTIVO && opcode == 4) {
-                    usuario_a_reactivar = uname;
-                    Logger::getInstance().log("Usuario " + uname + " será reactivado por enviar un mensaje");
-                } else if (conn_data.status == UserStatus::INACTIVO) {
-                    Logger::getInstance().log("Usuario " + uname + " mantiene estado INACTIVO (opcode=" + 
-                                            std::to_string(opcode) + ", no es mensaje)");
-                }
-    
-                Logger::getInstance().log("Actualizando tiempo de actividad para " + sender);
-                break;
-            }
+        if (conn_data.conn != &conn) return;
+        const std::string &uname = conn_data.username;
+        sender = &session->username;
+        sender_id = conn_data.user_id;
+        activity = std::chrono::steady_clock::now();
+        conn_data.last_active = activity;
+
+        // Solo considerar la reactivación si el mensaje es de tipo "enviar mensaje" (opcode 4)
+        if (conn_data.status == UserStatus::INACTIVO && opcode == 4) {
+            reactivar = true;
+            LOG_DEBUG(Presence, "Usuario {} será reactivado por enviar un mensaje", uname);
+        } else if (conn_data.status == UserStatus::INACTIVO) {
+            LOG_DEBUG(Presence, "Usuario {} mantiene estado INACTIVO (opcode={}, no es mensaje)", uname, opcode);
         }
+
+        LOG_DEBUG(Session, "Actualizando tiempo de actividad para {}", uname);
+    });
+    if (sender_id != UserIdTable::kInvalid)
+    {
+        inactivity_timers.schedule(sender_id, activity + INACTIVITY_TIMEOUT);
     }
     
     // Fuera del lock, reactivar si es un mensaje de chat (opcode 4)
-    if (!usuario_a_reactivar.empty()) {
-        update_status(usuario_a_reactivar, UserStatus::ACTIVO);
+    if (reactivar) {
+        update_status(*sender, UserStatus::ACTIVO);
     }
     
-    try
+    // La tabla de despacho decodifica los campos de cada opcode según su
+    // esquema, como vistas al frame; un frame truncado se reporta con un
+    // código de error, sin excepciones.
+    FrameReader in(data, 1);
+    LOG_DEBUG(Server, "Binario op={} from {}", opcode, *sender);
+    if (auto handler = client_dispatch[opcode])
     {
-        size_t offset = 0;
-        uint8_t opcode = read_uint8(data, offset);
-        Logger::getInstance().log("Binario op=" + std::to_string(opcode) + " from " + sender);
-        switch (opcode)
-        {
-        case 1:
-            handle_list_users(conn);
-            break;
-        case 2:
-            handle_get_user_info(conn, data, offset);
-            break;
-        case 3:
-            handle_change_status(conn, sender, data, offset);
-            break;
-        case 4:
-            handle_send_message(conn, sender, data, offset);
-            break;
-        case 5:
-            handle_get_history(conn, sender, data, offset);
-            break;
-        default:
-            Logger::getInstance().log("Opcode desconocido: " + std::to_string(opcode));
-            break;
-        }
+        handler(in, conn, *sender);
     }
-    catch (std::exception &e)
+    else
     {
-        Logger::getInstance().log("Error parseando binario: " + std::string(e.what()));
+        LOG_WARN(Server, "Opcode desconocido: {}", opcode);
+    }
+    if (!in.ok())
+    {
+        LOG_WARN(Server, "Frame inválido de {} (opcode {}): {}", *sender, opcode, parse_error_name(in.error()));
     }
 }
 
 void WebSocketHandler::on_close(crow::websocket::connection &conn, const std::string &reason, uint16_t code)
 {
     std::string disconnected_user;
+    uint32_t disconnected_id = UserIdTable::kInvalid;
+    std::chrono::steady_clock::time_point last_active;
     
+    ConnectionSession *session = resolve_session(conn);
+    if (!session)
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
+        return;
+    }
 
-        for (auto &[username, conn_data] : connections)
+    connections.with_handle(session->handle, [&](ConnectionData &conn_data)
+    {
+        if (conn_data.conn != &conn) return;
+        const std::string &username = conn_data.username;
+        // Guardar estado anterior y luego cambiar a DISCONNECTED
         {
-            if (conn_data.conn == &conn)
-            {
-                // Guardar estado anterior y luego cambiar a DISCONNECTED
-                last_user_status[username] = conn_data.status;
-                conn_data.status = UserStatus::DISCONNECTED;
-                conn_data.conn = nullptr; 
-                disconnected_user = username;
-                Logger::getInstance().log("Usuario desconectado: " + username + " - " + reason + " (Código " + std::to_string(code) + ")");
-                break;
-            }
+            std::lock_guard<std::mutex> lock(last_user_status_mutex);
+            last_user_status[username] = conn_data.status;
         }
-    }
+        conn_data.status = UserStatus::DISCONNECTED;
+        conn_data.conn = nullptr; 
+        disconnected_user = username;
+        disconnected_id = conn_data.user_id;
+        last_active = conn_data.last_active;
+        LOG_INFO(Session, "Usuario desconectado: {} - {} (Código {})", username, reason, code);
+    });
+    session->handle = {};
 
     if (!disconnected_user.empty())
     {
+        inactivity_timers.cancel(disconnected_id);
+        rooms.attach(disconnected_id, nullptr);
+        disconnect_timers.schedule(disconnected_id, last_active + DISCONNECT_RETENTION);
         // Notificar a todos los usuarios utilizando el código 54 (cambio de estado)
         notify_user_status_change(disconnected_user, UserStatus::DISCONNECTED);
     }
@@ -543,21 +963,23 @@ void WebSocketHandler::update_status(const std::string &username, UserStatus sta
     bool user_found = false;
     bool should_notify = false;
     UserStatus oldStatus = UserStatus::DISCONNECTED;
+    uint32_t connected_id = UserIdTable::kInvalid;
+    std::chrono::steady_clock::time_point activity;
 
+    connections.with_session(username, [&](ConnectionData &cd)
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        auto it = connections.find(username);
-        if (it != connections.end())
-        {
-            oldStatus = it->second.status;
-            it->second.status = status;
-            it->second.last_active = std::chrono::steady_clock::now();
-            user_found = true;
-            should_notify = notify || it->second.conn != nullptr;  // Always notify if connected
-            Logger::getInstance().log(username + " cambió su estado de " + 
-                std::to_string(userStatusToByte(oldStatus)) + " a " + 
-                std::to_string(userStatusToByte(status)));
-        }
+        oldStatus = cd.status;
+        cd.status = status;
+        activity = std::chrono::steady_clock::now();
+        cd.last_active = activity;
+        if (cd.conn) connected_id = cd.user_id;
+        user_found = true;
+        should_notify = notify || cd.conn != nullptr;  // Always notify if connected
+        LOG_INFO(Presence, "{} cambió su estado de {} a {}", username, userStatusToByte(oldStatus), userStatusToByte(status));
+    });
+    if (connected_id != UserIdTable::kInvalid)
+    {
+        inactivity_timers.schedule(connected_id, activity + INACTIVITY_TIMEOUT);
     }
 
     if (should_notify)
@@ -565,7 +987,7 @@ void WebSocketHandler::update_status(const std::string &username, UserStatus sta
         try {
             notify_user_status_change(username, status);
         } catch (const std::exception& e) {
-            Logger::getInstance().log("Error al notificar cambio de estado: " + std::string(e.what()));
+            LOG_ERROR(Presence, "Error al notificar cambio de estado: {}", e.what());
         }
     }
 }
@@ -573,105 +995,280 @@ void WebSocketHandler::update_status(const std::string &username, UserStatus sta
 std::string WebSocketHandler::list_users()
 {
     std::ostringstream oss;
+    oss << "Usuarios conectados:\n";
+    connections.for_each([&](const std::string &username, const ConnectionData &conn_data)
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        oss << "Usuarios conectados:\n";
-        for (const auto &[username, conn_data] : connections)
+        uint8_t st = userStatusToByte(conn_data.status);
+        oss << "- " << username << " (status=" << (int)st;
+        if (conn_data.conn)
         {
-            uint8_t st = userStatusToByte(conn_data.status);
-            oss << "- " << username << " (status=" << (int)st << ")\n";
+            auto q = conn_data.conn->get_outbound_stats();
+            oss << ", cola=" << q.queued_messages << " msgs/" << q.queued_bytes << " B"
+                << ", pico=" << q.peak_bytes << " B, descartados=" << q.dropped_messages;
         }
-    }
+        oss << ")\n";
+    });
     return oss.str();
 }
 
-void WebSocketHandler::send_private_message(const std::string &sender, const std::string &recipient, const std::string &msg)
+size_t WebSocketHandler::restore_history(const std::string &dir)
 {
-    bool can_notify = false;
+    return message_log.open(dir, [](const LogRecord &record)
+    {
+        uint32_t author_id = user_ids.intern(record.author);
+        if (record.kind == LogRecord::Kind::General)
+        {
+            uint64_t seq = history_store.append_general(record.author, record.text);
+            search_index.add(SearchIndex::kGeneral, seq, author_id, record.text);
+        }
+        else
+        {
+            uint32_t recipient_id = user_ids.intern(record.recipient);
+            uint64_t seq = history_store.append_private(author_id, recipient_id, record.author, record.text);
+            search_index.add(HistoryStore::conversation_key(author_id, recipient_id), seq, author_id, record.text);
+        }
+    });
+}
+
+bool WebSocketHandler::save_snapshot(const std::string &path)
+{
+    using namespace std::chrono;
+    auto steady_now = steady_clock::now();
+    int64_t wall_now_ms = wall_clock_ms();
 
+    // Copia compacta de cada shard bajo su lock compartido; la serialización y
+    // la escritura a disco ocurren sin locks.
+    std::vector<SessionRecord> live;
+    connections.for_each([&](const std::string &username, const ConnectionData &cd)
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
+        int64_t idle_ms = duration_cast<milliseconds>(steady_now - cd.last_active).count();
+        live.push_back(SessionRecord{username, cd.uuid, cd.status, cd.ip_address, wall_now_ms - idle_ms});
+    });
 
-        auto it = connections.find(recipient);
-        if (it == connections.end() || !it->second.conn || it->second.status == UserStatus::DISCONNECTED)
+    // Solo sesiones dentro de la retención: las del registro y las restauradas
+    // que no vencieron. Las vencidas se descartan aquí, así que el snapshot no
+    // crece con usuarios que ya no van a volver.
+    std::unordered_map<std::string, SessionRecord> records;
+    {
+        std::lock_guard<std::mutex> lock(last_user_status_mutex);
+        for (auto it = restored_sessions.begin(); it != restored_sessions.end();)
         {
-            auto se = connections.find(sender);
-            if (se != connections.end() && se->second.conn)
+            if (restored_expired(it->second, wall_now_ms))
             {
-                send_error(*se->second.conn, 4);  // Destinatario desconectado
+                it = restored_sessions.erase(it);
+                continue;
             }
-            return;
+            records.emplace(it->first, it->second);
+            ++it;
+        }
+        for (auto &r : live)
+        {
+            // Un usuario desconectado se guarda con el estado que tenía antes.
+            auto last = last_user_status.find(r.username);
+            if (r.status == UserStatus::DISCONNECTED && last != last_user_status.end())
+            {
+                r.status = last->second;
+            }
+            records[r.username] = std::move(r);
         }
+    }
 
-        std::string chat_id = (sender < recipient) ? (sender + "|" + recipient) : (recipient + "|" + sender);
-        chat_history[chat_id].push_back({sender, msg});
+    std::vector<SessionRecord> snapshot;
+    snapshot.reserve(records.size());
+    for (auto &[_, r] : records)
+    {
+        snapshot.push_back(std::move(r));
+    }
+    if (!SessionSnapshot::write(path, snapshot))
+    {
+        LOG_ERROR(Storage, "No se pudo escribir el snapshot de sesiones en {}", path);
+        return false;
+    }
+    return true;
+}
 
-        can_notify = true;
+size_t WebSocketHandler::load_snapshot(const std::string &path)
+{
+    std::vector<SessionRecord> records;
+    if (!SessionSnapshot::load(path, records))
+    {
+        LOG_WARN(Storage, "Sin snapshot de sesiones válido en {}", path);
+        return 0;
     }
 
-    if (can_notify)
+    int64_t wall_now_ms = wall_clock_ms();
+    size_t restored = 0;
+    std::lock_guard<std::mutex> lock(last_user_status_mutex);
+    for (auto &r : records)
     {
-        notify_new_message(sender, msg, true, recipient);
+        // Igual que una sesión eliminada del registro, el estado se conserva.
+        last_user_status[r.username] = r.status;
+        if (restored_expired(r, wall_now_ms)) continue;
+        restored_sessions[r.username] = std::move(r);
+        ++restored;
     }
+    LOG_INFO(Storage, "Snapshot de sesiones cargado: {} de {} sesiones vigentes", restored, records.size());
+    return restored;
 }
 
-void WebSocketHandler::send_broadcast(const std::string &sender, const std::string &msg)
+void WebSocketHandler::start_snapshotter(const std::string &path, std::chrono::seconds interval)
 {
+    std::thread([path, interval] {
+        while (true) {
+            std::this_thread::sleep_for(interval);
+            save_snapshot(path);
+        }
+    }).detach();
+}
+
+void WebSocketHandler::set_outbound_limits(const crow::websocket::outbound_limits &limits)
+{
+    std::lock_guard<std::mutex> lock(outbound_limits_mutex);
+    connection_outbound_limits = limits;
+}
+
+crow::websocket::outbound_limits WebSocketHandler::get_outbound_limits()
+{
+    std::lock_guard<std::mutex> lock(outbound_limits_mutex);
+    return connection_outbound_limits;
+}
+
+// Llave del registro para un nombre que llega como vista al frame. Reusa el
+// buffer del hilo, así que no reserva memoria por mensaje; la referencia vale
+// hasta la siguiente llamada en el mismo hilo.
+static const std::string &registry_key(std::string_view name)
+{
+    static thread_local std::string key;
+    key.assign(name.data(), name.size());
+    return key;
+}
+
+void WebSocketHandler::send_private_message(const std::string &sender, std::string_view recipient, std::string_view msg, uint32_t sender_id, crow::websocket::connection *sender_conn)
+{
+    bool online = false;
+    bool queued = false;
+    bool full = false;
+    uint32_t recipient_id = UserIdTable::kInvalid;
+    std::vector<FanoutTarget> targets;
+    // El remitente que llega por un frame ya trae su conexión; solo las
+    // llamadas internas lo buscan por nombre.
+    if (sender_conn)
+    {
+        targets.push_back(FanoutExecutor::target_for(*sender_conn));
+    }
+    else
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        general_chat_history.push_back({sender, msg});
+        connections.with_session_shared(sender, [&](const ConnectionData &cd) {
+            if (cd.conn) targets.push_back(FanoutExecutor::target_for(*cd.conn));
+        });
+    }
+    connections.with_session_shared(registry_key(recipient), [&](const ConnectionData &cd) {
+        online = cd.conn && cd.status != UserStatus::DISCONNECTED;
+        if (cd.conn) targets.push_back(FanoutExecutor::target_for(*cd.conn));
+        recipient_id = cd.user_id != UserIdTable::kInvalid ? cd.user_id : user_ids.intern(recipient);
+        // Sesión retenida sin conexión: se encola bajo el lock del shard, así
+        // on_open (que registra la conexión con el mismo lock) no la pierde.
+        if (!cd.conn)
+        {
+            queued = offline_mailboxes.push(recipient_id, sender, msg);
+            full = !queued;
+        }
+    });
+
+    if (!online && !queued)
+    {
+        // Buzón lleno, o destinatario desconocido
+        if (sender_conn)
+        {
+            send_error(*sender_conn, full ? 10 : 4);
+            return;
+        }
+        connections.with_session_shared(sender, [&](const ConnectionData &cd) {
+            if (cd.conn) send_error(*cd.conn, full ? 10 : 4);
+        });
+        return;
     }
-    notify_new_message(sender, msg, false, "");
+    if (queued) LOG_INFO(Chat, "Mensaje privado de {} para {} guardado en su buzón", sender, recipient);
+
+    if (sender_id == UserIdTable::kInvalid) sender_id = user_ids.intern(sender);
+    if (recipient_id == UserIdTable::kInvalid) recipient_id = user_ids.intern(recipient);
+    uint64_t seq = history_store.append_private(sender_id, recipient_id, sender, msg);
+    search_index.add(HistoryStore::conversation_key(sender_id, recipient_id), seq, sender_id, msg);
+    message_log.append_private(sender, recipient, msg);
+
+    LOG_DEBUG(Chat, "Enviando 55 de {} a {} ({} conexiones)", sender, recipient, targets.size());
+    notify_new_message(sender, msg, true, std::move(targets));
+}
+
+void WebSocketHandler::send_broadcast(const std::string &sender, std::string_view msg, uint32_t sender_id)
+{
+    if (sender_id == UserIdTable::kInvalid) sender_id = user_ids.intern(sender);
+    uint64_t seq = history_store.append_general(sender, msg);
+    search_index.add(SearchIndex::kGeneral, seq, sender_id, msg);
+    message_log.append_general(sender, msg);
+    notify_new_message(sender, msg, false);
 }
 
 void WebSocketHandler::start_inactivity_monitor()
 {
     std::thread([] {
         while (true) {
-            std::this_thread::sleep_for(std::chrono::seconds(5));
-            
-            std::vector<std::string> users_to_notify;
+            std::this_thread::sleep_for(inactivity_timers.tick());
+            expire_inactive(std::chrono::steady_clock::now());
+        }
+    }).detach();
+}
 
-            {
-                std::lock_guard<std::mutex> lock(connections_mutex);
-                auto now = std::chrono::steady_clock::now();
-
-                for (auto& [username, conn_data] : connections) {
-                    if (conn_data.conn &&
-                        conn_data.status != UserStatus::INACTIVO &&
-                        conn_data.status != UserStatus::DISCONNECTED) {
-                        
-                        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - conn_data.last_active).count();
-
-                        if (elapsed >= 60) {
-                            conn_data.status = UserStatus::INACTIVO;
-                            Logger::getInstance().log("Usuario " + username + " marcado como INACTIVO (inactivo por " + std::to_string(elapsed) + "s)");
-                            
-                            {
-                                std::lock_guard<std::mutex> lock(inactivity_mutex);
-                                user_marked_inactive = true;
-                            }
-
-                            users_to_notify.push_back(username);
-                        }
-                    }
-                }
-            }
+size_t WebSocketHandler::expire_inactive(std::chrono::steady_clock::time_point now)
+{
+    static thread_local std::vector<uint32_t> expired;
+    expired.clear();
+    if (inactivity_timers.advance(now, expired) == 0) return 0;
 
-            for (const auto& username : users_to_notify) {
-                notify_user_status_change(username, UserStatus::INACTIVO);
+    std::vector<std::string> users_to_notify;
+    for (uint32_t id : expired)
+    {
+        std::string username = user_ids.name(id);
+        std::chrono::steady_clock::time_point reschedule{};
+        connections.with_session(username, [&](ConnectionData &conn_data) {
+            if (!conn_data.conn ||
+                conn_data.status == UserStatus::INACTIVO ||
+                conn_data.status == UserStatus::DISCONNECTED) {
+                return;
             }
-
-            if (!users_to_notify.empty()) {
-                inactivity_cv.notify_all();
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                {
-                    std::lock_guard<std::mutex> lock(inactivity_mutex);
-                    user_marked_inactive = false;
-                }
+            // last_active también se actualiza sin pasar por la rueda (p. ej.
+            // al restaurar una sesión); si hubo actividad después, se reprograma.
+            auto idle = now - conn_data.last_active;
+            if (idle < INACTIVITY_TIMEOUT) {
+                reschedule = conn_data.last_active + INACTIVITY_TIMEOUT;
+                return;
             }
+            conn_data.status = UserStatus::INACTIVO;
+            LOG_INFO(Presence, "Usuario {} marcado como INACTIVO (inactivo por {}s)", username,
+                     std::chrono::duration_cast<std::chrono::seconds>(idle).count());
+            users_to_notify.push_back(username);
+        });
+        if (reschedule != std::chrono::steady_clock::time_point{})
+        {
+            inactivity_timers.schedule(id, reschedule);
         }
-    }).detach();
+    }
+
+    if (users_to_notify.empty()) return 0;
+    {
+        std::lock_guard<std::mutex> lock(inactivity_mutex);
+        user_marked_inactive = true;
+    }
+    for (const auto& username : users_to_notify) {
+        notify_user_status_change(username, UserStatus::INACTIVO);
+    }
+    inactivity_cv.notify_all();
+    if (!testing_mode) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        std::lock_guard<std::mutex> lock(inactivity_mutex);
+        user_marked_inactive = false;
+    }
+    return users_to_notify.size();
 }
 
 
@@ -679,21 +1276,49 @@ void WebSocketHandler::start_disconnection_cleanup()
 {
     std::thread([] {
         while (true) {
-            std::this_thread::sleep_for(std::chrono::minutes(1));
-            std::lock_guard<std::mutex> lock(connections_mutex);
-            auto now = std::chrono::steady_clock::now();
-
-            for (auto it = connections.begin(); it != connections.end(); ) {
-                if (it->second.conn == nullptr) {
-                    auto elapsed = std::chrono::duration_cast<std::chrono::minutes>(now - it->second.last_active).count();
-                    if (elapsed >= 5) {
-                        Logger::getInstance().log("Eliminando usuario desconectado por más de 5 min: " + it->first);
-                        it = connections.erase(it);
-                        continue;
-                    }
-                }
-                ++it;
-            }
+            std::this_thread::sleep_for(disconnect_timers.tick());
+            evict_disconnected(std::chrono::steady_clock::now());
         }
     }).detach();
 }
+
+size_t WebSocketHandler::evict_disconnected(std::chrono::steady_clock::time_point now)
+{
+    static thread_local std::vector<uint32_t> expired;
+    expired.clear();
+    if (disconnect_timers.advance(now, expired) == 0) return 0;
+
+    // Cada eliminación toma solo el lock del shard del usuario durante una
+    // búsqueda; entre lotes se cede el CPU para no retrasar a los hilos de Crow.
+    size_t evicted = 0;
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+        if (i > 0 && i % EVICTION_BATCH == 0) std::this_thread::yield();
+
+        uint32_t id = expired[i];
+        std::string username = user_ids.name(id);
+        std::chrono::steady_clock::time_point reschedule{};
+        bool erased = connections.erase_session_if(username, [&](const ConnectionData &cd) {
+            if (cd.conn != nullptr) return false;
+            if (now - cd.last_active < DISCONNECT_RETENTION) {
+                reschedule = cd.last_active + DISCONNECT_RETENTION;
+                return false;
+            }
+            return true;
+        });
+        if (erased)
+        {
+            LOG_INFO(Session, "Eliminando usuario desconectado por más de 5 min: {}", username);
+            presence_batcher.forget(username);
+            presence_subscriptions.remove_subscriber(id);
+            rooms.remove_user(id);
+            offline_mailboxes.drop(id);
+            ++evicted;
+        }
+        else if (reschedule != std::chrono::steady_clock::time_point{})
+        {
+            disconnect_timers.schedule(id, reschedule);
+        }
+    }
+    return evicted;
+}
@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "crow/websocket.h"
+#include "../include/session_registry.h"
+#include "../include/message_log.h"
+#include "../include/search_index.h"
+#include "../include/logger.h"
+#include "../include/timing_wheel.h"
+#include "../include/room_registry.h"
+
+// Benchmarks del servidor. Uso: ./BenchServer [caso]
+// Sin argumentos corre todos los casos.
+
+using bench_clock = std::chrono::steady_clock;
+
+// Evita que el compilador elimine el trabajo medido.
+static volatile size_t bench_sink;
+
+static std::vector<std::string> make_usernames(size_t n)
+{
+    std::vector<std::string> names;
+    names.reserve(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        names.push_back("user" + std::to_string(i));
+    }
+    return names;
+}
+
+static ConnectionData make_session(const std::string &name)
+{
+    return ConnectionData{name, "uuid-" + name, nullptr, UserStatus::ACTIVO, bench_clock::now(), "127.0.0.1"};
+}
+
+// Esquema anterior: un único mutex global sobre todo el mapa.
+struct GlobalMutexRegistry
+{
+    std::unordered_map<std::string, ConnectionData> sessions;
+    std::mutex mutex;
+
+    bool read_status(const std::string &name, UserStatus &out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sessions.find(name);
+        if (it == sessions.end()) return false;
+        out = it->second.status;
+        return true;
+    }
+
+    void touch(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sessions.find(name);
+        if (it != sessions.end()) it->second.last_active = bench_clock::now();
+    }
+};
+
+struct ShardedRegistry
+{
+    SessionRegistry sessions;
+
+    bool read_status(const std::string &name, UserStatus &out)
+    {
+        return sessions.with_session_shared(name, [&](const ConnectionData &cd) { out = cd.status; });
+    }
+
+    void touch(const std::string &name)
+    {
+        sessions.with_session(name, [](ConnectionData &cd) { cd.last_active = bench_clock::now(); });
+    }
+};
+
+// Cada hilo simula un io_context de Crow: 80% lecturas (presencia, info de
+// usuario) y 20% escrituras (marcas de actividad por cada frame recibido).
+template <typename Registry>
+static double run_contention(Registry &registry, const std::vector<std::string> &names, unsigned threads, std::chrono::milliseconds duration)
+{
+    std::atomic<bool> start{false};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total_ops{0};
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(1234 + t);
+            std::uniform_int_distribution<size_t> pick(0, names.size() - 1);
+            uint64_t ops = 0;
+            UserStatus st;
+            while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                for (int i = 0; i < 64; i++)
+                {
+                    const std::string &name = names[pick(rng)];
+                    if ((ops + i) % 5 == 0)
+                        registry.touch(name);
+                    else
+                        registry.read_status(name, st);
+                }
+                ops += 64;
+            }
+            total_ops += ops;
+        });
+    }
+
+    auto begin = bench_clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (auto &w : workers) w.join();
+    double secs = std::chrono::duration<double>(bench_clock::now() - begin).count();
+    return total_ops.load() / secs;
+}
+
+static void bench_registry_contention()
+{
+    const size_t user_count = 5000;
+    const auto duration = std::chrono::milliseconds(300);
+    auto names = make_usernames(user_count);
+
+    GlobalMutexRegistry global;
+    ShardedRegistry sharded;
+    for (const auto &name : names)
+    {
+        global.sessions[name] = make_session(name);
+        sharded.sessions.insert_or_assign(name, make_session(name));
+    }
+
+    unsigned hw = std::thread::hardware_concurrency();
+    if (hw == 0) hw = 4;
+    std::vector<unsigned> thread_counts;
+    for (unsigned t = 1; t <= std::max(hw * 2, 8u); t *= 2) thread_counts.push_back(t);
+
+    std::cout << "== registry: " << user_count << " usuarios, " << sharded.sessions.shard_count()
+              << " shards, hardware_concurrency=" << hw << " ==\n";
+    std::cout << std::setw(8) << "hilos" << std::setw(18) << "mutex global" << std::setw(18) << "sharded" << std::setw(10) << "x\n";
+    for (unsigned threads : thread_counts)
+    {
+        double g = run_contention(global, names, threads, duration);
+        double s = run_contention(sharded, names, threads, duration);
+        std::cout << std::setw(8) << threads
+                  << std::setw(14) << std::fixed << std::setprecision(2) << g / 1e6 << " Mop/s"
+                  << std::setw(14) << s / 1e6 << " Mop/s"
+                  << std::setw(9) << std::setprecision(2) << s / g << "\n";
+    }
+}
+
+// Costo de encolar un broadcast "~" en las colas de escritura de N conexiones,
+// replicando lo que hace Connection: encabezado + payload y luego el gather
+// de buffers para async_write.
+enum class FanoutMode { CopyPerConnection, SharedPayload, PreEncoded };
+
+static double run_fanout(FanoutMode mode, size_t recipients, const std::string &payload, int rounds)
+{
+    using crow::websocket::write_buffer;
+    std::vector<std::vector<write_buffer>> queues(recipients);
+    std::vector<boost::asio::const_buffer> gather;
+    size_t checksum = 0;
+
+    auto begin = bench_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        if (mode == FanoutMode::CopyPerConnection)
+        {
+            for (auto &q : queues)
+            {
+                std::string msg = payload; // send_binary(std::string) recibe una copia
+                q.emplace_back(crow::websocket::build_frame_header(0x2, msg.size()));
+                q.emplace_back(std::move(msg));
+            }
+        }
+        else if (mode == FanoutMode::SharedPayload)
+        {
+            auto shared = std::make_shared<const std::string>(payload);
+            for (auto &q : queues)
+            {
+                q.emplace_back(crow::websocket::build_frame_header(0x2, shared->size()));
+                q.emplace_back(shared);
+            }
+        }
+        else
+        {
+            auto frame = crow::websocket::encode_frame(0x2, payload);
+            for (auto &q : queues)
+            {
+                q.emplace_back(frame.wire);
+            }
+        }
+
+        for (auto &q : queues)
+        {
+            gather.clear();
+            for (auto &b : q) gather.push_back(b.buffer());
+            for (auto &g : gather) checksum += g.size();
+            q.clear();
+        }
+    }
+    double secs = std::chrono::duration<double>(bench_clock::now() - begin).count();
+    bench_sink = checksum;
+    return secs * 1e9 / (double(rounds) * recipients);
+}
+
+static void bench_frame_fanout()
+{
+    const size_t recipients = 10000;
+    const int rounds = 50;
+
+    std::cout << "== fanout: broadcast '~' a " << recipients << " conexiones ==\n";
+    std::cout << std::setw(10) << "payload" << std::setw(18) << "copia/conexión" << std::setw(18) << "payload shared" << std::setw(18) << "pre-codificado\n";
+    for (size_t size : {16, 255, 4096})
+    {
+        std::string payload(size, 'x');
+        double copy = run_fanout(FanoutMode::CopyPerConnection, recipients, payload, rounds);
+        double shared = run_fanout(FanoutMode::SharedPayload, recipients, payload, rounds);
+        double encoded = run_fanout(FanoutMode::PreEncoded, recipients, payload, rounds);
+        std::cout << std::setw(10) << size
+                  << std::setw(12) << std::fixed << std::setprecision(1) << copy << " ns/dst"
+                  << std::setw(12) << shared << " ns/dst"
+                  << std::setw(12) << encoded << " ns/dst\n";
+    }
+}
+
+// Escritura con group commit y recuperación del log de mensajes.
+static void bench_message_log()
+{
+    const size_t records = 2000000;
+    auto dir = std::filesystem::temp_directory_path() / "bench_message_log";
+    std::filesystem::remove_all(dir);
+
+    std::cout << "== message log: " << records << " mensajes ==\n";
+    {
+        MessageLog log;
+        log.open(dir.string());
+        std::string text(64, 'x');
+        auto begin = bench_clock::now();
+        uint64_t last = 0;
+        for (size_t i = 0; i < records; i++) last = log.append_general("user" + std::to_string(i % 1000), text);
+        log.flush(last);
+        double secs = std::chrono::duration<double>(bench_clock::now() - begin).count();
+        std::cout << "escritura: " << std::fixed << std::setprecision(2) << records / secs / 1e6 << " M msgs/s, "
+                  << log.sync_count() << " fdatasync\n";
+    }
+    {
+        MessageLog log;
+        size_t bytes = 0;
+        auto begin = bench_clock::now();
+        size_t n = log.open(dir.string(), [&](const LogRecord &r) { bytes += r.text.size(); });
+        double secs = std::chrono::duration<double>(bench_clock::now() - begin).count();
+        bench_sink = bytes;
+        std::cout << "recuperación: " << n << " mensajes en " << std::setprecision(3) << secs << " s ("
+                  << std::setprecision(2) << n / secs / 1e6 << " M msgs/s)\n";
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// Latencia de búsqueda sobre el índice de trigramas. Los mensajes se arman con
+// un vocabulario fijo; un 10% son privados entre pares de usuarios.
+static void bench_search(size_t docs)
+{
+    std::mt19937 rng(42);
+    std::vector<std::string> words;
+    for (int i = 0; i < 5000; i++)
+    {
+        std::string w;
+        size_t len = 4 + rng() % 6;
+        for (size_t k = 0; k < len; k++) w.push_back(char('a' + rng() % 26));
+        words.push_back(w);
+    }
+
+    SearchIndex index(1 << 20, 64);
+    std::cout << "== search: " << docs << " mensajes ==\n";
+    auto begin = bench_clock::now();
+    std::string text;
+    for (size_t i = 0; i < docs; i++)
+    {
+        text.clear();
+        size_t n = 6 + rng() % 8;
+        for (size_t k = 0; k < n; k++)
+        {
+            if (k) text.push_back(' ');
+            // Sesgo hacia las primeras palabras para tener términos comunes y raros
+            size_t r = rng() % words.size();
+            text += words[(r * r) / words.size()];
+        }
+        uint32_t author = 1 + rng() % 1000;
+        uint64_t conv = (i % 10 == 0) ? (uint64_t(author) << 32) | (1 + rng() % 1000) : SearchIndex::kGeneral;
+        index.add(conv, i + 1, author, text);
+    }
+    double secs = std::chrono::duration<double>(bench_clock::now() - begin).count();
+    std::cout << "indexado: " << std::fixed << std::setprecision(2) << docs / secs / 1e6 << " M msgs/s\n";
+
+    const int queries = 2000;
+    std::vector<double> latencies;
+    size_t found = 0;
+    for (int q = 0; q < queries; q++)
+    {
+        // Mezcla de una palabra, dos palabras y un fragmento sin coincidencias
+        std::string query;
+        switch (q % 3)
+        {
+        case 0: query = words[rng() % words.size()]; break;
+        case 1: query = words[rng() % 50] + " " + words[rng() % 50]; break;
+        default: query = words[rng() % words.size()].substr(0, 3) + "qzx"; break;
+        }
+        auto t0 = bench_clock::now();
+        found += index.search(query, 1 + rng() % 1000, 20).size();
+        latencies.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count());
+    }
+    bench_sink = found;
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "consulta: p50 " << std::setprecision(1) << latencies[queries / 2] << " us, p99 "
+              << latencies[queries * 99 / 100] << " us, máx " << latencies.back() << " us\n";
+}
+
+// Costo por llamada de LOG_INFO con varios hilos registrando a la vez, en
+// modo texto y binario.
+static void bench_logger()
+{
+    const int per_thread = 200000;
+    Logger &logger = Logger::getInstance();
+
+    for (auto format : {Logger::OutputFormat::Text, Logger::OutputFormat::Binary})
+    {
+        logger.setOutputFormat(format);
+        logger.startLogging();
+        std::cout << "== logger (" << Logger::fileFor(format) << "): " << per_thread << " líneas por hilo ==\n";
+        for (int threads : {1, 4, 16})
+        {
+            std::atomic<bool> go{false};
+            std::vector<std::thread> producers;
+            for (int t = 0; t < threads; t++)
+            {
+                producers.emplace_back([&, t] {
+                    std::string sender = "alice";
+                    while (!go.load()) std::this_thread::yield();
+                    for (int i = 0; i < per_thread; i++) LOG_INFO(Chat, "Enviando 55 de {} a user{}", sender, t);
+                });
+            }
+            auto begin = bench_clock::now();
+            go = true;
+            for (auto &p : producers) p.join();
+            double secs = std::chrono::duration<double>(bench_clock::now() - begin).count();
+            logger.flush();
+            double total = std::chrono::duration<double>(bench_clock::now() - begin).count();
+            std::cout << std::setw(4) << threads << " hilos: " << std::fixed << std::setprecision(1)
+                      << secs * 1e9 / (double(per_thread) * threads) << " ns/llamada, "
+                      << std::setprecision(2) << double(per_thread) * threads / total / 1e6 << " M líneas/s escritas\n";
+        }
+        logger.stopLogging();
+    }
+}
+
+// Detección de inactividad: barrido completo del registro (esquema anterior,
+// cada 5 s) contra la rueda de temporizadores, que cobra cada actividad con
+// un schedule() y por tick solo recorre las ranuras transcurridas.
+static void bench_inactivity_timers()
+{
+    const size_t users = 100000;
+    auto names = make_usernames(users);
+    SessionRegistry registry;
+    for (const auto &name : names) registry.insert_or_assign(name, make_session(name));
+
+    std::cout << "== inactividad: " << users << " usuarios ==\n";
+    {
+        const int rounds = 20;
+        size_t marked = 0;
+        auto begin = bench_clock::now();
+        for (int r = 0; r < rounds; r++)
+        {
+            auto now = bench_clock::now();
+            registry.for_each_mut([&](const std::string &, ConnectionData &cd) {
+                if (cd.conn && now - cd.last_active >= std::chrono::seconds(60)) marked++;
+            });
+        }
+        bench_sink = marked;
+        double us = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / rounds;
+        std::cout << "barrido completo: " << std::fixed << std::setprecision(1) << us << " us por pasada\n";
+    }
+    {
+        auto start = bench_clock::now();
+        TimingWheel wheel(std::chrono::milliseconds(100), start);
+        for (uint32_t id = 1; id <= users; id++) wheel.schedule(id, start + std::chrono::seconds(60));
+
+        const size_t touches = 2000000;
+        std::mt19937 rng(7);
+        auto begin = bench_clock::now();
+        for (size_t i = 0; i < touches; i++)
+        {
+            wheel.schedule(1 + rng() % users, start + std::chrono::milliseconds(60000 + i / 100));
+        }
+        double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - begin).count() / touches;
+
+        // Diez minutos simulados de ticks de 100 ms; todos los plazos vencen.
+        std::vector<uint32_t> expired;
+        double worst = 0;
+        begin = bench_clock::now();
+        for (int t = 1; t <= 6000; t++)
+        {
+            auto t0 = bench_clock::now();
+            wheel.advance(start + std::chrono::milliseconds(100 * t), expired);
+            worst = std::max(worst, std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count());
+        }
+        double us = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / 6000;
+        bench_sink = expired.size();
+        std::cout << "rueda: schedule " << std::setprecision(1) << ns << " ns, tick " << std::setprecision(2) << us
+                  << " us promedio (peor " << worst << " us), " << expired.size() << " vencidos\n";
+    }
+    {
+        // Limpieza de desconectados: erase_if retiene el lock de cada shard
+        // mientras lo recorre entero; erase_session_if lo toma por usuario.
+        auto begin = bench_clock::now();
+        bench_sink = registry.erase_if([](const ConnectionData &cd) {
+            return cd.conn == nullptr && bench_clock::now() - cd.last_active >= std::chrono::minutes(5);
+        });
+        double scan = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count();
+
+        const size_t evictions = 10000;
+        double worst = 0;
+        begin = bench_clock::now();
+        for (size_t i = 0; i < evictions; i++)
+        {
+            auto t0 = bench_clock::now();
+            registry.erase_session_if(names[i * 7 % users], [](const ConnectionData &cd) { return cd.conn == nullptr; });
+            worst = std::max(worst, std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count());
+        }
+        double each = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / evictions;
+        std::cout << "limpieza: barrido " << std::setprecision(1) << scan << " us (" << registry.shard_count()
+                  << " shards), por sesión " << std::setprecision(2) << each << " us (peor " << worst << " us)\n";
+    }
+}
+
+// Lista de usuarios (opcode 51): serializar recorriendo el registro en cada
+// solicitud contra tomar una referencia al snapshot mantenido por el registro.
+static void bench_user_list()
+{
+    const size_t users = 100000;
+    const int requests = 200;
+    auto names = make_usernames(users);
+    SessionRegistry registry;
+    for (const auto &name : names) registry.insert_or_assign(name, make_session(name));
+
+    std::cout << "== lista de usuarios: " << users << " usuarios ==\n";
+    auto begin = bench_clock::now();
+    for (int r = 0; r < requests; r++)
+    {
+        std::string payload(1, char(51));
+        payload.push_back(0);
+        registry.for_each([&](const std::string &username, const ConnectionData &cd) {
+            payload.push_back(static_cast<char>(std::min<size_t>(username.size(), 255)));
+            payload.append(username, 0, 255);
+            payload.push_back(static_cast<char>(cd.status));
+        });
+        bench_sink = payload.size();
+    }
+    double scan = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / requests;
+
+    begin = bench_clock::now();
+    for (int r = 0; r < requests; r++) bench_sink = registry.user_list()->payload.size();
+    double cached = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / requests;
+
+    // Ráfaga de reconexión: cada alta o cambio de estado seguido de una solicitud.
+    const size_t churn = 2000;
+    double patch_worst = 0;
+    begin = bench_clock::now();
+    for (size_t i = 0; i < churn; i++)
+    {
+        auto t0 = bench_clock::now();
+        registry.with_session(names[i], [](ConnectionData &cd) { cd.status = UserStatus::OCUPADO; });
+        patch_worst = std::max(patch_worst, std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count());
+        bench_sink = registry.user_list()->payload.size();
+    }
+    double churned = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / churn;
+
+    begin = bench_clock::now();
+    for (size_t i = 0; i < churn; i++) registry.erase(names[users - 1 - i]);
+    double evict = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / churn;
+    begin = bench_clock::now();
+    bench_sink = registry.user_list()->payload.size();
+    double rebuild = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count();
+
+    std::cout << std::fixed << std::setprecision(1) << "serializar por solicitud: " << scan << " us, snapshot: "
+              << std::setprecision(2) << cached << " us\n";
+    std::cout << "cambio de estado + solicitud: " << std::setprecision(1) << churned << " us (peor parche "
+              << patch_worst << " us), baja " << std::setprecision(2) << evict << " us, rearmado tras bajas "
+              << std::setprecision(1) << rebuild << " us\n";
+}
+
+// Fanout de una sala: recorrer el registro filtrando miembros contra el
+// arreglo contiguo de miembros de la sala.
+static void bench_room_fanout()
+{
+    const size_t users = 100000;
+    const size_t members = 10000;
+    const int rounds = 200;
+    auto names = make_usernames(users);
+    SessionRegistry registry;
+    for (const auto &name : names) registry.insert_or_assign(name, make_session(name));
+
+    // Las conexiones no se usan: solo se cuentan los destinatarios.
+    auto fake_conn = [](size_t i) { return reinterpret_cast<crow::websocket::connection *>(uintptr_t(i + 1) * 64); };
+    RoomRegistry rooms;
+    std::unordered_map<std::string, bool> member_of;
+    uint32_t room = rooms.create("sala", 1, fake_conn(0));
+    for (size_t i = 1; i < members; i++)
+    {
+        rooms.join(room, static_cast<uint32_t>(i * 10 + 1), fake_conn(i));
+        member_of[names[i * 10]] = true;
+    }
+    member_of[names[0]] = true;
+
+    std::cout << "== sala: " << members << " miembros entre " << users << " sesiones ==\n";
+    std::vector<const void *> targets;
+    auto begin = bench_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        targets.clear();
+        registry.for_each([&](const std::string &username, const ConnectionData &cd) {
+            if (member_of.count(username)) targets.push_back(&cd);
+        });
+    }
+    double scan = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / rounds;
+    bench_sink = targets.size();
+
+    begin = bench_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        targets.clear();
+        rooms.for_each_connected(room, [&](crow::websocket::connection &c) { targets.push_back(&c); });
+    }
+    double direct = std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count() / rounds;
+    bench_sink = targets.size();
+    std::cout << std::fixed << std::setprecision(1) << "registro filtrado: " << scan << " us, miembros de la sala: "
+              << direct << " us por mensaje\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string which = argc > 1 ? argv[1] : "";
+
+    if (which.empty() || which == "registry") bench_registry_contention();
+    if (which.empty() || which == "fanout") bench_frame_fanout();
+    if (which.empty() || which == "wal") bench_message_log();
+    if (which.empty() || which == "logger") bench_logger();
+    if (which.empty() || which == "timers") bench_inactivity_timers();
+    if (which.empty() || which == "userlist") bench_user_list();
+    if (which.empty() || which == "rooms") bench_room_fanout();
+    if (which.empty() || which == "search") bench_search(argc > 2 ? std::stoul(argv[2]) : 1000000);
+
+    return 0;
+}
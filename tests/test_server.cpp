@@ -4,9 +4,41 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <zlib.h>
+#include <iterator>
+#include <cstdio>
+#include <random>
 #include "../include/websocket_handler.h"
 #include "../include/logger.h"
 #include "../include/websocket_global.h"
+#include "../include/fanout_executor.h"
+#include "../include/session_snapshot.h"
+#include <cstdlib>
+#include <new>
+
+// Reservas de memoria del hilo actual, para verificar caminos sin heap.
+static thread_local size_t thread_allocations = 0;
+
+void *operator new(std::size_t size)
+{
+    ++thread_allocations;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
 
 class MockConnection : public crow::websocket::connection
 {
@@ -16,10 +48,35 @@ public:
     {
     }
 
+    ~MockConnection() override
+    {
+        delete static_cast<ConnectionSession *>(userdata());
+    }
+
     void send_binary(std::string msg) override
     {
+        if (slow_reader)
+        {
+            crow::websocket::outbound_queue::entry e;
+            e.header = crow::websocket::build_frame_header(0x2, msg.size());
+            e.body = std::move(msg);
+            enqueue(std::move(e));
+            return;
+        }
         sent_messages.push_back(msg);
     }
+    void send_frame(const crow::websocket::encoded_frame &frame) override
+    {
+        if (slow_reader)
+        {
+            crow::websocket::outbound_queue::entry e;
+            e.header = frame.wire;
+            e.cls = frame.cls;
+            enqueue(std::move(e));
+            return;
+        }
+        sent_messages.push_back(frame.payload());
+    }
     void send_text(std::string msg) override
     {
         sent_messages.push_back(msg);
@@ -36,6 +93,7 @@ public:
     {
         closed = true;
         close_reason = msg;
+        close_code = code;
     }
     std::string get_subprotocol() const override
     {
@@ -47,14 +105,90 @@ public:
         return remote_ip_;
     }
 
+    void set_outbound_limits(const crow::websocket::outbound_limits &limits) override
+    {
+        outbound.set_limits(limits);
+    }
+    crow::websocket::outbound_stats get_outbound_stats() override
+    {
+        return outbound.stats();
+    }
+
+    // Simula que el cliente lee los frames encolados en modo slow_reader.
+    void drain()
+    {
+        std::vector<crow::websocket::outbound_queue::entry> in_flight;
+        outbound.take(in_flight);
+        for (const auto &e : in_flight)
+        {
+            auto h = e.header.buffer();
+            std::string wire(static_cast<const char *>(h.data()), h.size());
+            auto b = e.body.buffer();
+            wire.append(static_cast<const char *>(b.data()), b.size());
+
+            uint8_t len = (uint8_t)wire[1] & 0x7f;
+            size_t header_size = len == 126 ? 4 : len == 127 ? 10 : 2;
+            sent_messages.push_back(wire.substr(header_size));
+        }
+        outbound.sent(in_flight);
+    }
+
     bool closed = false;
     std::string close_reason;
+    uint16_t close_code = 0;
     std::vector<std::string> sent_messages;
 
+    // En modo lector lento los frames quedan en la cola hasta llamar drain().
+    bool slow_reader = false;
+    crow::websocket::outbound_queue outbound;
+
 private:
+    void enqueue(crow::websocket::outbound_queue::entry e)
+    {
+        if (outbound.push(std::move(e)) == crow::websocket::outbound_queue::push_result::disconnect)
+        {
+            close("outbound queue overflow", outbound.limits().close_code);
+        }
+    }
+
     std::string remote_ip_;
 };
 
+// Registra la sesión directamente y la enlaza a su conexión, como on_open.
+static void register_session(ConnectionData data)
+{
+    if (data.user_id == UserIdTable::kInvalid) data.user_id = user_ids.intern(data.username);
+    connections.insert_or_assign(data.username, data);
+    if (data.conn)
+    {
+        delete static_cast<ConnectionSession *>(data.conn->userdata());
+        data.conn->userdata(new ConnectionSession{data.username, connections.handle_for(data.username), data.user_id});
+    }
+}
+
+// Conexión que vive en un io_context propio, como las de Crow
+class ContextMockConnection : public MockConnection
+{
+public:
+    ContextMockConnection(const std::string &ip, crow::asio::io_context &ctx)
+        : MockConnection(ip), ctx_(ctx)
+    {
+    }
+
+    crow::asio::io_context *get_io_context() override
+    {
+        return &ctx_;
+    }
+    std::weak_ptr<void> lifetime() override
+    {
+        return anchor_;
+    }
+
+private:
+    crow::asio::io_context &ctx_;
+    std::shared_ptr<void> anchor_ = std::make_shared<int>();
+};
+
 static uint8_t get_opcode(const std::string &data)
 {
     return (uint8_t)data[0];
@@ -130,19 +264,65 @@ void test_on_open_and_duplicate()
     std::cout << "- Duplicado alice rechazado correctamente\n";
 
     // 3) Reconexión: dejar conn_alice a nullptr y reabrir
-    connections["alice"].conn = nullptr;
-    connections["alice"].status = UserStatus::DISCONNECTED;
+    connections.with_session("alice", [](ConnectionData &cd) {
+        cd.conn = nullptr;
+        cd.status = UserStatus::DISCONNECTED;
+    });
     MockConnection conn_alice_re("127.0.0.1");
     WebSocketHandler::on_open(conn_alice_re, "alice");
     // Reconexión
     assert(!conn_alice_re.closed && " on_open: reconexión erroneamente cerrada");
-    assert(connections["alice"].conn == &conn_alice_re && "on_open: reconexión no reusó la misma entry");
-    assert(connections["alice"].status == UserStatus::ACTIVO && "on_open: reconexión no cambió status a ACTIVO");
+    assert(connections.get("alice")->conn == &conn_alice_re && "on_open: reconexión no reusó la misma entry");
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && "on_open: reconexión no cambió status a ACTIVO");
     std::cout << "- Reconexión de alice correcta, estado cambiado a ACTIVO\n";
     
     std::cout << "test_on_open_and_duplicate: Todas las pruebas pasaron\n";
 }
 
+void test_session_binding()
+{
+    std::cout << "test_session_binding\n";
+
+    connections.clear();
+
+    MockConnection conn_alice("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+
+    auto *session = static_cast<ConnectionSession *>(conn_alice.userdata());
+    assert(session && session->handle && "on_open: no se enlazó la sesión a la conexión");
+    assert(session->username == "alice" && "on_open: sesión con nombre incorrecto");
+    assert(session->handle.data->conn == &conn_alice && "on_open: handle no apunta a la entrada de alice");
+    std::cout << "- Sesión enlazada en on_open\n";
+
+    // Conexión sin sesión enlazada: es un remitente desconocido y no se
+    // busca en el registro, aunque su usuario figure en él
+    MockConnection conn_bob("127.0.0.1");
+    auto before = std::chrono::steady_clock::now() - std::chrono::minutes(1);
+    connections.insert_or_assign("bob", ConnectionData{
+        "bob", "uuid-bob", &conn_bob,
+        UserStatus::INACTIVO, before, "127.0.0.1"
+    });
+    std::string data;
+    data.push_back((char)0x03);
+    data.push_back((char)3); data += "bob";
+    data.push_back((char)1);
+    WebSocketHandler::on_message(conn_bob, data, true);
+    assert(!conn_bob.userdata() && "on_message: se enlazó una conexión que no pasó por on_open");
+    auto bob = connections.get("bob");
+    assert(bob->last_active == before && bob->status == UserStatus::INACTIVO && "on_message: el frame se atribuyó a bob");
+    WebSocketHandler::on_close(conn_bob, "Test", 1000);
+    assert(connections.get("bob")->conn == &conn_bob && "on_close: se cerró una sesión no enlazada");
+    std::cout << "- Conexión sin sesión tratada como desconocida\n";
+
+    WebSocketHandler::on_close(conn_alice, "Test", 1000);
+    session = static_cast<ConnectionSession *>(conn_alice.userdata());
+    assert(!session->handle && "on_close: la sesión siguió enlazada");
+    assert(connections.get("alice")->status == UserStatus::DISCONNECTED && "on_close: alice no quedó DISCONNECTED");
+    std::cout << "- Sesión desenlazada en on_close\n";
+
+    std::cout << "test_session_binding: Todas las pruebas pasaron\n";
+}
+
 void test_list_users()
 {
     std::cout << "test_list_users\n";
@@ -157,12 +337,12 @@ void test_list_users()
     std::cout << "- Usuarios alice y bob registrados correctamente\n";
 
     size_t old_count = conn_bob.sent_messages.size();
-    WebSocketHandler::handle_list_users(conn_bob);
+    WebSocketHandler::handle_list_users(conn_bob, "bob");
     assert(conn_bob.sent_messages.size() == old_count + 1 && "handle_list_users no envió nada");
     std::cout << "- Mensaje de lista de usuarios enviado\n";
 
     std::string payload = conn_bob.sent_messages.back();
-    check_opcode(payload, 0x51, "test_list_users");
+    check_opcode(payload, 51, "test_list_users");
 
     size_t offset = 1;
     uint8_t n = (uint8_t)payload[offset++];
@@ -179,31 +359,501 @@ void test_list_users()
     std::cout << "test_list_users: Todas las pruebas pasaron\n";
 }
 
+// Decodifica un payload 51 a pares (nombre, estado), ordenados por nombre.
+static std::vector<std::pair<std::string, uint8_t>> decode_user_list(const std::string &payload)
+{
+    std::vector<std::pair<std::string, uint8_t>> users;
+    FrameReader in(payload);
+    uint8_t count = 0;
+    bool decoded = proto::UserList::decode_header(in, count);
+    assert(decoded && "Encabezado 51 inválido");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        std::string_view name;
+        uint8_t st = 0;
+        decoded = proto::UserEntry::read(in, name, st);
+        assert(decoded && "Entrada 51 truncada");
+        users.emplace_back(std::string(name), st);
+    }
+    assert(in.remaining() == 0 && "Sobran bytes en el payload 51");
+    std::sort(users.begin(), users.end());
+    return users;
+}
+
+void test_user_list_snapshot()
+{
+    std::cout << "test_user_list_snapshot\n";
+    using Users = std::vector<std::pair<std::string, uint8_t>>;
+    auto now = std::chrono::steady_clock::now();
+
+    SessionRegistry registry(4);
+    auto empty = registry.user_list();
+    assert(decode_user_list(empty->payload).empty() && "La lista inicial debe estar vacía");
+
+    registry.insert_or_assign("alice", ConnectionData{"alice", "u1", nullptr, UserStatus::ACTIVO, now, "127.0.0.1"});
+    registry.insert_or_assign("bob", ConnectionData{"bob", "u2", nullptr, UserStatus::OCUPADO, now, "127.0.0.1"});
+    registry.insert_or_assign("carol", ConnectionData{"carol", "u3", nullptr, UserStatus::ACTIVO, now, "127.0.0.1"});
+    auto v1 = registry.user_list();
+    assert(v1->version > empty->version && "Las altas deben subir la versión");
+    assert((decode_user_list(v1->payload) == Users{{"alice", 1}, {"bob", 2}, {"carol", 1}}) && "Altas mal reflejadas");
+    assert(registry.user_list() == v1 && "Sin cambios se debe reutilizar el mismo snapshot");
+    std::cout << "- Altas reflejadas y snapshot compartido entre solicitudes\n";
+
+    // Tocar solo la actividad no cambia el payload.
+    registry.with_session("bob", [](ConnectionData &cd) { cd.last_active = std::chrono::steady_clock::now(); });
+    assert(registry.user_list() == v1 && "Actividad sin cambio de estado no debe crear versión");
+
+    registry.with_session("bob", [](ConnectionData &cd) { cd.status = UserStatus::INACTIVO; });
+    auto v2 = registry.user_list();
+    assert(v2->version > v1->version && "El cambio de estado debe subir la versión");
+    assert((decode_user_list(v2->payload) == Users{{"alice", 1}, {"bob", 3}, {"carol", 1}}) && "Cambio de estado mal parchado");
+    assert((decode_user_list(v1->payload) == Users{{"alice", 1}, {"bob", 2}, {"carol", 1}}) && "Un snapshot publicado no debe cambiar");
+    std::cout << "- Cambio de estado parchado sin tocar snapshots anteriores\n";
+
+    // Baja en el medio: las entradas siguientes se siguen parchando bien.
+    registry.erase_session_if("bob", [](const ConnectionData &) { return true; });
+    registry.with_handle(registry.handle_for("carol"), [](ConnectionData &cd) { cd.status = UserStatus::OCUPADO; });
+    assert((decode_user_list(registry.user_list()->payload) == Users{{"alice", 1}, {"carol", 2}}) && "Baja mal reflejada");
+
+    registry.with_shard("dave", [&](SessionRegistry::SessionMap &sessions) {
+        sessions.emplace("dave", ConnectionData{"dave", "u4", nullptr, UserStatus::ACTIVO, now, "127.0.0.1"});
+    });
+    registry.erase_if([](const ConnectionData &cd) { return cd.username == "alice"; });
+    registry.for_each_mut([](const std::string &, ConnectionData &cd) { cd.status = UserStatus::DISCONNECTED; });
+    assert((decode_user_list(registry.user_list()->payload) == Users{{"carol", 0}, {"dave", 0}}) && "with_shard/erase_if/for_each_mut mal reflejados");
+    std::cout << "- Bajas e inserciones por shard reflejadas\n";
+
+    registry.clear();
+    assert(decode_user_list(registry.user_list()->payload).empty() && "clear debe vaciar la lista");
+
+    // Por el handler: dos solicitudes seguidas comparten el frame codificado.
+    connections.clear();
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::update_status("bob", UserStatus::OCUPADO);
+    WebSocketHandler::handle_list_users(conn_alice, "alice");
+    WebSocketHandler::handle_list_users(conn_bob, "bob");
+    assert(conn_alice.sent_messages.back() == conn_bob.sent_messages.back() && "Ambas solicitudes deben recibir la misma lista");
+    assert((decode_user_list(conn_bob.sent_messages.back()) == Users{{"alice", 1}, {"bob", 2}}) && "El handler debe enviar el snapshot actual");
+    WebSocketHandler::on_close(conn_alice, "cerrado", 1000);
+    WebSocketHandler::handle_list_users(conn_bob, "bob");
+    assert((decode_user_list(conn_bob.sent_messages.back()) == Users{{"alice", 0}, {"bob", 2}}) && "La desconexión debe verse en la lista");
+    connections.clear();
+
+    std::cout << "test_user_list_snapshot: Todas las pruebas pasaron\n";
+}
+
+void test_presence_batching()
+{
+    std::cout << "test_presence_batching\n";
+    using Users = std::vector<std::pair<std::string, uint8_t>>;
+    auto decode_batch = [](const std::string &payload) {
+        Users users;
+        FrameReader in(payload);
+        uint8_t count = 0;
+        bool decoded = proto::PresenceBatch::decode_header(in, count);
+        assert(decoded && "Encabezado 59 inválido");
+        for (uint8_t i = 0; i < count; i++)
+        {
+            std::string_view name;
+            uint8_t st = 0;
+            decoded = proto::UserEntry::read(in, name, st);
+            assert(decoded && "Entrada 59 truncada");
+            users.emplace_back(std::string(name), st);
+        }
+        assert(in.remaining() == 0 && "Sobran bytes en el payload 59");
+        std::sort(users.begin(), users.end());
+        return users;
+    };
+
+    PresenceBatcher batcher;
+    batcher.record("alice", 1);
+    batcher.record("bob", 1);
+    batcher.record("alice", 3);
+    batcher.record("alice", 2);
+    auto payloads = batcher.drain();
+    assert(payloads.size() == 1 && (decode_batch(payloads[0]) == Users{{"alice", 2}, {"bob", 1}}) && "Debe quedar el estado final de cada usuario");
+    assert(batcher.pending() == 0 && "drain debe vaciar la ventana");
+
+    // Ida y vuelta dentro de la ventana: los clientes ya conocen ese estado.
+    batcher.record("alice", 3);
+    batcher.record("alice", 2);
+    payloads = batcher.drain();
+    assert(payloads.empty() && "Una transición que vuelve al estado conocido debe descartarse");
+    batcher.forget("bob");
+    batcher.record("bob", 1);
+    payloads = batcher.drain();
+    assert(payloads.size() == 1 && "Tras forget el estado vuelve a informarse");
+    std::cout << "- Transiciones del mismo usuario colapsadas (" << batcher.collapsed() << ")\n";
+
+    for (int i = 0; i < 300; i++) batcher.record("u" + std::to_string(i), 1);
+    payloads = batcher.drain();
+    assert(payloads.size() == 2 && decode_batch(payloads[0]).size() == 255 && decode_batch(payloads[1]).size() == 45 && "Más de 255 entradas se reparten en varios frames");
+    std::cout << "- Lotes de más de 255 usuarios divididos\n";
+
+    // Por el handler: bob pide lotes, alice sigue con 53/54.
+    connections.clear();
+    presence_batcher.clear();
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::on_message(conn_bob, proto::PresenceMode::encode(1), true);
+    WebSocketHandler::flush_presence();
+    size_t alice_before = conn_alice.sent_messages.size();
+    size_t bob_before = conn_bob.sent_messages.size();
+
+    MockConnection conn_carol("127.0.0.1");
+    WebSocketHandler::on_open(conn_carol, "carol");
+    WebSocketHandler::update_status("carol", UserStatus::OCUPADO);
+    WebSocketHandler::update_status("carol", UserStatus::INACTIVO);
+    assert(conn_alice.sent_messages.size() == alice_before + 2 && "alice debe recibir cada 54 por separado");
+    assert(conn_bob.sent_messages.size() == bob_before && "bob no debe recibir 53/54 sueltos");
+
+    size_t frames = WebSocketHandler::flush_presence();
+    assert(frames == 1 && "Debe armarse un solo frame 59");
+    assert(conn_bob.sent_messages.size() == bob_before + 1 && "bob debe recibir un único lote");
+    assert((decode_batch(conn_bob.sent_messages.back()) == Users{{"carol", 3}}) && "El lote debe traer el estado final de carol");
+    assert(conn_alice.sent_messages.size() == alice_before + 2 && "alice no debe recibir lotes");
+    std::cout << "- Lote entregado solo a quien lo pidió\n";
+
+    WebSocketHandler::on_message(conn_bob, proto::PresenceMode::encode(7), true);
+    assert(get_opcode(conn_bob.sent_messages.back()) == 50 && (uint8_t)conn_bob.sent_messages.back()[1] == 6 && "Modo inválido debe responder error 6");
+    WebSocketHandler::on_message(conn_bob, proto::PresenceMode::encode(0), true);
+    WebSocketHandler::update_status("carol", UserStatus::ACTIVO);
+    assert(get_opcode(conn_bob.sent_messages.back()) == 54 && "Con modo 0 vuelve a recibir 54");
+    std::cout << "- Modo 0 vuelve a la presencia por evento\n";
+
+    connections.clear();
+    presence_batcher.clear();
+    std::cout << "test_presence_batching: Todas las pruebas pasaron\n";
+}
+
+void test_presence_subscriptions()
+{
+    std::cout << "test_presence_subscriptions\n";
+
+    PresenceSubscriptions subs;
+    bool added = subs.subscribe(1, 2);
+    added = subs.subscribe(3, 2) && added;
+    added = subs.subscribe(1, 4) && added;
+    assert(added && "Suscripciones nuevas");
+    added = subs.subscribe(1, 2);
+    assert(!added && "Una suscripción repetida no cambia nada");
+    std::vector<uint32_t> followers;
+    subs.subscribers_of(2, followers);
+    assert((followers == std::vector<uint32_t>{1, 3}) && "Suscriptores de 2");
+    assert(subs.edges() == 3 && subs.is_subscriber(1) && !subs.is_subscriber(2) && "Modo suscripción por usuario");
+    bool removed = subs.unsubscribe(1, 2);
+    assert(removed && !subs.subscribed(1, 2) && subs.subscribed(1, 4) && "unsubscribe quita una arista");
+    subs.remove_subscriber(3);
+    followers.clear();
+    subs.subscribers_of(2, followers);
+    assert(followers.empty() && !subs.is_subscriber(3) && subs.edges() == 1 && "remove_subscriber quita todas sus aristas");
+    std::cout << "- Lista de adyacencia en ambos sentidos\n";
+
+    {
+        PresenceAudience audience;
+        MockConnection c1("127.0.0.1"), c2("127.0.0.1"), c3("127.0.0.1"), c4("127.0.0.1");
+        audience.update(1, &c1, false, false);
+        audience.update(2, &c2, false, false);
+        audience.update(3, &c3, false, true);
+        audience.update(4, &c4, true, false);
+        audience.update(1, nullptr, false, false);
+        std::vector<uint32_t> seen;
+        audience.for_each_global([&](uint32_t user, crow::websocket::connection &) { seen.push_back(user); });
+        assert((seen == std::vector<uint32_t>{2}) && "Global: conectados sin suscripciones ni lotes");
+        seen.clear();
+        audience.for_each_of({1, 2, 3, 4, 9}, [&](uint32_t user, crow::websocket::connection &) { seen.push_back(user); });
+        assert((seen == std::vector<uint32_t>{2, 3}) && "Por ID: conectados que reciben presencia por evento");
+        audience.update(4, &c4, false, false);
+        assert(audience.global_size() == 2 && audience.batched_size() == 0 && "Cambiar de modo mueve la conexión");
+    }
+    std::cout << "- Índice de presencia por ID\n";
+
+    connections.clear();
+    presence_batcher.clear();
+    presence_subscriptions.clear();
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    MockConnection conn_carol("127.0.0.1");
+    MockConnection conn_dave("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::on_open(conn_carol, "carol");
+    WebSocketHandler::on_open(conn_dave, "dave");
+
+    WebSocketHandler::on_message(conn_alice, proto::Subscribe::encode("bob", 1), true);
+    std::string_view name;
+    uint8_t st = 0;
+    bool decoded = proto::UserInfo::decode(conn_alice.sent_messages.back(), name, st);
+    assert(decoded && name == "bob" && st == 1 && "Suscribirse responde con el estado actual");
+    WebSocketHandler::on_message(conn_alice, proto::Subscribe::encode("usuario_que_no_existe", 1), true);
+    assert(get_opcode(conn_alice.sent_messages.back()) == 50 && (uint8_t)conn_alice.sent_messages.back()[1] == 1 && "Usuario desconocido: error 1");
+    WebSocketHandler::on_message(conn_alice, proto::Subscribe::encode("bob", 2), true);
+    assert((uint8_t)conn_alice.sent_messages.back()[1] == 6 && "Acción inválida: error 6");
+
+    size_t alice_before = conn_alice.sent_messages.size();
+    size_t dave_before = conn_dave.sent_messages.size();
+    WebSocketHandler::update_status("carol", UserStatus::OCUPADO);
+    assert(conn_alice.sent_messages.size() == alice_before && "alice no sigue a carol");
+    assert(conn_dave.sent_messages.size() == dave_before + 1 && "dave sin suscripciones recibe todo");
+    WebSocketHandler::update_status("bob", UserStatus::OCUPADO);
+    assert(conn_alice.sent_messages.size() == alice_before + 1 && "alice sigue a bob");
+    decoded = proto::StatusChanged::decode(conn_alice.sent_messages.back(), name, st);
+    assert(decoded && name == "bob" && st == 2 && "54 de bob");
+    const PresenceAudience &audience = connections.presence_audience();
+    assert(audience.global_size() == 3 && "alice suscrita sale de la presencia global");
+    std::cout << "- 54 solo a suscriptores y a clientes sin suscripciones\n";
+
+    // En lotes, cada suscriptor recibe solo los cambios de sus contactos.
+    WebSocketHandler::on_message(conn_alice, proto::PresenceMode::encode(1), true);
+    WebSocketHandler::flush_presence();
+    alice_before = conn_alice.sent_messages.size();
+    WebSocketHandler::update_status("carol", UserStatus::INACTIVO);
+    WebSocketHandler::update_status("bob", UserStatus::ACTIVO);
+    WebSocketHandler::flush_presence();
+    assert(conn_alice.sent_messages.size() == alice_before + 1 && "alice debe recibir un lote");
+    FrameReader in(conn_alice.sent_messages.back());
+    uint8_t count = 0;
+    decoded = proto::PresenceBatch::decode_header(in, count);
+    assert(decoded && count == 1 && "El lote trae solo a bob");
+    decoded = proto::UserEntry::read(in, name, st);
+    assert(decoded && name == "bob" && st == 1 && "Entrada de bob en el lote");
+    assert(audience.batched_size() == 1 && audience.global_size() == 3 && "alice pasa a lotes");
+
+    WebSocketHandler::on_message(conn_alice, proto::Subscribe::encode("bob", 0), true);
+    WebSocketHandler::update_status("bob", UserStatus::OCUPADO);
+    size_t frames = WebSocketHandler::flush_presence();
+    assert(frames == 0 && "Sin contactos no se arma ningún lote");
+    std::cout << "- Lotes filtrados por suscripción\n";
+
+    WebSocketHandler::on_close(conn_dave, "bye", 1000);
+    assert(audience.global_size() == 2 && "La conexión cerrada sale del índice");
+    MockConnection conn_alice_re("127.0.0.1");
+    WebSocketHandler::on_close(conn_alice, "bye", 1000);
+    WebSocketHandler::on_open(conn_alice_re, "alice");
+    assert(audience.global_size() == 2 && audience.batched_size() == 0 && "alice vuelve suscrita y sin lotes");
+    std::cout << "- Índice al día con on_open y on_close\n";
+
+    connections.clear();
+    presence_batcher.clear();
+    presence_subscriptions.clear();
+    std::cout << "test_presence_subscriptions: Todas las pruebas pasaron\n";
+}
+
+void test_rooms()
+{
+    std::cout << "test_rooms\n";
+
+    RoomRegistry registry;
+    uint32_t dev = registry.create("dev", 1, nullptr);
+    assert(dev == 1 && registry.find("dev") == dev && registry.name(dev) == "dev" && "Sala creada con ID denso");
+    uint32_t again = registry.create("dev", 2, nullptr);
+    assert(again == 0 && "Un nombre repetido no crea otra sala");
+    bool joined = registry.join(dev, 3, nullptr);
+    joined = registry.join(dev, 2, nullptr) && joined;
+    bool joined_twice = registry.join(dev, 2, nullptr);
+    assert(joined && !joined_twice && "join idempotente");
+    assert(registry.member_count(dev) == 3 && registry.is_member(dev, 2) && !registry.is_member(dev, 4) && "Miembros de la sala");
+    bool left = registry.leave(dev, 2);
+    bool left_twice = registry.leave(dev, 2);
+    assert(left && !left_twice && !registry.is_member(dev, 2) && "leave quita al miembro");
+    registry.remove_user(3);
+    assert(registry.member_count(dev) == 1 && registry.find("nope") == 0 && "remove_user saca al usuario de sus salas");
+
+    HistoryStore store(64, 32, 4);
+    for (int i = 0; i < 40; i++) store.append_room(dev, "ana", "m" + std::to_string(i));
+    assert(store.room_size(dev) == 32 && "El historial de la sala está acotado");
+    assert(store.private_size(1, 2) == 0 && store.general_size() == 0 && "Las salas no se mezclan con otros chats");
+    std::cout << "- Registro de salas e historial acotado\n";
+
+    connections.clear();
+    rooms.clear();
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    MockConnection conn_carol("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::on_open(conn_carol, "carol");
+
+    std::string_view room, user, text;
+    uint8_t event = 0;
+    WebSocketHandler::on_message(conn_alice, proto::CreateRoom::encode("sala"), true);
+    bool decoded = proto::RoomEvent::decode(conn_alice.sent_messages.back(), room, user, event);
+    assert(decoded && room == "sala" && user == "alice" && event == 1 && "Confirmación de sala creada");
+    WebSocketHandler::on_message(conn_carol, proto::CreateRoom::encode("sala"), true);
+    assert(get_opcode(conn_carol.sent_messages.back()) == 50 && (uint8_t)conn_carol.sent_messages.back()[1] == 8 && "Sala repetida: error 8");
+    WebSocketHandler::on_message(conn_carol, proto::JoinRoom::encode("no_existe"), true);
+    assert((uint8_t)conn_carol.sent_messages.back()[1] == 7 && "Sala inexistente: error 7");
+
+    WebSocketHandler::on_message(conn_bob, proto::JoinRoom::encode("sala"), true);
+    decoded = proto::RoomEvent::decode(conn_alice.sent_messages.back(), room, user, event);
+    assert(decoded && user == "bob" && event == 2 && "Los miembros ven la entrada de bob");
+    decoded = proto::RoomEvent::decode(conn_bob.sent_messages.back(), room, user, event);
+    assert(decoded && user == "bob" && event == 2 && "bob recibe la confirmación");
+
+    size_t carol_before = conn_carol.sent_messages.size();
+    WebSocketHandler::on_message(conn_bob, proto::PostRoom::encode("sala", "hola sala"), true);
+    decoded = proto::RoomMessage::decode(conn_alice.sent_messages.back(), room, user, text);
+    assert(decoded && room == "sala" && user == "bob" && text == "hola sala" && "alice recibe el mensaje de la sala");
+    decoded = proto::RoomMessage::decode(conn_bob.sent_messages.back(), room, user, text);
+    assert(decoded && "bob recibe su propio mensaje");
+    assert(conn_carol.sent_messages.size() == carol_before && "carol no es miembro");
+    WebSocketHandler::on_message(conn_carol, proto::PostRoom::encode("sala", "intruso"), true);
+    assert((uint8_t)conn_carol.sent_messages.back()[1] == 9 && "Publicar sin ser miembro: error 9");
+    std::cout << "- Mensajes entregados solo a los miembros\n";
+
+    // La membresía sobrevive a la desconexión; la entrega sigue a la conexión nueva.
+    size_t bob_before = conn_bob.sent_messages.size();
+    WebSocketHandler::on_close(conn_bob, "bye", 1000);
+    WebSocketHandler::on_message(conn_alice, proto::PostRoom::encode("sala", "sigues ahí?"), true);
+    assert(conn_bob.sent_messages.size() == bob_before && "No se entrega a una conexión cerrada");
+    MockConnection conn_bob2("127.0.0.1");
+    WebSocketHandler::on_open(conn_bob2, "bob");
+    WebSocketHandler::on_message(conn_alice, proto::PostRoom::encode("sala", "de vuelta"), true);
+    decoded = proto::RoomMessage::decode(conn_bob2.sent_messages.back(), room, user, text);
+    assert(decoded && text == "de vuelta" && "bob reconectado sigue en la sala");
+
+    WebSocketHandler::on_message(conn_bob2, proto::GetRoomHistory::encode("sala", 0, 0), true);
+    FrameReader in(conn_bob2.sent_messages.back());
+    uint64_t cursor = 1;
+    uint8_t count = 0;
+    decoded = proto::RoomHistory::decode_header(in, room, cursor, count);
+    assert(decoded && room == "sala" && cursor == 0 && count == 3 && "Historial de la sala");
+    std::string_view author, msg;
+    decoded = proto::HistoryEntry::read(in, author, msg);
+    assert(decoded && author == "bob" && msg == "hola sala" && "El historial va del más antiguo al más nuevo");
+
+    WebSocketHandler::on_message(conn_bob2, proto::LeaveRoom::encode("sala"), true);
+    decoded = proto::RoomEvent::decode(conn_alice.sent_messages.back(), room, user, event);
+    assert(decoded && user == "bob" && event == 3 && "Los miembros ven la salida");
+    decoded = proto::RoomEvent::decode(conn_bob2.sent_messages.back(), room, user, event);
+    assert(decoded && event == 3 && "bob recibe la confirmación de salida");
+    WebSocketHandler::on_message(conn_bob2, proto::LeaveRoom::encode("sala"), true);
+    assert((uint8_t)conn_bob2.sent_messages.back()[1] == 9 && "Salir dos veces: error 9");
+    std::cout << "- Membresía, reconexión e historial de la sala\n";
+
+    connections.clear();
+    rooms.clear();
+    std::cout << "test_rooms: Todas las pruebas pasaron\n";
+}
+
+void test_offline_mailbox()
+{
+    std::cout << "test_offline_mailbox\n";
+
+    using namespace std::chrono_literals;
+    auto t0 = OfflineMailboxes::Clock::now();
+    OfflineMailboxes::Limits limits;
+    limits.max_messages = 3;
+    limits.max_bytes = 1024;
+    limits.max_total_bytes = 1200;
+    limits.ttl = 60s;
+    OfflineMailboxes boxes(limits);
+
+    bool queued = boxes.push(1, "ana", "m1", t0);
+    queued = boxes.push(1, "ana", "m2", t0 + 10s) && queued;
+    queued = boxes.push(1, "ana", "m3", t0 + 20s) && queued;
+    assert(queued && boxes.size(1) == 3 && "Entran los tres primeros");
+    queued = boxes.push(1, "ana", "m4", t0 + 30s);
+    assert(!queued && boxes.size(1) == 3 && "Buzón lleno por cantidad");
+    queued = boxes.push(1, "ana", "m4", t0 + 65s);
+    assert(queued && boxes.size(1) == 3 && "Los vencidos liberan lugar");
+    queued = boxes.push(2, "ana", std::string(255, 'x'), t0);
+    assert(queued && "Entra un mensaje grande");
+    for (int i = 0; i < 3; i++)
+    {
+        queued = boxes.push(3, "ana", std::string(255, 'y'), t0);
+        assert(queued && "Entran bajo el límite por buzón");
+    }
+    queued = boxes.push(4, "ana", std::string(255, 'z'), t0);
+    assert(boxes.size(3) == 3 && !queued && "Límite total de bytes");
+
+    std::string frame = boxes.take(1, t0 + 75s);
+    FrameReader in(frame);
+    uint8_t count = 0;
+    std::string_view author, msg;
+    bool decoded = proto::OfflineMessages::decode_header(in, count);
+    assert(decoded && count == 2 && "Un solo frame sin los vencidos");
+    decoded = proto::HistoryEntry::read(in, author, msg);
+    assert(decoded && author == "ana" && msg == "m3" && "Del más antiguo al más nuevo");
+    decoded = proto::HistoryEntry::read(in, author, msg);
+    assert(decoded && msg == "m4" && in.remaining() == 0);
+    frame = boxes.take(1, t0 + 75s);
+    assert(boxes.size(1) == 0 && frame.empty() && "take vacía el buzón");
+    boxes.drop(2);
+    boxes.drop(3);
+    assert(boxes.total_bytes() == 0 && "Sin buzones no queda memoria contada");
+    std::cout << "- Límites, vencimiento y frame 63\n";
+
+    connections.clear();
+    offline_mailboxes.clear();
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::on_close(conn_bob, "bye", 1000);
+
+    WebSocketHandler::on_message(conn_alice, proto::SendMessage::encode("bob", "hola"), true);
+    WebSocketHandler::on_message(conn_alice, proto::SendMessage::encode("bob", "sigues?"), true);
+    assert(get_opcode(conn_alice.sent_messages.back()) == 55 && "alice recibe su eco, no el error 4");
+    assert(history_store.private_size(user_ids.find("alice"), user_ids.find("bob")) >= 2 && "Los mensajes van al historial igual");
+
+    MockConnection conn_bob2("127.0.0.1");
+    WebSocketHandler::on_open(conn_bob2, "bob");
+    size_t batches = 0;
+    for (const std::string& sent : conn_bob2.sent_messages)
+    {
+        if (get_opcode(sent) != proto::OfflineMessages::opcode) continue;
+        ++batches;
+        FrameReader batch(sent);
+        decoded = proto::OfflineMessages::decode_header(batch, count);
+        assert(decoded && count == 2 && "Los dos mensajes en un frame");
+        decoded = proto::HistoryEntry::read(batch, author, msg);
+        assert(decoded && author == "alice" && msg == "hola");
+        decoded = proto::HistoryEntry::read(batch, author, msg);
+        assert(decoded && msg == "sigues?");
+    }
+    assert(batches == 1 && offline_mailboxes.size(user_ids.find("bob")) == 0 && "Buzón entregado una sola vez al reconectar");
+
+    size_t bob_before = conn_bob2.sent_messages.size();
+    WebSocketHandler::on_message(conn_alice, proto::SendMessage::encode("bob", "en línea"), true);
+    assert(conn_bob2.sent_messages.size() == bob_before + 1 && get_opcode(conn_bob2.sent_messages.back()) == 55 && "En línea se entrega directo");
+    std::cout << "- Entrega en lote al reconectar\n";
+
+    connections.clear();
+    offline_mailboxes.clear();
+    std::cout << "test_offline_mailbox: Todas las pruebas pasaron\n";
+}
+
 void test_handle_get_user_info()
 {
     std::cout << "test_handle_get_user_info\n";
 
     connections.clear();
-    chat_history.clear();
+    history_store.clear();
 
-    connections["alice"] = ConnectionData{
+    connections.insert_or_assign("alice", ConnectionData{
         "alice",
         "uuid-alice",
         nullptr,
         UserStatus::ACTIVO,
         std::chrono::steady_clock::now(),
         "192.168.1.10"
-    };
+    });
 
     MockConnection conn_bob("127.0.0.1");
-    connections["bob"] = ConnectionData{
+    register_session(ConnectionData{
         "bob",
         "uuid-bob",
         &conn_bob,
         UserStatus::ACTIVO,
         std::chrono::steady_clock::now(),
         "127.0.0.1" 
-    };
+    });
     
     std::cout << "- Usuarios alice y bob registrados con estados\n";
 
@@ -224,7 +874,7 @@ void test_handle_get_user_info()
     }
     std::cout << "\n";
 
-    check_opcode(payload, 0x52, "test_handle_get_user_info");
+    check_opcode(payload, 52, "test_handle_get_user_info");
 
     size_t offset = 1;
     std::string name = get_string_8(payload, offset);
@@ -248,7 +898,7 @@ void test_handle_get_user_info()
     assert(conn_bob.sent_messages.size() == old_count + 1 && "Error de usuario no encontrado no fue enviado");
     
     payload = conn_bob.sent_messages.back();
-    check_opcode(payload, 0x50, "test_handle_get_user_info error");
+    check_opcode(payload, 50, "test_handle_get_user_info error");
     assert(payload[1] == 1 && "Código de error incorrecto para usuario no existente");
     std::cout << "- Error de usuario no existente enviado correctamente\n";
 
@@ -260,16 +910,16 @@ void test_handle_change_status()
     std::cout << "test_handle_change_status\n";
 
     connections.clear();
-    chat_history.clear();
+    history_store.clear();
 
     MockConnection conn("127.0.0.1");
-    connections["alice"] = ConnectionData{
+    register_session(ConnectionData{
         "alice",
         "uuid-alice",
         &conn,
         UserStatus::ACTIVO,
         std::chrono::steady_clock::now()
-    };
+    });
 
     auto simulate_status_change = [&](uint8_t new_status_byte, UserStatus expected_status, const std::string &description) {
         std::string data;
@@ -284,12 +934,12 @@ void test_handle_change_status()
             std::cout << "Probando transición: " << description << std::endl;
             WebSocketHandler::on_message(conn, data, true);
 
-            assert(connections["alice"].status == expected_status && ("❌ " + description + ": Estado no actualizado correctamente").c_str());
+            assert(connections.get("alice")->status == expected_status && ("❌ " + description + ": Estado no actualizado correctamente").c_str());
 
             assert(conn.sent_messages.size() > old_count && ("❌ " + description + ": No se notificó cambio de estado").c_str());
 
             std::string payload = conn.sent_messages.back();
-            check_opcode(payload, 0x54, description);
+            check_opcode(payload, 54, description);
 
             size_t offset = 1;
             std::string name = get_string_8(payload, offset);
@@ -319,16 +969,16 @@ void test_inactive_status_not_reactivated_by_non_message_opcode()
     std::cout << "test_inactive_status_not_reactivated_by_non_message_opcode\n";
 
     connections.clear();
-    chat_history.clear();
+    history_store.clear();
 
     MockConnection conn("127.0.0.1");
-    connections["bob"] = ConnectionData{
+    register_session(ConnectionData{
         "bob",
         "uuid-bob",
         &conn,
         UserStatus::INACTIVO,
         std::chrono::steady_clock::now()
-    };
+    });
 
     // Simular mensaje tipo "solicitar lista de usuarios" (opcode 0x01)
     std::string data;
@@ -336,7 +986,7 @@ void test_inactive_status_not_reactivated_by_non_message_opcode()
 
     WebSocketHandler::on_message(conn, data, true);
 
-    assert(connections["bob"].status == UserStatus::INACTIVO && "❌ Estado cambiado a ACTIVO por mensaje no permitido");
+    assert(connections.get("bob")->status == UserStatus::INACTIVO && "❌ Estado cambiado a ACTIVO por mensaje no permitido");
     std::cout << "✅ Estado se mantuvo INACTIVO correctamente\n";
 }
 
@@ -345,16 +995,16 @@ void test_inactive_status_reactivated_by_message_opcode()
     std::cout << "test_inactive_status_reactivated_by_message_opcode\n";
 
     connections.clear();
-    chat_history.clear();
+    history_store.clear();
 
     MockConnection conn("127.0.0.1");
-    connections["bob"] = ConnectionData{
+    register_session(ConnectionData{
         "bob",
         "uuid-bob",
         &conn,
         UserStatus::INACTIVO,
         std::chrono::steady_clock::now()
-    };
+    });
 
     // Simular mensaje privado (opcode 0x04): para "~", contenido "hola"
     std::string data;
@@ -366,29 +1016,213 @@ void test_inactive_status_reactivated_by_message_opcode()
 
     WebSocketHandler::on_message(conn, data, true);
 
-    assert(connections["bob"].status == UserStatus::ACTIVO && "❌ Estado no se reactivó tras enviar mensaje");
+    assert(connections.get("bob")->status == UserStatus::ACTIVO && "❌ Estado no se reactivó tras enviar mensaje");
     std::cout << "✅ Estado INACTIVO se reactivó correctamente al enviar mensaje\n";
 }
 
+void test_frame_reader()
+{
+    std::cout << "test_frame_reader\n";
+
+    // Opcode 4 completo: las cadenas son vistas al frame, sin copias
+    std::string frame;
+    frame.push_back((char)4);
+    frame.push_back((char)1);
+    frame += "~";
+    frame.push_back((char)22);
+    frame += "un mensaje sin copiarse";
+    frame.pop_back();
+
+    size_t before = thread_allocations;
+    FrameReader in(frame, 1);
+    std::string_view destino, mensaje;
+    bool read_ok = in.str8(destino) && in.str8(mensaje);
+    assert(read_ok);
+    assert(thread_allocations == before && "La decodificación no debe reservar memoria");
+    assert(destino == "~" && mensaje == "un mensaje sin copiars");
+    assert(mensaje.data() == frame.data() + 4);
+    assert(in.ok() && in.remaining() == 0);
+
+    // u64 en big endian
+    std::string page("\x00\x00\x00\x00\x00\x00\x01\x02\x07", 9);
+    FrameReader pr(page);
+    uint64_t cursor = 0;
+    uint8_t size = 0;
+    read_ok = pr.u64(cursor);
+    assert(read_ok && cursor == 0x102);
+    read_ok = pr.u8(size);
+    assert(read_ok && size == 7);
+
+    // Un frame truncado deja el error registrado y las lecturas siguientes fallan
+    std::string truncated("\x04\x05~", 3);
+    FrameReader bad(truncated, 1);
+    std::string_view field;
+    uint8_t byte = 0;
+    read_ok = bad.str8(field);
+    assert(!read_ok && field.empty());
+    assert(bad.error() == ParseError::Truncated);
+    read_ok = bad.u8(byte);
+    assert(!read_ok && byte == 0);
+    assert(bad.error() == ParseError::Truncated);
+
+    // Una ráfaga de frames truncados no lanza excepciones ni reserva memoria
+    connections.clear();
+    MockConnection conn_alice("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    size_t history_before = history_store.general_size();
+    std::vector<std::string> malformed = {
+        std::string("\x04", 1),
+        std::string("\x04\x01", 2),
+        std::string("\x04\x01~\x09hola", 7),
+        std::string("\x06\x01~\x00\x00", 5),
+        std::string("\x07\x03", 2),
+    };
+    // Lo que se registra reserva slots del logger la primera vez: se mide sin logs
+    Logger &logger = Logger::getInstance();
+    std::vector<LogLevel> levels;
+    for (size_t c = 0; c < static_cast<size_t>(LogComponent::Count); c++)
+    {
+        levels.push_back(logger.componentLevel(static_cast<LogComponent>(c)));
+        logger.setComponentLevel(static_cast<LogComponent>(c), LogLevel::Error);
+    }
+    WebSocketHandler::on_message(conn_alice, malformed[0], true);
+    before = thread_allocations;
+    for (int round = 0; round < 1000; round++)
+    {
+        for (const auto &m : malformed) WebSocketHandler::on_message(conn_alice, m, true);
+    }
+    assert(thread_allocations == before && "Los frames truncados no deben reservar memoria");
+    for (size_t c = 0; c < levels.size(); c++) logger.setComponentLevel(static_cast<LogComponent>(c), levels[c]);
+    assert(history_store.general_size() == history_before);
+    assert(conn_alice.sent_messages.empty());
+
+    std::cout << "test_frame_reader: Todas las pruebas pasaron\n";
+}
+
+static int schema_calls = 0;
+static std::string schema_last;
+
+static void schema_send_handler(int &ctx, std::string_view to, std::string_view msg)
+{
+    schema_calls += ctx;
+    schema_last = std::string(to) + ":" + std::string(msg);
+}
+
+static void schema_list_handler(int &)
+{
+    schema_calls += 100;
+}
+
+void test_protocol_schema()
+{
+    std::cout << "test_protocol_schema\n";
+
+    // Los codificadores generados producen los mismos bytes que el protocolo
+    assert(proto::ListUsers::encode() == std::string("\x01", 1));
+    assert(proto::SendMessage::encode("~", "hola") == std::string("\x04\x01~\x04hola", 8));
+    assert(proto::ChangeStatus::encode("alice", 2) == std::string("\x03\x05" "alice" "\x02", 8));
+    assert(proto::GetHistoryPage::encode("~", 0x0102, 7) == std::string("\x06\x01~\x00\x00\x00\x00\x00\x00\x01\x02\x07", 12));
+    assert(proto::Error::encode(4) == std::string("\x32\x04", 2));
+    assert(proto::StatusChanged::encode("bob", 3) == std::string("\x36\x03" "bob" "\x03", 6));
+
+    // Una sola reserva del tamaño exacto
+    std::string long_text(200, 'x');
+    std::string encoded = proto::NewMessage::encode("alice", long_text);
+    assert(encoded.size() == proto::NewMessage::size("alice", long_text));
+    assert(encoded.size() == 1 + 1 + 5 + 1 + 200);
+    std::string appended = "prefijo";
+    size_t before = thread_allocations;
+    appended.reserve(appended.size() + proto::NewMessage::size("alice", long_text));
+    proto::NewMessage::append(appended, "alice", long_text);
+    assert(thread_allocations == before + 1);
+
+    // Las cadenas se recortan a 255 bytes y el largo coincide con el contenido
+    std::string huge(300, 'y');
+    std::string_view sender, text;
+    std::string clipped = proto::NewMessage::encode("bob", huge);
+    bool decoded = proto::NewMessage::decode(clipped, sender, text);
+    assert(decoded && sender == "bob" && text.size() == 255);
+
+    // Decodificadores: opcode equivocado, frame truncado o bytes de sobra fallan
+    std::string_view name;
+    uint8_t status = 0;
+    std::string info = proto::UserInfo::encode("carol", 1);
+    decoded = proto::UserInfo::decode(info, name, status);
+    assert(decoded && name == "carol" && status == 1);
+    decoded = proto::UserJoined::decode(proto::UserInfo::encode("carol", 1), name, status);
+    assert(!decoded);
+    decoded = proto::UserInfo::decode(std::string("\x34\x05" "car", 5), name, status);
+    assert(!decoded);
+    decoded = proto::UserInfo::decode(proto::UserInfo::encode("carol", 1) + "!", name, status);
+    assert(!decoded);
+
+    // Respuestas con entradas repetidas: encabezado y luego cada registro
+    std::string list;
+    proto::UserList::append(list, 2);
+    proto::UserEntry::write(list, "alice", 1);
+    proto::UserEntry::write(list, "bob", 2);
+    FrameReader in(list);
+    uint8_t count = 0;
+    decoded = proto::UserList::decode_header(in, count);
+    assert(decoded && count == 2);
+    for (const char *expected : {"alice", "bob"})
+    {
+        decoded = proto::UserEntry::read(in, name, status);
+        assert(decoded && name == expected);
+    }
+    assert(in.remaining() == 0);
+
+    std::string results;
+    proto::SearchResults::append(results, "hola", 1);
+    proto::SearchHit::append(results, "~", 42, "alice", "hola a todos");
+    FrameReader rs(results);
+    std::string_view query, chat, author, body;
+    uint64_t seq = 0;
+    decoded = proto::SearchResults::decode_header(rs, query, count);
+    assert(decoded && query == "hola" && count == 1);
+    decoded = proto::SearchHit::read(rs, chat, seq, author, body);
+    assert(decoded);
+    assert(chat == "~" && seq == 42 && author == "alice" && body == "hola a todos");
+
+    // Tabla de despacho: solo los opcodes con ruta tienen handler
+    using TestDispatcher = proto::Dispatcher<int &>;
+    constexpr TestDispatcher::Table table = TestDispatcher::table<
+        proto::Route<proto::SendMessage, &schema_send_handler>,
+        proto::Route<proto::ListUsers, &schema_list_handler>>();
+    int &calls = schema_calls;
+    std::string &last = schema_last;
+    assert(table[4] && table[1] && !table[0] && !table[2] && !table[50]);
+    int ctx = 1;
+    std::string frame = proto::SendMessage::encode("bob", "hola");
+    FrameReader fr(frame, 1);
+    table[frame[0]](fr, ctx);
+    assert(calls == 1 && last == "bob:hola");
+    std::string truncated("\x04\x03" "bo", 4);
+    FrameReader tr(truncated, 1);
+    table[4](tr, ctx);
+    assert(calls == 1 && tr.error() == ParseError::Truncated && "Un frame truncado no llega al handler");
+
+    std::cout << "test_protocol_schema: Todas las pruebas pasaron\n";
+}
+
 void test_handle_send_message()
 {
     std::cout << "test_handle_send_message\n";
 
     connections.clear();
-    chat_history.clear();
-    general_chat_history.clear();
+    history_store.clear();
 
     MockConnection conn_alice("127.0.0.1");
-    connections["alice"] = ConnectionData{
+    register_session(ConnectionData{
         "alice", "uuid-alice", &conn_alice,
         UserStatus::ACTIVO, std::chrono::steady_clock::now()
-    };
+    });
 
     MockConnection conn_bob("127.0.0.1");
-    connections["bob"] = ConnectionData{
+    register_session(ConnectionData{
         "bob", "uuid-bob", &conn_bob,
         UserStatus::ACTIVO, std::chrono::steady_clock::now()
-    };
+    });
     
     std::cout << "- Usuarios alice y bob registrados\n";
 
@@ -407,7 +1241,7 @@ void test_handle_send_message()
     assert(conn_alice.sent_messages.size() > alice_msgs && "Alice no recibió copia del mensaje enviado");
     
     std::string bob_payload = conn_bob.sent_messages.back();
-    check_opcode(bob_payload, 0x55, "Mensaje a Bob");
+    check_opcode(bob_payload, 55, "Mensaje a Bob");
     
     size_t offset = 1;
     std::string origin = get_string_8(bob_payload, offset);
@@ -427,14 +1261,15 @@ void test_handle_send_message()
     
     assert(conn_alice.sent_messages.size() > alice_msgs && "No se envió error por mensaje vacío");
     std::string error_msg = conn_alice.sent_messages.back();
-    assert(get_opcode(error_msg) == 0x50 && error_msg[1] == 3 && "Error incorrecto para mensaje vacío");
+    assert(get_opcode(error_msg) == 50 && error_msg[1] == 3 && "Error incorrecto para mensaje vacío");
     std::cout << "- Error por mensaje vacío enviado correctamente\n";
     
-    // Test 3: Destinatario desconectado (error)
-    connections["charlie"] = ConnectionData{
+    // Test 3: Destinatario desconectado (se guarda en su buzón)
+    offline_mailboxes.clear();
+    connections.insert_or_assign("charlie", ConnectionData{
         "charlie", "uuid-charlie", nullptr,
         UserStatus::DISCONNECTED, std::chrono::steady_clock::now()
-    };
+    });
     
     data.clear();
     data.push_back((char)0x04);              // Enviar mensaje
@@ -444,10 +1279,24 @@ void test_handle_send_message()
     alice_msgs = conn_alice.sent_messages.size();
     WebSocketHandler::on_message(conn_alice, data, true);
     
-    assert(conn_alice.sent_messages.size() > alice_msgs && "No se envió error por destinatario desconectado");
+    assert(conn_alice.sent_messages.size() > alice_msgs && "alice no recibió el eco del mensaje encolado");
+    assert(get_opcode(conn_alice.sent_messages.back()) == 55 && "Destinatario desconectado: ya no hay error 4");
+    assert(offline_mailboxes.size(user_ids.find("charlie")) == 1 && "El mensaje quedó en el buzón de charlie");
+    std::cout << "- Mensaje a destinatario desconectado guardado en su buzón\n";
+
+    data.clear();
+    data.push_back((char)0x04);              // Enviar mensaje
+    data.push_back((char)4); data += "dave";    // Destinatario desconocido
+    data.push_back((char)4); data += "hola";    // Mensaje
+
+    alice_msgs = conn_alice.sent_messages.size();
+    WebSocketHandler::on_message(conn_alice, data, true);
+
+    assert(conn_alice.sent_messages.size() > alice_msgs && "No se envió error por destinatario desconocido");
     error_msg = conn_alice.sent_messages.back();
-    assert(get_opcode(error_msg) == 0x50 && error_msg[1] == 4 && "Error incorrecto para destinatario desconectado");
-    std::cout << "- Error por destinatario desconectado enviado correctamente\n";
+    assert(get_opcode(error_msg) == 50 && error_msg[1] == 4 && "Error incorrecto para destinatario desconocido");
+    std::cout << "- Error por destinatario desconocido enviado correctamente\n";
+    offline_mailboxes.clear();
     
     // Test 4: Mensaje al chat general
     data.clear();
@@ -462,10 +1311,10 @@ void test_handle_send_message()
     
     assert(conn_alice.sent_messages.size() > alice_msgs && "Alice no recibió mensaje del chat general");
     assert(conn_bob.sent_messages.size() > bob_msgs && "Bob no recibió mensaje del chat general");
-    assert(general_chat_history.size() == 1 && "Mensaje no agregado al historial del chat general");
+    assert(history_store.general_size() == 1 && "Mensaje no agregado al historial del chat general");
     
     std::string general_msg = conn_bob.sent_messages.back();
-    check_opcode(general_msg, 0x55, "Mensaje al chat general");
+    check_opcode(general_msg, 55, "Mensaje al chat general");
     
     offset = 1;
     origin = get_string_8(general_msg, offset);
@@ -488,7 +1337,7 @@ void test_handle_send_message()
     
     assert(conn_bob.sent_messages.size() > bob_msgs && "Bob no recibió mensaje largo");
     std::string truncated_msg = conn_bob.sent_messages.back();
-    check_opcode(truncated_msg, 0x55, "Mensaje truncado");
+    check_opcode(truncated_msg, 55, "Mensaje truncado");
     
     offset = 1;
     origin = get_string_8(truncated_msg, offset);
@@ -500,36 +1349,205 @@ void test_handle_send_message()
     std::cout << "test_handle_send_message: Todas las pruebas pasaron\n";
 }
 
+void test_shared_frame_fanout()
+{
+    std::cout << "test_shared_frame_fanout\n";
+
+    connections.clear();
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    MockConnection conn_carol("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::on_open(conn_carol, "carol");
+    MockConnection *recipients[] = {&conn_alice, &conn_bob, &conn_carol};
+    for (MockConnection *conn : recipients) conn->slow_reader = true;
+
+    // Un mensaje al chat general se codifica una vez: cada cola guarda una
+    // referencia al mismo buffer, no una copia ni un encabezado propio.
+    std::string text(100, 'z');  // payload < 126 bytes: encabezado de 2
+    WebSocketHandler::on_message(conn_alice, proto::SendMessage::encode("~", text), true);
+
+    std::vector<crow::websocket::outbound_queue::entry> queued[3];
+    for (int i = 0; i < 3; i++)
+    {
+        recipients[i]->outbound.take(queued[i]);
+        assert(queued[i].size() == 1 && "Cada destinatario encola un solo frame");
+    }
+    const crow::websocket::shared_payload &wire = queued[0][0].header.shared;
+    assert(wire && queued[0][0].body.size() == 0 && "El frame completo va en un único buffer compartido");
+    assert(queued[1][0].header.shared == wire && queued[2][0].header.shared == wire && "Los destinatarios comparten los mismos bytes");
+    assert(wire.use_count() == 3 && "Solo las colas retienen el frame");
+    assert(wire->size() == 2 + proto::NewMessage::size("alice", text) && "Encabezado y payload codificados juntos");
+    for (int i = 0; i < 3; i++) recipients[i]->outbound.sent(queued[i]);
+    std::cout << "- Un frame codificado, referenciado por " << wire.use_count() << " colas\n";
+
+    connections.clear();
+    std::cout << "test_shared_frame_fanout: Todas las pruebas pasaron\n";
+}
+
+void test_fanout_executor_batches()
+{
+    std::cout << "test_fanout_executor_batches\n";
+
+    crow::asio::io_context ctx_a;
+    crow::asio::io_context ctx_b;
+    ContextMockConnection conn_a1("127.0.0.1", ctx_a);
+    ContextMockConnection conn_a2("127.0.0.1", ctx_a);
+    ContextMockConnection conn_b1("127.0.0.1", ctx_b);
+    MockConnection conn_inline("127.0.0.1");
+
+    std::vector<FanoutTarget> targets = {
+        FanoutExecutor::target_for(conn_a1),
+        FanoutExecutor::target_for(conn_a2),
+        FanoutExecutor::target_for(conn_b1),
+        FanoutExecutor::target_for(conn_inline),
+    };
+
+    uint64_t batches_before = FanoutExecutor::getInstance().batches_posted();
+    SharedFrame frame(std::string("\x37\x01x\x02hi", 6));
+    FanoutExecutor::getInstance().deliver(frame, targets);
+
+    assert(FanoutExecutor::getInstance().batches_posted() == batches_before + 2 && "Debe publicarse una tarea por io_context");
+    assert(conn_inline.sent_messages.size() == 1 && "La conexión sin io_context debe recibir en línea");
+    assert(conn_a1.sent_messages.empty() && conn_b1.sent_messages.empty() && "La entrega debe ocurrir en el hilo del io_context");
+    std::cout << "- Una tarea por io_context, entrega en línea sin io_context\n";
+
+    ctx_a.run();
+    ctx_b.run();
+    assert(conn_a1.sent_messages.size() == 1 && conn_a2.sent_messages.size() == 1 && conn_b1.sent_messages.size() == 1 && "Faltan entregas");
+    assert(conn_a1.sent_messages[0] == frame.payload() && "Payload entregado incorrecto");
+    std::cout << "- Todos los destinatarios recibieron el frame al correr su io_context\n";
+
+    std::cout << "test_fanout_executor_batches: Todas las pruebas pasaron\n";
+}
+
+void test_slow_consumer_policies()
+{
+    std::cout << "test_slow_consumer_policies\n";
+    using crow::websocket::frame_class;
+    using crow::websocket::overflow_policy;
+
+    auto presence = [](const std::string &name) {
+        return crow::websocket::encode_frame(0x2, std::string("\x36", 1) + (char)name.size() + name + '\x01', frame_class::presence);
+    };
+    auto data = [](const std::string &text) {
+        return crow::websocket::encode_frame(0x2, text);
+    };
+
+    // drop_oldest: el cliente ve los frames más recientes
+    {
+        MockConnection conn("127.0.0.1");
+        conn.slow_reader = true;
+        conn.set_outbound_limits({0, 2, overflow_policy::drop_oldest, 1008});
+        conn.send_frame(data("a"));
+        conn.send_frame(data("b"));
+        conn.send_frame(data("c"));
+        assert(conn.get_outbound_stats().queued_messages == 2 && "La cola no respeta el límite de mensajes");
+        assert(conn.get_outbound_stats().dropped_messages == 1 && "Debe contarse el frame descartado");
+        conn.drain();
+        assert(conn.sent_messages.size() == 2 && conn.sent_messages[0] == "b" && conn.sent_messages[1] == "c" && "drop_oldest debe descartar el más antiguo");
+        assert(!conn.closed && "drop_oldest no debe desconectar");
+        assert(conn.get_outbound_stats().queued_messages == 0 && "La cola debe quedar vacía tras drain");
+        std::cout << "- drop_oldest conserva los frames más recientes\n";
+    }
+
+    // drop_presence: primero se descarta presencia, luego se desconecta
+    {
+        MockConnection conn("127.0.0.1");
+        conn.slow_reader = true;
+        conn.set_outbound_limits({0, 3, overflow_policy::drop_presence, 4000});
+        conn.send_frame(presence("bob"));
+        conn.send_frame(data("m1"));
+        conn.send_frame(presence("carol"));
+        conn.send_frame(data("m2"));
+        conn.send_frame(presence("dave"));
+        assert(!conn.closed && "No debe desconectar mientras haya presencia que descartar");
+        assert(conn.get_outbound_stats().dropped_messages == 2 && "Deben descartarse solo frames de presencia");
+        conn.send_frame(data("m3"));
+        conn.drain();
+        assert(conn.sent_messages.size() == 3 && conn.sent_messages[0] == "m1" && conn.sent_messages[1] == "m2" && conn.sent_messages[2] == "m3" && "Los mensajes no deben perderse");
+        std::cout << "- drop_presence descarta presencia y conserva mensajes\n";
+
+        conn.send_frame(data("m4"));
+        conn.send_frame(data("m5"));
+        conn.send_frame(data("m6"));
+        conn.send_frame(data("m7"));
+        assert(conn.closed && conn.close_code == 4000 && "Debe desconectar cuando solo hay mensajes en la cola");
+        assert(conn.get_outbound_stats().overflowed && "Debe marcarse el desbordamiento");
+        std::cout << "- drop_presence desconecta con el código configurado\n";
+    }
+
+    // disconnect: límite en bytes
+    {
+        MockConnection conn("127.0.0.1");
+        conn.slow_reader = true;
+        conn.set_outbound_limits({16, 0, overflow_policy::disconnect, 1008});
+        conn.send_frame(data("12345678"));
+        assert(!conn.closed && "Un frame que cabe no debe desconectar");
+        conn.send_frame(data("12345678"));
+        assert(conn.closed && conn.close_code == 1008 && "Debe desconectar al exceder el límite de bytes");
+        std::cout << "- disconnect cierra al exceder el límite de bytes\n";
+    }
+
+    // on_open aplica los límites configurados y list_users muestra la cola
+    {
+        connections.clear();
+        crow::websocket::outbound_limits previous = WebSocketHandler::get_outbound_limits();
+        WebSocketHandler::set_outbound_limits({0, 4, overflow_policy::drop_presence, 1008});
+
+        MockConnection slow("127.0.0.1");
+        slow.slow_reader = true;
+        WebSocketHandler::on_open(slow, "slowpoke");
+        slow.drain();
+        slow.sent_messages.clear();
+        for (int i = 0; i < 10; i++)
+        {
+            WebSocketHandler::notify_user_status_change("slowpoke", i % 2 ? UserStatus::OCUPADO : UserStatus::ACTIVO);
+        }
+        assert(!slow.closed && "La presencia no debe desconectar a un lector lento");
+        assert(slow.get_outbound_stats().queued_messages == 4 && "La cola debe quedar en el límite");
+        assert(slow.get_outbound_stats().dropped_messages == 6 && "Deben descartarse los cambios de estado que no caben");
+        assert(WebSocketHandler::list_users().find("cola=4 msgs") != std::string::npos && "list_users debe mostrar la profundidad de la cola");
+        std::cout << "- on_open aplica los límites y list_users muestra la cola\n";
+
+        WebSocketHandler::set_outbound_limits(previous);
+        connections.clear();
+    }
+
+    std::cout << "test_slow_consumer_policies: Todas las pruebas pasaron\n";
+}
+
 void test_handle_get_history()
 {
     std::cout << "test_handle_get_history\n";
 
     connections.clear();
-    chat_history.clear();
-    general_chat_history.clear();
+    history_store.clear();
 
     MockConnection conn_alice("127.0.0.1");
-    connections["alice"] = ConnectionData{
+    register_session(ConnectionData{
         "alice", "uuid-alice", &conn_alice,
         UserStatus::ACTIVO, std::chrono::steady_clock::now()
-    };
+    });
 
     MockConnection conn_bob("127.0.0.1");
-    connections["bob"] = ConnectionData{
+    register_session(ConnectionData{
         "bob", "uuid-bob", &conn_bob,
         UserStatus::ACTIVO, std::chrono::steady_clock::now()
-    };
+    });
     
     std::cout << "- Usuarios alice y bob registrados\n";
 
     // Agregar mensajes al historial privado
-    std::string chat_id = (std::string("alice") < "bob") ? "alice|bob" : "bob|alice";
-    chat_history[chat_id].push_back({"alice", "hola"});
-    chat_history[chat_id].push_back({"bob", "respuesta"});
+    uint32_t alice_id = user_ids.intern("alice");
+    uint32_t bob_id = user_ids.intern("bob");
+    history_store.append_private(alice_id, bob_id, "alice", "hola");
+    history_store.append_private(bob_id, alice_id, "bob", "respuesta");
     
     // Agregar mensajes al chat general
-    general_chat_history.push_back({"alice", "mensaje general 1"});
-    general_chat_history.push_back({"bob", "mensaje general 2"});
+    history_store.append_general("alice", "mensaje general 1");
+    history_store.append_general("bob", "mensaje general 2");
     
     std::cout << "- Historial de chat privado y general inicializado\n";
 
@@ -544,7 +1562,7 @@ void test_handle_get_history()
 
     assert(conn_alice.sent_messages.size() > alice_msgs && "No se envió historial de chat privado");
     std::string history_payload = conn_alice.sent_messages.back();
-    check_opcode(history_payload, 0x56, "Historial de chat privado");
+    check_opcode(history_payload, 56, "Historial de chat privado");
 
     size_t offset = 1;
     uint8_t num = (uint8_t)history_payload[offset++];
@@ -568,7 +1586,7 @@ void test_handle_get_history()
 
     assert(conn_alice.sent_messages.size() > alice_msgs && "No se envió historial de chat general");
     history_payload = conn_alice.sent_messages.back();
-    check_opcode(history_payload, 0x56, "Historial de chat general");
+    check_opcode(history_payload, 56, "Historial de chat general");
 
     offset = 1;
     num = (uint8_t)history_payload[offset++];
@@ -592,7 +1610,7 @@ void test_handle_get_history()
 
     assert(conn_alice.sent_messages.size() > alice_msgs && "No se envió respuesta para historial inexistente");
     history_payload = conn_alice.sent_messages.back();
-    check_opcode(history_payload, 0x56, "Historial inexistente");
+    check_opcode(history_payload, 56, "Historial inexistente");
 
     offset = 1;
     num = (uint8_t)history_payload[offset++];
@@ -602,6 +1620,813 @@ void test_handle_get_history()
     std::cout << "test_handle_get_history: Todas las pruebas pasaron\n";
 }
 
+void test_history_store()
+{
+    std::cout << "test_history_store\n";
+
+    history_store.clear();
+    connections.clear();
+
+    MockConnection conn_alice("127.0.0.1");
+    register_session(ConnectionData{
+        "alice", "uuid-alice", &conn_alice,
+        UserStatus::ACTIVO, std::chrono::steady_clock::now(), "127.0.0.1"
+    });
+
+    // Con más de 255 mensajes el 56 debe traer los más recientes
+    for (int i = 0; i < 300; i++)
+    {
+        history_store.append_general("alice", "m" + std::to_string(i));
+    }
+    std::string data;
+    data.push_back((char)5);
+    data.push_back((char)1); data += "~";
+    WebSocketHandler::on_message(conn_alice, data, true);
+
+    std::string payload = conn_alice.sent_messages.back();
+    check_opcode(payload, 56, "Historial con más de 255 mensajes");
+    size_t offset = 1;
+    uint8_t num = (uint8_t)payload[offset++];
+    assert(num == 255 && "Debe devolver 255 mensajes");
+    get_string_8(payload, offset);
+    std::string first = get_string_8(payload, offset);
+    assert(first == "m45" && "El primer mensaje debe ser el más antiguo de los últimos 255");
+    std::string last;
+    for (int i = 1; i < num; i++)
+    {
+        get_string_8(payload, offset);
+        last = get_string_8(payload, offset);
+    }
+    assert(last == "m299" && "El último mensaje debe ser el más reciente");
+    assert(offset == payload.size() && "Payload con bytes de más");
+    std::cout << "- El 56 devuelve los 255 mensajes más recientes en orden\n";
+
+    // La capacidad es fija: los mensajes viejos se descartan
+    HistoryStore small(64, 32, 4);
+    for (int i = 0; i < 100; i++)
+    {
+        small.append_private(2, 1, i % 2 ? "alice" : "bob", std::to_string(i));
+    }
+    auto messages = small.private_messages(1, 2);
+    assert(small.private_size(2, 1) == 32 && messages.size() == 32 && "El buffer privado no respeta su capacidad");
+    assert(messages.front().second == "68" && messages.back().second == "99" && "Se deben conservar los más recientes");
+    assert(small.private_size(1, 3) == 0 && "Una conversación sin mensajes debe estar vacía");
+    std::cout << "- Los buffers privados conservan solo los últimos mensajes\n";
+
+    // Lecturas concurrentes con escrituras: nunca ven mensajes rotos
+    std::atomic<bool> done{false};
+    std::atomic<bool> torn{false};
+    std::thread reader([&] {
+        while (!done.load())
+        {
+            std::string out;
+            small.write_general(out, 64);
+            size_t off = 0;
+            while (off < out.size())
+            {
+                std::string author = get_string_8(out, off);
+                std::string text = get_string_8(out, off);
+                if (text != std::string(text.size(), author[0])) torn = true;
+            }
+        }
+    });
+    for (int i = 0; i < 20000; i++)
+    {
+        std::string author(1, (char)('a' + i % 26));
+        small.append_general(author, std::string(1 + i % 200, author[0]));
+    }
+    done = true;
+    reader.join();
+    assert(!torn && "Un lector vio un mensaje a medio escribir");
+    assert(small.general_size() == 64 && "El buffer general no respeta su capacidad");
+    std::cout << "- Las lecturas concurrentes no ven mensajes a medio escribir\n";
+
+    history_store.clear();
+    connections.clear();
+    std::cout << "test_history_store: Todas las pruebas pasaron\n";
+}
+
+// Pide una página con el opcode 6 y devuelve los mensajes y el cursor siguiente
+static std::vector<std::string> request_history_page(MockConnection &conn, const std::string &chat, uint64_t cursor, uint8_t page_size, uint64_t &next_cursor)
+{
+    std::string data;
+    data.push_back((char)6);
+    data.push_back((char)chat.size());
+    data += chat;
+    for (int i = 7; i >= 0; i--) data.push_back((char)((cursor >> (8 * i)) & 0xFF));
+    data.push_back((char)page_size);
+    WebSocketHandler::on_message(conn, data, true);
+
+    std::string payload = conn.sent_messages.back();
+    check_opcode(payload, 57, "Página de historial");
+    size_t offset = 1;
+    std::string page_chat = get_string_8(payload, offset);
+    assert(page_chat == chat && "La página debe indicar el chat");
+    next_cursor = 0;
+    for (int i = 0; i < 8; i++) next_cursor = (next_cursor << 8) | (uint8_t)payload[offset++];
+    uint8_t count = (uint8_t)payload[offset++];
+    std::vector<std::string> texts;
+    for (int i = 0; i < count; i++)
+    {
+        get_string_8(payload, offset);
+        texts.push_back(get_string_8(payload, offset));
+    }
+    assert(offset == payload.size() && "Página con bytes de más");
+    return texts;
+}
+
+void test_history_paging()
+{
+    std::cout << "test_history_paging\n";
+
+    history_store.clear();
+    connections.clear();
+    MockConnection conn_alice("127.0.0.1");
+    register_session(ConnectionData{
+        "alice", "uuid-alice", &conn_alice,
+        UserStatus::ACTIVO, std::chrono::steady_clock::now(), "127.0.0.1"
+    });
+
+    // 1000 mensajes: más de lo que cabe en un 56
+    for (int i = 1; i <= 1000; i++)
+    {
+        history_store.append_general("alice", std::to_string(i));
+    }
+
+    uint64_t cursor = 0;
+    auto page = request_history_page(conn_alice, "~", 0, 100, cursor);
+    assert(page.size() == 100 && page.front() == "901" && page.back() == "1000" && "La primera página debe ser la más reciente");
+    assert(cursor == 901 && "El cursor debe apuntar al mensaje más antiguo de la página");
+
+    // Recorrer todo hacia atrás
+    size_t total = page.size();
+    std::string oldest;
+    while (cursor != 0)
+    {
+        page = request_history_page(conn_alice, "~", cursor, 255, cursor);
+        total += page.size();
+        oldest = page.front();
+    }
+    assert(total == 1000 && oldest == "1" && "El recorrido debe cubrir todo el historial");
+    std::cout << "- Se recorren 1000 mensajes por páginas\n";
+
+    // Tamaño 0 usa el valor por defecto; el chat privado vacío devuelve una página vacía
+    page = request_history_page(conn_alice, "~", 0, 0, cursor);
+    assert(page.size() == 50 && "El tamaño de página por defecto es 50");
+    page = request_history_page(conn_alice, "nadie", 0, 10, cursor);
+    assert(page.empty() && cursor == 0 && "Una conversación vacía no tiene páginas");
+
+    // Un cursor más viejo que lo retenido devuelve una página vacía
+    HistoryStore small(64, 32, 4);
+    for (int i = 0; i < 200; i++) small.append_general("a", std::to_string(i));
+    std::string out;
+    auto p = small.write_general_page(out, 10, 20);
+    assert(p.count == 0 && !p.has_older() && "Los mensajes descartados no deben devolverse");
+    p = small.write_general_page(out, 0, 100);
+    assert(p.count == 64 && p.first_seq == 137 && !p.has_older() && "Solo se devuelven los mensajes retenidos");
+    std::cout << "- Cursores fuera del buffer y páginas vacías\n";
+
+    history_store.clear();
+    connections.clear();
+    std::cout << "test_history_paging: Todas las pruebas pasaron\n";
+}
+
+struct SearchResult {
+    std::string chat;
+    uint64_t seq;
+    std::string author;
+    std::string text;
+};
+
+static std::vector<SearchResult> request_search(MockConnection &conn, const std::string &query, uint8_t max_results)
+{
+    std::string data;
+    data.push_back((char)7);
+    data.push_back((char)query.size());
+    data += query;
+    data.push_back((char)max_results);
+    WebSocketHandler::on_message(conn, data, true);
+
+    std::string payload = conn.sent_messages.back();
+    check_opcode(payload, 58, "Resultados de búsqueda");
+    size_t offset = 1;
+    std::string echoed = get_string_8(payload, offset);
+    assert(echoed == query && "La respuesta debe repetir la consulta");
+    uint8_t count = (uint8_t)payload[offset++];
+    std::vector<SearchResult> results;
+    for (int i = 0; i < count; i++)
+    {
+        SearchResult r;
+        r.chat = get_string_8(payload, offset);
+        r.seq = 0;
+        for (int k = 0; k < 8; k++) r.seq = (r.seq << 8) | (uint8_t)payload[offset++];
+        r.author = get_string_8(payload, offset);
+        r.text = get_string_8(payload, offset);
+        results.push_back(r);
+    }
+    assert(offset == payload.size() && "Resultados con bytes de más");
+    return results;
+}
+
+void test_search()
+{
+    std::cout << "test_search\n";
+
+    history_store.clear();
+    search_index.clear();
+    connections.clear();
+    MockConnection conn_alice("127.0.0.1"), conn_bob("127.0.0.2"), conn_carol("127.0.0.3");
+    for (auto [name, conn] : {std::make_pair("alice", &conn_alice), std::make_pair("bob", &conn_bob), std::make_pair("carol", &conn_carol)})
+    {
+        register_session(ConnectionData{
+            name, std::string("uuid-") + name, conn,
+            UserStatus::ACTIVO, std::chrono::steady_clock::now(), "127.0.0.1"
+        });
+    }
+
+    auto send = [](MockConnection &conn, const std::string &to, const std::string &text) {
+        std::string data;
+        data.push_back((char)4);
+        data.push_back((char)to.size());
+        data += to;
+        data.push_back((char)text.size());
+        data += text;
+        WebSocketHandler::on_message(conn, data, true);
+    };
+    send(conn_alice, "~", "Reunion de equipo a las cinco");
+    send(conn_bob, "~", "alguien tiene el informe?");
+    send(conn_alice, "bob", "el informe secreto esta listo");
+    send(conn_carol, "~", "la REUNION se movio");
+    assert(search_index.size() == 4 && "Cada mensaje enviado debe indexarse");
+
+    // Sin distinguir mayúsculas, del más nuevo al más viejo
+    auto results = request_search(conn_bob, "reunion", 0);
+    assert(results.size() == 2 && "Deben encontrarse ambas menciones");
+    assert(results[0].author == "carol" && results[0].text == "la REUNION se movio" && "Primero el más reciente");
+    assert(results[1].chat == "~" && results[1].author == "alice" && results[1].seq == 1 && "La secuencia es la del historial");
+    std::cout << "- Búsqueda sin distinguir mayúsculas en el chat general\n";
+
+    // Los privados solo los ven sus participantes, con el chat del otro participante
+    results = request_search(conn_bob, "informe", 0);
+    assert(results.size() == 2 && results[0].chat == "alice" && results[0].author == "alice" && "bob ve su privado con alice");
+    results = request_search(conn_alice, "secreto", 0);
+    assert(results.size() == 1 && results[0].chat == "bob" && "alice ve su privado con bob");
+    results = request_search(conn_carol, "informe", 0);
+    assert(results.size() == 1 && results[0].chat == "~" && "carol no debe ver privados ajenos");
+    std::cout << "- Las conversaciones privadas quedan acotadas a sus participantes\n";
+
+    // Límite de resultados, subcadenas sin coincidencia y consultas cortas
+    results = request_search(conn_alice, "informe", 1);
+    assert(results.size() == 1 && results[0].text == "el informe secreto esta listo" && "Se respeta el máximo pedido");
+    results = request_search(conn_alice, "informes", 0);
+    assert(results.empty() && "Sin coincidencias la lista queda vacía");
+    std::string data = {(char)7, (char)2, 'e', 'l', (char)0};
+    WebSocketHandler::on_message(conn_alice, data, true);
+    check_opcode(conn_alice.sent_messages.back(), 50, "Error");
+    assert(conn_alice.sent_messages.back()[1] == 5 && "Una consulta de menos de 3 bytes debe dar error 5");
+    std::cout << "- Límite, consultas sin resultados y consultas cortas\n";
+
+    // Índice acotado: al llenarse se descarta el segmento más antiguo
+    SearchIndex small(4, 2);
+    for (int i = 1; i <= 10; i++) small.add(SearchIndex::kGeneral, i, 1, "mensaje " + std::to_string(i));
+    assert(small.size() == 6 && "Solo se retienen max_segments segmentos");
+    auto hits = small.search("mensaje", 1, 100);
+    assert(hits.size() == 6 && hits.front().seq == 10 && hits.back().seq == 5 && "Se descartan los mensajes más antiguos");
+    std::cout << "- El índice descarta los segmentos más antiguos\n";
+
+    history_store.clear();
+    search_index.clear();
+    connections.clear();
+    std::cout << "test_search: Todas las pruebas pasaron\n";
+}
+
+void test_user_ids()
+{
+    std::cout << "test_user_ids\n";
+
+    UserIdTable ids;
+    uint32_t alice = ids.intern("alice");
+    uint32_t bob = ids.intern("bob");
+    assert(alice == 1 && bob == 2 && "Los IDs deben ser densos y empezar en 1");
+    uint32_t alice_again = ids.intern("alice");
+    assert(alice_again == alice && ids.find("bob") == bob && "Un usuario debe conservar su ID");
+    assert(ids.find("carol") == UserIdTable::kInvalid && "find no debe asignar IDs");
+    assert(ids.name(bob) == "bob" && "name debe resolver el ID");
+    std::cout << "- IDs densos y estables\n";
+
+    // Vistas a un frame que después se reutiliza: la tabla guarda su copia
+    std::string frame = "xdave-y";
+    uint32_t dave = ids.intern(std::string_view(frame).substr(1, 4));
+    frame.assign(64, 'z');
+    for (int i = 0; i < 100; i++) ids.intern("u" + std::to_string(i));
+    uint32_t dave_found = ids.find(std::string_view("dave"));
+    assert(dave_found == dave && ids.name(dave) == "dave" && "La llave no debe apuntar a la vista recibida");
+    std::cout << "- Búsquedas por vista sin copiar el nombre\n";
+
+    assert(HistoryStore::conversation_key(alice, bob) == HistoryStore::conversation_key(bob, alice) && "La llave debe ser simétrica");
+    assert(HistoryStore::conversation_key(alice, bob) == ((uint64_t)1 << 32 | 2) && "La llave debe empacar (min, max)");
+
+    // Muchas conversaciones en el mapa abierto (fuerza varios rehash)
+    HistoryStore store(64, 32, 4);
+    for (uint32_t a = 1; a <= 40; a++)
+    {
+        for (uint32_t b = a; b <= 40; b++)
+        {
+            store.append_private(a, b, "u", std::to_string(a) + "-" + std::to_string(b));
+        }
+    }
+    for (uint32_t a = 1; a <= 40; a++)
+    {
+        for (uint32_t b = 1; b <= 40; b++)
+        {
+            auto messages = store.private_messages(a, b);
+            std::string expected = std::to_string(std::min(a, b)) + "-" + std::to_string(std::max(a, b));
+            assert(messages.size() == 1 && messages[0].second == expected && "Conversación perdida en el mapa");
+        }
+    }
+    assert(store.private_size(0, 1) == 0 && "El ID 0 no es válido");
+    std::cout << "- Conversaciones indexadas por par de IDs\n";
+
+    // on_open asigna el ID y lo guarda en la sesión
+    connections.clear();
+    MockConnection conn("127.0.0.1");
+    WebSocketHandler::on_open(conn, "zed");
+    uint32_t zed = user_ids.find("zed");
+    assert(zed != UserIdTable::kInvalid && connections.get("zed")->user_id == zed && "on_open debe asignar el ID");
+    assert(static_cast<ConnectionSession *>(conn.userdata())->user_id == zed && "La sesión debe guardar el ID");
+    connections.clear();
+    std::cout << "- on_open asigna el ID del usuario\n";
+
+    std::cout << "test_user_ids: Todas las pruebas pasaron\n";
+}
+
+void test_message_log()
+{
+    std::cout << "test_message_log\n";
+    namespace fs = std::filesystem;
+
+    fs::path dir = fs::temp_directory_path() / ("test_message_log_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+
+    std::vector<std::string> replayed;
+    auto collect = [&](const LogRecord &r) {
+        replayed.push_back(std::to_string((int)r.kind) + ":" + std::string(r.author) + ">" + std::string(r.recipient) + ":" + std::string(r.text));
+    };
+
+    // Escritura y recuperación
+    {
+        MessageLog log;
+        size_t recovered = log.open(dir.string(), collect);
+        assert(recovered == 0 && "Un log nuevo no tiene registros");
+        log.append_general("alice", "hola a todos");
+        uint64_t seq = log.append_private("bob", "alice", "hola alice");
+        bool durable = log.flush(seq);
+        assert(durable && log.durable_seq() >= seq && "flush debe esperar a que el registro esté en disco");
+    }
+    {
+        MessageLog log;
+        size_t recovered = log.open(dir.string(), collect);
+        assert(recovered == 2 && "Deben recuperarse los dos registros");
+        assert(replayed[0] == "0:alice>:hola a todos" && replayed[1] == "1:bob>alice:hola alice" && "Registros recuperados incorrectos");
+    }
+    std::cout << "- Los mensajes sobreviven a un reinicio\n";
+
+    // Group commit: muchos registros, pocos fdatasync
+    {
+        MessageLog log;
+        log.open(dir.string());
+        uint64_t last = 0;
+        for (int i = 0; i < 1000; i++) last = log.append_general("carol", "m" + std::to_string(i));
+        log.flush(last);
+        assert(log.sync_count() < 1000 && "Los registros deben sincronizarse por lotes");
+        std::cout << "- 1000 registros en " << log.sync_count() << " fdatasync\n";
+    }
+
+    // Cola incompleta: se descarta y se puede seguir agregando
+    fs::path segment = dir / "00000001.wal";
+    auto size_before = fs::file_size(segment);
+    {
+        std::ofstream f(segment, std::ios::binary | std::ios::app);
+        f.write("\x20\x00\x00\x00\x01\x02", 6);
+    }
+    {
+        MessageLog log;
+        replayed.clear();
+        size_t recovered = log.open(dir.string(), collect);
+        assert(recovered == 1002 && "La cola corrupta no debe afectar los registros válidos");
+        assert(fs::file_size(segment) == size_before && "La cola corrupta debe truncarse");
+        log.flush(log.append_general("dave", "después del corte"));
+    }
+    {
+        MessageLog log;
+        replayed.clear();
+        size_t recovered = log.open(dir.string(), collect);
+        assert(recovered == 1003 && replayed.back() == "0:dave>:después del corte" && "Falta el registro escrito tras truncar");
+    }
+    std::cout << "- Una escritura interrumpida se descarta al abrir\n";
+    fs::remove_all(dir);
+
+    // Rotación de segmentos
+    {
+        MessageLog::Options options;
+        options.segment_bytes = 256;
+        options.commit_window = std::chrono::milliseconds(0);
+        MessageLog log;
+        log.open(dir.string(), nullptr, options);
+        for (int i = 0; i < 50; i++) log.flush(log.append_general("erin", std::to_string(i)));
+        assert(log.segment_index() > 1 && "Debe abrirse más de un segmento");
+    }
+    {
+        MessageLog log;
+        replayed.clear();
+        size_t recovered = log.open(dir.string(), collect);
+        assert(recovered == 50 && "Deben leerse todos los segmentos");
+        assert(replayed.front() == "0:erin>:0" && replayed.back() == "0:erin>:49" && "Los segmentos deben leerse en orden");
+    }
+    std::cout << "- Los segmentos rotan y se recuperan en orden\n";
+
+    // Una escritura fallida no se da por durable (el segmento 2 es /dev/full)
+    {
+        MessageLog::Options options;
+        options.commit_window = std::chrono::milliseconds(0);
+        fs::path full = dir / "00000099.wal";
+        fs::create_symlink("/dev/full", full);
+        MessageLog log;
+        log.open(dir.string(), nullptr, options);
+        uint64_t seq = log.append_general("gina", "sin espacio");
+        bool durable = log.flush(seq);
+        assert(!durable && log.durable_seq() < seq && log.write_errors() > 0 && "flush debe informar el error de escritura");
+        log.close();
+        fs::remove(full);
+    }
+    std::cout << "- Un error de escritura se informa y no avanza durable_seq\n";
+
+    // El historial en memoria se reconstruye desde el log
+    history_store.clear();
+    user_ids.clear();
+    size_t restored = WebSocketHandler::restore_history(dir.string());
+    assert(restored == 50 && "restore_history debe cargar el log");
+    assert(history_store.general_size() == 50 && "El historial general no se restauró");
+    WebSocketHandler::send_private_message("frank", "nadie", "x");  // destinatario desconocido: no se registra
+    message_log.close();
+    std::cout << "- restore_history reconstruye el historial\n";
+
+    history_store.clear();
+    fs::remove_all(dir);
+    std::cout << "test_message_log: Todas las pruebas pasaron\n";
+}
+
+void test_session_snapshot()
+{
+    std::cout << "test_session_snapshot\n";
+    namespace fs = std::filesystem;
+
+    fs::path path = fs::temp_directory_path() / ("test_sessions_" + std::to_string(::getpid()) + ".snap");
+    connections.clear();
+    last_user_status.clear();
+
+    // alice conectada y OCUPADA, bob desconectado (antes INACTIVO), carol ya
+    // eliminada del registro: su sesión venció y no se guarda
+    MockConnection conn_alice("10.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    connections.with_session("alice", [](ConnectionData &cd) { cd.status = UserStatus::OCUPADO; });
+    std::string alice_uuid = connections.get("alice")->uuid;
+
+    MockConnection conn_bob("10.0.0.2");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    connections.with_session("bob", [](ConnectionData &cd) { cd.status = UserStatus::INACTIVO; });
+    WebSocketHandler::on_close(conn_bob, "bye", 1000);
+    {
+        std::lock_guard<std::mutex> lock(last_user_status_mutex);
+        last_user_status["carol"] = UserStatus::OCUPADO;
+    }
+
+    bool saved = WebSocketHandler::save_snapshot(path.string());
+    assert(saved && "No se pudo escribir el snapshot");
+    std::vector<SessionRecord> records;
+    bool loaded = SessionSnapshot::load(path.string(), records);
+    assert(loaded && records.size() == 2 && "El snapshot debe tener solo las sesiones vigentes");
+    for (const auto &r : records)
+    {
+        assert(r.username != "carol" && "Una sesión vencida no debe guardarse");
+        if (r.username == "alice") assert(r.status == UserStatus::OCUPADO && r.uuid == alice_uuid && r.ip_address == "10.0.0.1" && "Datos de alice incorrectos");
+        if (r.username == "bob") assert(r.status == UserStatus::INACTIVO && "bob debe guardarse con su estado previo");
+    }
+    std::cout << "- Snapshot escrito con " << records.size() << " usuarios\n";
+
+    // Reinicio: el registro y los estados se pierden y se cargan del snapshot
+    connections.clear();
+    last_user_status.clear();
+    size_t restored = WebSocketHandler::load_snapshot(path.string());
+    assert(restored == 2 && "No se cargó el snapshot");
+
+    MockConnection conn_alice_re("10.0.0.3");
+    WebSocketHandler::on_open(conn_alice_re, "alice");
+    assert(connections.get("alice")->status == UserStatus::OCUPADO && "alice debe volver con su estado previo");
+    assert(connections.get("alice")->uuid == alice_uuid && "alice debe conservar su UUID");
+    std::cout << "- Un usuario que vuelve tras reiniciar conserva estado y UUID\n";
+
+    // Las sesiones restauradas vencen a los 5 minutos de su última actividad
+    {
+        using namespace std::chrono;
+        int64_t now_ms = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        int64_t retention_ms = duration_cast<milliseconds>(minutes(5)).count();
+        std::vector<SessionRecord> aged = {
+            {"viejo", "uuid-viejo", UserStatus::OCUPADO, "10.0.0.9", now_ms - retention_ms - 1000},
+            {"justo", "uuid-justo", UserStatus::ACTIVO, "10.0.0.8", now_ms - retention_ms + 150},
+            {"nuevo", "uuid-nuevo", UserStatus::ACTIVO, "10.0.0.7", now_ms},
+        };
+        bool written = SessionSnapshot::write(path.string(), aged);
+        assert(written);
+        connections.clear();
+        restored = WebSocketHandler::load_snapshot(path.string());
+        assert(restored == 2 && "Una sesión vencida no se restaura");
+        {
+            std::lock_guard<std::mutex> lock(last_user_status_mutex);
+            assert(last_user_status["viejo"] == UserStatus::OCUPADO && "El estado del vencido se conserva");
+        }
+
+        std::this_thread::sleep_for(milliseconds(300));
+        saved = WebSocketHandler::save_snapshot(path.string());
+        loaded = SessionSnapshot::load(path.string(), records);
+        assert(saved && loaded);
+        bool nuevo_saved = false;
+        for (const auto &r : records)
+        {
+            assert(r.username != "viejo" && r.username != "justo" && "La restaurada que venció no se vuelve a escribir");
+            nuevo_saved = nuevo_saved || r.username == "nuevo";
+        }
+        assert(nuevo_saved && "La restaurada vigente debe seguir en el snapshot");
+
+        MockConnection conn_justo("10.0.0.8");
+        WebSocketHandler::on_open(conn_justo, "justo");
+        assert(connections.get("justo")->uuid != "uuid-justo" && "Una sesión vencida no conserva su UUID");
+    }
+    std::cout << "- Las sesiones restauradas vencen como las del registro\n";
+
+    // Un snapshot corrupto se ignora
+    {
+        std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(6);
+        f.put('\x7f');
+    }
+    loaded = SessionSnapshot::load(path.string(), records);
+    assert(!loaded && "Un snapshot corrupto no debe cargarse");
+    restored = WebSocketHandler::load_snapshot(path.string());
+    assert(restored == 0 && "load_snapshot debe ignorar un archivo corrupto");
+    std::cout << "- Un snapshot corrupto se descarta\n";
+
+    fs::remove(path);
+    connections.clear();
+    last_user_status.clear();
+    std::cout << "test_session_snapshot: Todas las pruebas pasaron\n";
+}
+
+void test_logger()
+{
+    std::cout << "test_logger\n";
+    Logger &logger = Logger::getInstance();
+    logger.flush();
+    std::uintmax_t start = std::filesystem::file_size("server_logs.txt");
+
+    // Varios productores a la vez: no se pierde ni se reordena nada por hilo
+    const int threads = 4, per_thread = 2000;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; t++)
+    {
+        producers.emplace_back([t] {
+            for (int i = 0; i < per_thread; i++)
+            {
+                Logger::getInstance().log("logtest " + std::to_string(t) + " " + std::to_string(i));
+            }
+        });
+    }
+    for (auto &p : producers) p.join();
+    logger.flush();
+
+    std::ifstream in("server_logs.txt");
+    in.seekg(static_cast<std::streamoff>(start));
+    std::string line;
+    std::vector<int> next(threads, 0);
+    int total = 0;
+    while (std::getline(in, line))
+    {
+        size_t at = line.find("] logtest ");
+        if (at == std::string::npos) continue;
+        assert(line[0] == '[' && at == 20 && "Cada línea lleva el prefijo [YYYY-MM-DD HH:MM:SS]");
+        int t = 0, i = 0;
+        std::sscanf(line.c_str() + at + 10, "%d %d", &t, &i);
+        assert(i == next[t] && "Las líneas de un hilo deben salir en orden");
+        next[t]++;
+        total++;
+    }
+    assert(total == threads * per_thread && "Todas las líneas deben escribirse");
+    std::cout << "- " << total << " líneas de " << threads << " hilos, en orden por hilo\n";
+
+    // Sin consumidor y con política Drop las líneas que no caben se descartan
+    logger.stopLogging();
+    logger.setOverflowPolicy(Logger::OverflowPolicy::Drop);
+    logger.setThreadBufferCapacity(8);
+    uint64_t dropped = logger.droppedMessages();
+    std::thread([] {
+        for (int i = 0; i < 100; i++) Logger::getInstance().log("droptest " + std::to_string(i));
+    }).join();
+    assert(logger.droppedMessages() - dropped == 92 && "Solo caben 8 líneas en el buffer");
+
+    start = std::filesystem::file_size("server_logs.txt");
+    logger.startLogging();
+    logger.stopLogging();
+    in.close();
+    in.open("server_logs.txt");
+    in.seekg(static_cast<std::streamoff>(start));
+    int kept = 0;
+    bool reported = false;
+    while (std::getline(in, line))
+    {
+        if (line.find("] droptest ") != std::string::npos) kept++;
+        if (line.find("92 mensajes descartados") != std::string::npos) reported = true;
+    }
+    assert(kept == 8 && reported && "Se escriben las líneas retenidas y se informa lo descartado");
+    std::cout << "- Política Drop con buffer lleno\n";
+
+    logger.setOverflowPolicy(Logger::OverflowPolicy::Block);
+    logger.setThreadBufferCapacity(4096);
+    logger.startLogging();
+    std::cout << "test_logger: Todas las pruebas pasaron\n";
+}
+
+void test_log_levels()
+{
+    std::cout << "test_log_levels\n";
+    Logger &logger = Logger::getInstance();
+
+    assert(logger.configure("warn,chat=debug") && "Especificación válida");
+    assert(!logger.enabled(LogLevel::Info, LogComponent::Server) && logger.enabled(LogLevel::Warn, LogComponent::Server));
+    assert(logger.enabled(LogLevel::Debug, LogComponent::Chat) && "El componente puede tener su propio nivel");
+    assert(!logger.configure("info,nadie=debug") && !logger.configure("verbose") && "Nombres desconocidos se rechazan");
+    assert(logger.componentLevel(LogComponent::Server) == LogLevel::Warn && "Una especificación inválida no cambia nada");
+    std::cout << "- Niveles globales y por componente\n";
+
+    // Los argumentos no se evalúan si el nivel está deshabilitado
+    int evaluated = 0;
+    auto expensive = [&evaluated] {
+        evaluated++;
+        return std::string("niveltest");
+    };
+    LOG_DEBUG(Server, "{}", expensive());
+    LOG_INFO(Presence, "{}", expensive());
+    assert(evaluated == 0 && "Un nivel deshabilitado no debe armar el mensaje");
+    logger.flush();
+    std::uintmax_t start = std::filesystem::file_size("server_logs.txt");
+    LOG_WARN(Presence, "{}", expensive());
+    LOG_DEBUG(Chat, "{}", expensive());
+    assert(evaluated == 2);
+    logger.flush();
+
+    std::ifstream in("server_logs.txt");
+    in.seekg(static_cast<std::streamoff>(start));
+    std::string line;
+    std::vector<std::string> found;
+    while (std::getline(in, line))
+    {
+        if (line.find("niveltest") != std::string::npos) found.push_back(line.substr(line.find("] ") + 2));
+    }
+    assert(found.size() == 2 && found[0] == "WARN presence: niveltest" && found[1] == "DEBUG chat: niveltest" &&
+           "Cada línea lleva nivel y componente");
+    std::cout << "- Los mensajes solo se arman si el nivel está habilitado\n";
+
+    logger.setLevel(LogLevel::Debug);
+    std::cout << "test_log_levels: Todas las pruebas pasaron\n";
+}
+
+void test_binary_log()
+{
+    std::cout << "test_binary_log\n";
+    Logger &logger = Logger::getInstance();
+    std::filesystem::remove("server_logs.bin");
+
+    logger.setOutputFormat(Logger::OutputFormat::Binary);
+    auto before = std::chrono::system_clock::now();
+    LOG_INFO(Chat, "bintest de {} a {}: {} bytes, ok={}", "alice", std::string("bob"), 42, true);
+    LOG_WARN(Storage, "bintest negativo {} y {}", -7, 2.5);
+    logger.log("bintest plano");
+    logger.flush();
+    logger.setOutputFormat(Logger::OutputFormat::Text);
+
+    std::ifstream in("server_logs.bin", std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    logfmt::Reader reader(data);
+    logfmt::Reader::Line line;
+    std::vector<std::string> texts;
+    size_t all = 0;
+    while (reader.next(line))
+    {
+        all++;
+        std::string text;
+        logfmt::append_tag(text, *line.format);
+        logfmt::format_message(line.format->format, line.args, text);
+        if (text.find("bintest") == std::string::npos) continue;
+        texts.push_back(text);
+
+        auto wall = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(line.wall_ns)));
+        assert(wall >= before - std::chrono::seconds(1) && wall <= std::chrono::system_clock::now() &&
+               "La hora se reconstruye desde el reloj monotónico");
+        if (texts.size() == 1)
+        {
+            assert(line.format->file == "test_server.cpp" && line.args.size() == 4 && "El descriptor guarda archivo y argumentos");
+            assert(line.args[2].type == logfmt::ArgType::Int && line.args[2].i == 42);
+        }
+    }
+    assert(reader.error().empty() && "El archivo debe decodificarse completo");
+    assert(texts.size() == 3 && texts[0] == "INFO chat: bintest de alice a bob: 42 bytes, ok=true" &&
+           texts[1] == "WARN storage: bintest negativo -7 y 2.5" && texts[2] == "bintest plano" &&
+           "Los mensajes decodificados deben coincidir con el modo texto");
+    std::cout << "- Mensajes binarios decodificados con su formato\n";
+
+    // Un registro cortado al final se informa
+    logfmt::Reader truncated(std::string_view(data.data(), data.size() - 3));
+    size_t decoded = 0;
+    while (truncated.next(line)) decoded++;
+    assert(decoded == all - 1 && !truncated.error().empty() && "Un final truncado se detecta");
+    std::cout << "- Archivo truncado\n";
+
+    std::filesystem::remove("server_logs.bin");
+    std::cout << "test_binary_log: Todas las pruebas pasaron\n";
+}
+
+static std::vector<std::string> rotated_logs(const std::string &suffix)
+{
+    std::vector<std::string> names;
+    for (const auto &entry : std::filesystem::directory_iterator("."))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("server_logs-", 0) == 0 && name.size() > suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            names.push_back(name);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+void test_log_rotation()
+{
+    std::cout << "test_log_rotation\n";
+    Logger &logger = Logger::getInstance();
+    for (const auto &name : rotated_logs(".txt.gz")) std::filesystem::remove(name);
+
+    // Por tamaño: 200 líneas de ~100 bytes con un límite de 4 KiB
+    logger.setRotation(4096, std::chrono::seconds(0), 3);
+    std::string filler(80, 'r');
+    for (int i = 0; i < 200; i++)
+    {
+        logger.log("rotacion " + std::to_string(i) + " " + filler);
+        if (i % 20 == 19) logger.flush();
+    }
+    logger.flush();
+    logger.rotate();
+    logger.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    logger.waitForCompression();
+
+    auto compressed = rotated_logs(".txt.gz");
+    assert(compressed.size() == 3 && "Solo se conservan los 3 comprimidos más recientes");
+    assert(rotated_logs(".txt").empty() && "Los rotados se borran al comprimirlos");
+    assert(std::filesystem::file_size("server_logs.txt") < 4096 && "El archivo actual se reinicia al rotar");
+
+    // El más reciente contiene las últimas líneas, legibles con zlib
+    gzFile gz = gzopen(compressed.back().c_str(), "rb");
+    assert(gz && "El rotado debe ser un gzip válido");
+    std::string content;
+    char buf[4096];
+    int n;
+    while ((n = gzread(gz, buf, sizeof(buf))) > 0) content.append(buf, n);
+    gzclose(gz);
+    assert(content.find("rotacion 199 ") != std::string::npos && "El último rotado tiene las últimas líneas");
+    std::cout << "- Rotación por tamaño, compresión y archivos conservados\n";
+
+    // Por antigüedad
+    logger.setRotation(0, std::chrono::seconds(1), 3);
+    logger.rotate();
+    logger.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    logger.waitForCompression();
+    std::string newest = rotated_logs(".txt.gz").back();
+    logger.log("rotacion por tiempo");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1300));
+    logger.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    logger.waitForCompression();
+    assert(rotated_logs(".txt.gz").back() != newest && "Se rota al cumplirse la antigüedad máxima");
+    std::cout << "- Rotación por antigüedad\n";
+
+    logger.setRotation(64 * 1024 * 1024, std::chrono::hours(24), 10);
+    for (const auto &name : rotated_logs(".txt.gz")) std::filesystem::remove(name);
+    std::cout << "test_log_rotation: Todas las pruebas pasaron\n";
+}
+
 void test_user_disconnection()
 {
     std::cout << "test_user_disconnection\n";
@@ -615,8 +2440,8 @@ void test_user_disconnection()
     MockConnection conn_bob("127.0.0.1");
     WebSocketHandler::on_open(conn_bob, "bob");
     
-    assert(connections["alice"].status == UserStatus::ACTIVO && "Estado inicial de alice incorrecto");
-    assert(connections["bob"].status == UserStatus::ACTIVO && "Estado inicial de bob incorrecto");
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && "Estado inicial de alice incorrecto");
+    assert(connections.get("bob")->status == UserStatus::ACTIVO && "Estado inicial de bob incorrecto");
     std::cout << "- Usuarios alice y bob registrados como ACTIVOS\n";
     
     // Limpiar mensajes anteriores
@@ -627,27 +2452,27 @@ void test_user_disconnection()
     WebSocketHandler::on_close(conn_alice, "Test disconnection", 1000);
     
     // Verificar que alice está marcada como DISCONNECTED
-    assert(connections["alice"].status == UserStatus::DISCONNECTED && "alice no cambió a DISCONNECTED");
-    assert(connections["alice"].conn == nullptr && "Puntero conn de alice no se estableció a nullptr");
+    assert(connections.get("alice")->status == UserStatus::DISCONNECTED && "alice no cambió a DISCONNECTED");
+    assert(connections.get("alice")->conn == nullptr && "Puntero conn de alice no se estableció a nullptr");
     std::cout << "- Estado de alice cambiado a DISCONNECTED y puntero anulado\n";
     
-    // Verificar que bob recibió notificación 0x54 (cambio de estado)
+    // Verificar que bob recibió notificación 54 (cambio de estado)
     bool notification_received = false;
     for (const auto& msg : conn_bob.sent_messages) {
-        if (get_opcode(msg) == 0x54) {  // Notificación de cambio de estado
+        if (get_opcode(msg) == 54) {  // Notificación de cambio de estado
             size_t offset = 1;
             std::string name = get_string_8(msg, offset);
             uint8_t status = (uint8_t)msg[offset];
             
             if (name == "alice" && status == 0) {  // 0 = DISCONNECTED
                 notification_received = true;
-                std::cout << "- Bob recibió notificación 0x54 de desconexión de alice\n";
+                std::cout << "- Bob recibió notificación 54 de desconexión de alice\n";
                 break;
             }
         }
     }
     
-    assert(notification_received && "Bob no recibió notificación 0x54 de desconexión");
+    assert(notification_received && "Bob no recibió notificación 54 de desconexión");
     
     // Intentar enviar mensaje a usuario desconectado
     std::string data;
@@ -660,17 +2485,17 @@ void test_user_disconnection()
     size_t old_count = conn_bob.sent_messages.size();
     WebSocketHandler::on_message(conn_bob, data, true);
     
-    assert(conn_bob.sent_messages.size() > old_count && "No se envió error por destinatario desconectado");
-    std::string error_msg = conn_bob.sent_messages.back();
-    assert(get_opcode(error_msg) == 0x50 && error_msg[1] == 4 && "Error incorrecto para destinatario desconectado");
-    std::cout << "- Error enviado por mensaje a usuario desconectado\n";
+    assert(conn_bob.sent_messages.size() > old_count && "bob no recibió el eco del mensaje encolado");
+    assert(get_opcode(conn_bob.sent_messages.back()) == 55 && "Destinatario desconectado: el mensaje se encola, sin error 4");
+    std::cout << "- Mensaje a usuario desconectado guardado en su buzón\n";
     
     // Probar reconexión
     MockConnection conn_alice_re("127.0.0.1");
     WebSocketHandler::on_open(conn_alice_re, "alice");
+    assert(get_opcode(conn_alice_re.sent_messages.front()) == 63 && "alice recibe el buzón al reconectar");
     
-    assert(connections["alice"].status == UserStatus::ACTIVO && "Reconexión no cambia estado a ACTIVO");
-    assert(connections["alice"].conn == &conn_alice_re && "Puntero conn no actualizado en reconexión");
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && "Reconexión no cambia estado a ACTIVO");
+    assert(connections.get("alice")->conn == &conn_alice_re && "Puntero conn no actualizado en reconexión");
     std::cout << "- Reconexión exitosa, estado cambiado a ACTIVO\n";
     
     std::cout << "test_user_disconnection: Todas las pruebas pasaron\n";
@@ -681,7 +2506,7 @@ void test_message_size_limit()
     std::cout << "test_message_size_limit\n";
     
     connections.clear();
-    chat_history.clear();
+    history_store.clear();
     
     // Crear usuarios para la prueba
     MockConnection conn_alice("127.0.0.1");
@@ -707,7 +2532,7 @@ void test_message_size_limit()
     assert(conn_bob.sent_messages.size() > bob_msgs && "Bob no recibió mensaje de longitud exacta");
     
     std::string msg_payload = conn_bob.sent_messages.back();
-    check_opcode(msg_payload, 0x55, "Mensaje exacto");
+    check_opcode(msg_payload, 55, "Mensaje exacto");
     
     size_t offset = 1;
     std::string sender = get_string_8(msg_payload, offset);
@@ -732,7 +2557,7 @@ void test_message_size_limit()
     assert(conn_bob.sent_messages.size() > bob_msgs && "Bob no recibió mensaje truncado");
     
     msg_payload = conn_bob.sent_messages.back();
-    check_opcode(msg_payload, 0x55, "Mensaje truncado");
+    check_opcode(msg_payload, 55, "Mensaje truncado");
     
     offset = 1;
     sender = get_string_8(msg_payload, offset);
@@ -755,7 +2580,7 @@ void test_keep_status()
     // Simular primera conexión de Alice
     MockConnection conn_alice("127.0.0.1");
     WebSocketHandler::on_open(conn_alice, "alice");
-    assert(connections["alice"].status == UserStatus::ACTIVO && "Estado incorrecto al conectar por primera vez");
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && "Estado incorrecto al conectar por primera vez");
     std::cout << "- Primera conexión de alice: estado ACTIVO\n";
 
     // Cambiar estado de Alice a OCUPADO
@@ -765,20 +2590,20 @@ void test_keep_status()
     data += "alice";             // Nombre usuario
     data.push_back((char)2);     // OCUPADO
     WebSocketHandler::on_message(conn_alice, data, true);
-    assert(connections["alice"].status == UserStatus::OCUPADO && "Cambio de estado fallido");
+    assert(connections.get("alice")->status == UserStatus::OCUPADO && "Cambio de estado fallido");
     std::cout << "- Estado cambiado a OCUPADO\n";
 
     // Simular desconexión de Alice
     WebSocketHandler::on_close(conn_alice, "Cerrando", 1000);
     assert(last_user_status["alice"] == UserStatus::OCUPADO && "Estado no guardado al desconectar");
-    assert(connections["alice"].status == UserStatus::DISCONNECTED && "Estado no cambiado a DISCONNECTED");
+    assert(connections.get("alice")->status == UserStatus::DISCONNECTED && "Estado no cambiado a DISCONNECTED");
     std::cout << "- Desconexión: estado guardado y cambiado a DISCONNECTED\n";
 
     // Simular reconexión de Alice
     MockConnection conn_alice_re("127.0.0.1");
     WebSocketHandler::on_open(conn_alice_re, "alice");
     // Según el protocolo, al reconectar debe volver a ACTIVO, no importa el estado anterior
-    assert(connections["alice"].status == UserStatus::ACTIVO && "Estado no restaurado a ACTIVO al reconectar");
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && "Estado no restaurado a ACTIVO al reconectar");
     std::cout << "- Reconexión: estado restaurado a ACTIVO\n";
 
     std::cout << "test_keep_status: Todas las pruebas pasaron\n";
@@ -802,47 +2627,31 @@ void test_inactivity()
     WebSocketHandler::on_open(conn_alice, "alice");
     
     // Verificar estado inicial
-    assert(connections["alice"].status == UserStatus::ACTIVO && "Estado inicial incorrecto");
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && "Estado inicial incorrecto");
     std::cout << "- Usuario alice inicialmente ACTIVO\n";
     
     // Forzar manualmente el timestamp de última actividad para que parezca inactivo
+    connections.with_session("alice", [](ConnectionData &cd) {
+        cd.last_active = std::chrono::steady_clock::now() - std::chrono::seconds(70);
+    });
+
+    // Solo se revisan los plazos vencidos: el de alice se programó en on_open
+    // y todavía no llega, aunque last_active sea antiguo.
+    size_t early = WebSocketHandler::expire_inactive(std::chrono::steady_clock::now());
+    assert(early == 0);
+    assert(connections.get("alice")->status == UserStatus::ACTIVO);
+
+    // Un minuto después el plazo vence y alice pasa a INACTIVO
+    size_t marked = WebSocketHandler::expire_inactive(std::chrono::steady_clock::now() + std::chrono::seconds(61));
+    assert(marked == 1 && "Se esperaba un único usuario marcado como INACTIVO");
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        // Retroceder el tiempo de última actividad para simular inactividad
-        connections["alice"].last_active = std::chrono::steady_clock::now() - std::chrono::seconds(70);
-    }
-
-    // Llamar directamente al código que verifica inactividad
-    {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        auto now = std::chrono::steady_clock::now();
-        for (auto& [username, conn_data] : connections) {
-            if (conn_data.status != UserStatus::INACTIVO) {
-                auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-                    now - conn_data.last_active).count();
-                
-                if (elapsed >= 60) {
-                    conn_data.status = UserStatus::INACTIVO;
-                    std::cout << "  Usuario " + username + " marcado como INACTIVO (inactivo por " 
-                        + std::to_string(elapsed) + "s)\n";
-                    
-                    {
-                        std::lock_guard<std::mutex> lock(inactivity_mutex);
-                        user_marked_inactive = true;
-                    }
-                    inactivity_cv.notify_all();
-                }
-            }
-        }
+        std::lock_guard<std::mutex> lock(inactivity_mutex);
+        assert(user_marked_inactive);
     }
     
-    // Esperar brevemente para asegurar que el cambio de estado se ha propagado
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    
     // Verificar que Alice haya sido marcada como INACTIVO
     {
-        std::lock_guard<std::mutex> lock(connections_mutex);
-        assert(connections["alice"].status == UserStatus::INACTIVO && 
+        assert(connections.get("alice")->status == UserStatus::INACTIVO && 
                "Usuario no fue marcado como INACTIVO tras inactividad");
     }
     
@@ -857,13 +2666,121 @@ void test_inactivity()
     WebSocketHandler::on_message(conn_alice, data, true);
     
     // Verificar que el estado se actualizó a ACTIVO
-    assert(connections["alice"].status == UserStatus::ACTIVO && 
+    assert(connections.get("alice")->status == UserStatus::ACTIVO && 
            "Estado no cambió a ACTIVO tras enviar mensaje");
     std::cout << "- Estado cambiado automáticamente a ACTIVO tras enviar mensaje\n";
 
     std::cout << "test_inactivity: Todas las pruebas pasaron\n";
 }
 
+void test_timing_wheel()
+{
+    std::cout << "test_timing_wheel\n";
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    TimingWheel wheel(milliseconds(100), start);
+    std::vector<uint32_t> expired;
+
+    // Un plazo vence en el primer tick que empieza en o después de él
+    wheel.schedule(1, start + milliseconds(250));
+    size_t due = wheel.advance(start + milliseconds(200), expired);
+    assert(due == 0);
+    due = wheel.advance(start + milliseconds(300), expired);
+    assert(due == 1 && expired[0] == 1);
+    assert(!wheel.contains(1) && wheel.size() == 0);
+
+    // Reprogramar mueve el plazo; cancelar lo quita
+    expired.clear();
+    wheel.schedule(2, start + seconds(1));
+    wheel.schedule(2, start + seconds(5));
+    wheel.schedule(3, start + seconds(2));
+    assert(wheel.size() == 2);
+    bool cancelled = wheel.cancel(3);
+    bool cancelled_again = wheel.cancel(3);
+    assert(cancelled && !cancelled_again);
+    due = wheel.advance(start + seconds(3), expired);
+    assert(due == 0);
+    assert(wheel.contains(2));
+    due = wheel.advance(start + seconds(5), expired);
+    assert(due == 1 && expired[0] == 2);
+
+    // Plazos en todos los niveles, reprogramados al azar, vencen dentro del
+    // paso en que se alcanzan y nunca antes.
+    TimingWheel big(milliseconds(100), start);
+    std::mt19937 rng(3);
+    const uint32_t keys = 2000;
+    std::vector<steady_clock::time_point> deadline(keys + 1);
+    std::vector<bool> pending(keys + 1, false);
+    for (uint32_t k = 1; k <= keys; k++)
+    {
+        // Hasta ~12 h: pasa por los cuatro niveles de la rueda
+        deadline[k] = start + milliseconds(rng() % (12 * 3600 * 1000));
+        big.schedule(k, deadline[k]);
+        pending[k] = true;
+    }
+    for (uint32_t k = 1; k <= keys; k += 7)
+    {
+        deadline[k] = start + milliseconds(rng() % (12 * 3600 * 1000));
+        big.schedule(k, deadline[k]);
+    }
+    size_t total = 0;
+    const auto step = seconds(7);
+    for (auto now = start; total < keys; now += step)
+    {
+        expired.clear();
+        total += big.advance(now, expired);
+        for (uint32_t k : expired)
+        {
+            assert(pending[k] && "Llave vencida dos veces");
+            assert(deadline[k] <= now && "Plazo vencido antes de tiempo");
+            assert(now - deadline[k] < step + milliseconds(100) && "Plazo vencido tarde");
+            pending[k] = false;
+        }
+        assert(now < start + hours(13));
+    }
+    assert(big.size() == 0);
+
+    std::cout << "test_timing_wheel: Todas las pruebas pasaron\n";
+}
+
+void test_disconnection_cleanup()
+{
+    std::cout << "test_disconnection_cleanup\n";
+    using namespace std::chrono;
+    connections.clear();
+
+    MockConnection conn_alice("127.0.0.1");
+    MockConnection conn_bob("127.0.0.1");
+    MockConnection conn_carol("127.0.0.1");
+    WebSocketHandler::on_open(conn_alice, "alice");
+    WebSocketHandler::on_open(conn_bob, "bob");
+    WebSocketHandler::on_open(conn_carol, "carol");
+
+    // alice se desconecta; bob se desconecta y vuelve; carol sigue conectada
+    WebSocketHandler::on_close(conn_alice, "Test", 1000);
+    WebSocketHandler::on_close(conn_bob, "Test", 1000);
+    assert(disconnect_timers.contains(user_ids.find("alice")));
+    assert(disconnect_timers.contains(user_ids.find("bob")));
+    MockConnection conn_bob2("127.0.0.1");
+    WebSocketHandler::on_open(conn_bob2, "bob");
+    assert(!disconnect_timers.contains(user_ids.find("bob")) && "La reconexión debe cancelar el plazo");
+    assert(!disconnect_timers.contains(user_ids.find("carol")));
+
+    // Antes de los 5 minutos no se elimina nada
+    size_t evicted = WebSocketHandler::evict_disconnected(steady_clock::now() + minutes(4));
+    assert(evicted == 0);
+    assert(connections.contains("alice"));
+
+    // Vencido el plazo solo se elimina la sesión desconectada
+    evicted = WebSocketHandler::evict_disconnected(steady_clock::now() + minutes(5) + seconds(2));
+    assert(evicted == 1);
+    assert(!connections.contains("alice") && "La sesión desconectada debía eliminarse");
+    assert(connections.contains("bob") && connections.contains("carol"));
+    assert(disconnect_timers.size() == 0);
+
+    std::cout << "test_disconnection_cleanup: Todas las pruebas pasaron\n";
+}
+
 extern bool testing_mode;
 int main()
 {
@@ -875,16 +2792,39 @@ int main()
     {
         test_invalid_usernames();
         test_on_open_and_duplicate();
+        test_session_binding();
         test_list_users();
+        test_user_list_snapshot();
+        test_presence_batching();
+        test_presence_subscriptions();
+        test_rooms();
+        test_offline_mailbox();
         test_handle_get_user_info();
         test_handle_change_status();
         test_inactive_status_not_reactivated_by_non_message_opcode();
         test_inactive_status_reactivated_by_message_opcode();
+        test_frame_reader();
+        test_protocol_schema();
         test_handle_send_message();
+        test_shared_frame_fanout();
+        test_fanout_executor_batches();
+        test_slow_consumer_policies();
         test_handle_get_history();
+        test_history_store();
+        test_history_paging();
+        test_search();
+        test_user_ids();
+        test_message_log();
+        test_session_snapshot();
+        test_logger();
+        test_log_levels();
+        test_binary_log();
+        test_log_rotation();
         test_user_disconnection();
         test_message_size_limit();
         test_keep_status();
+        test_timing_wheel();
+        test_disconnection_cleanup();
         test_inactivity();
 
         std::cout << "\nTodos los tests de test_server pasaron con éxito.\n";